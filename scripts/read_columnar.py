@@ -0,0 +1,148 @@
+#!/usr/bin/env python3
+"""Reads column files written by the bridge's columnar sink.
+
+Prints the tables and row counts of each file, or the rows of one table as
+CSV with --table. Only needs the standard library; columns come out as
+memoryviews over the block, so loading them into numpy is a
+np.frombuffer() away.
+"""
+
+import argparse
+import csv
+import struct
+import sys
+
+FILE_MAGIC = b"BRCOLUMN"
+BLOCK_MAGIC = b"CBLK"
+VERSION = 1
+
+# FieldType order in packet_parser.hpp; 10 is a byte array.
+TYPES = {
+    0: ("uint8", "B"), 1: ("uint16", "H"), 2: ("uint32", "I"), 3: ("uint64", "Q"),
+    4: ("int8", "b"), 5: ("int16", "h"), 6: ("int32", "i"), 7: ("int64", "q"),
+    8: ("float32", "f"), 9: ("float64", "d"), 10: ("bytes", "B"),
+}
+
+
+def _crc32c_table():
+    table = []
+    for i in range(256):
+        crc = i
+        for _ in range(8):
+            crc = (crc >> 1) ^ 0x82F63B78 if crc & 1 else crc >> 1
+        table.append(crc)
+    return table
+
+
+CRC32C_TABLE = _crc32c_table()
+
+
+def crc32c(data):
+    crc = 0xFFFFFFFF
+    for byte in data:
+        crc = CRC32C_TABLE[(crc ^ byte) & 0xFF] ^ (crc >> 8)
+    return crc ^ 0xFFFFFFFF
+
+
+class Column:
+    def __init__(self, name, type_code, elements, data):
+        self.name = name
+        self.type, fmt = TYPES[type_code]
+        self.elements = elements
+        self.values = data.cast(fmt)
+
+    def row(self, i):
+        if self.type == "bytes":
+            return bytes(self.values[i * self.elements:(i + 1) * self.elements]).hex()
+        if self.elements == 1:
+            return self.values[i]
+        return list(self.values[i * self.elements:(i + 1) * self.elements])
+
+
+class Block:
+    def __init__(self, table, rows, columns):
+        self.table = table
+        self.rows = rows
+        self.columns = columns
+
+
+def read_blocks(path, verify=True):
+    with open(path, "rb") as f:
+        data = memoryview(f.read())
+    if bytes(data[:8]) != FILE_MAGIC:
+        raise ValueError(f"{path}: not a column file")
+    version, = struct.unpack_from("<I", data, 8)
+    if version != VERSION:
+        raise ValueError(f"{path}: unsupported version {version}")
+    pos = 24
+    while pos < len(data):
+        if bytes(data[pos:pos + 4]) != BLOCK_MAGIC:
+            raise ValueError(f"{path}: bad block magic at offset {pos}")
+        header_bytes, data_bytes, rows, ncolumns, name_length = struct.unpack_from("<IQIII", data, pos + 4)
+        end = pos + header_bytes + data_bytes
+        if end + 8 > len(data):
+            raise ValueError(f"{path}: truncated block at offset {pos}")
+        if verify:
+            stored, = struct.unpack_from("<I", data, end)
+            if crc32c(data[pos:end]) != stored:
+                raise ValueError(f"{path}: CRC mismatch in block at offset {pos}")
+        at = pos + 32
+        table = bytes(data[at:at + name_length]).decode()
+        at += name_length
+        descs = []
+        for _ in range(ncolumns):
+            type_code, _, length, elements = struct.unpack_from("<BBHI", data, at)
+            at += 8
+            descs.append((bytes(data[at:at + length]).decode(), type_code, elements))
+            at += length
+        at = pos + header_bytes
+        columns = []
+        for name, type_code, elements in descs:
+            width = struct.calcsize(TYPES[type_code][1])
+            size = rows * elements * width
+            columns.append(Column(name, type_code, elements, data[at:at + size]))
+            at += (size + 7) & ~7
+        yield Block(table, rows, columns)
+        pos = end + 8
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Read bridge column files")
+    parser.add_argument("files", nargs="+")
+    parser.add_argument("--table", help="print the rows of this table as CSV")
+    parser.add_argument("--limit", type=int, default=0, help="stop after this many rows (0 = all)")
+    parser.add_argument("--no-verify", action="store_true", help="skip the CRC32C check (faster)")
+    args = parser.parse_args()
+
+    if args.table:
+        out = csv.writer(sys.stdout)
+        header = None
+        printed = 0
+        for path in args.files:
+            for block in read_blocks(path, not args.no_verify):
+                if block.table != args.table:
+                    continue
+                if header is None:
+                    header = [c.name for c in block.columns]
+                    out.writerow(header)
+                for i in range(block.rows):
+                    out.writerow([c.row(i) for c in block.columns])
+                    printed += 1
+                    if args.limit and printed >= args.limit:
+                        return
+        return
+
+    for path in args.files:
+        tables = {}
+        for block in read_blocks(path, not args.no_verify):
+            entry = tables.setdefault(block.table, [0, 0, block.columns])
+            entry[0] += 1
+            entry[1] += block.rows
+        print(path)
+        for table, (blocks, rows, columns) in sorted(tables.items()):
+            schema = ", ".join(f"{c.name}:{c.type}" + (f"[{c.elements}]" if c.elements > 1 else "") for c in columns)
+            print(f"  {table}: {rows} rows in {blocks} blocks ({schema})")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,345 @@
+#include "byte_encoding.hpp"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define TCP_MQTT_BRIDGE_HAVE_X86_SIMD 1
+#endif
+
+namespace byte_encoding {
+
+namespace {
+
+constexpr char LOWER_DIGITS[] = "0123456789abcdef";
+constexpr char UPPER_DIGITS[] = "0123456789ABCDEF";
+constexpr char BASE64_ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// Each kernel converts a prefix of the input and returns how many bytes it
+// took; the scalar loops finish the rest.
+
+size_t hex_scalar(const uint8_t* in, size_t n, char* out, const char* digits) {
+    for (size_t i = 0; i < n; ++i) {
+        out[2 * i] = digits[in[i] >> 4];
+        out[2 * i + 1] = digits[in[i] & 0x0F];
+    }
+    return n;
+}
+
+// Encodes whole groups of three bytes into four characters.
+size_t base64_scalar(const uint8_t* in, size_t n, char* out) {
+    size_t i = 0;
+    for (; i + 3 <= n; i += 3, out += 4) {
+        uint32_t v = uint32_t(in[i]) << 16 | uint32_t(in[i + 1]) << 8 | in[i + 2];
+        out[0] = BASE64_ALPHABET[v >> 18];
+        out[1] = BASE64_ALPHABET[(v >> 12) & 0x3F];
+        out[2] = BASE64_ALPHABET[(v >> 6) & 0x3F];
+        out[3] = BASE64_ALPHABET[v & 0x3F];
+    }
+    return i;
+}
+
+bool needs_escape(uint8_t c) {
+    return c < 0x20 || c == '"' || c == '\\';
+}
+
+size_t clean_prefix_scalar(const uint8_t* in, size_t n) {
+    size_t i = 0;
+    while (i < n && !needs_escape(in[i])) ++i;
+    return i;
+}
+
+void escape_byte(uint8_t c, std::string& out) {
+    switch (c) {
+    case '"':  out += "\\\""; return;
+    case '\\': out += "\\\\"; return;
+    case '\b': out += "\\b"; return;
+    case '\f': out += "\\f"; return;
+    case '\n': out += "\\n"; return;
+    case '\r': out += "\\r"; return;
+    case '\t': out += "\\t"; return;
+    default: break;
+    }
+    char u[6] = {'\\', 'u', '0', '0', LOWER_DIGITS[c >> 4], LOWER_DIGITS[c & 0x0F]};
+    out.append(u, sizeof(u));
+}
+
+#ifdef TCP_MQTT_BRIDGE_HAVE_X86_SIMD
+__attribute__((target("ssse3")))
+size_t hex_ssse3(const uint8_t* in, size_t n, char* out, const char* digits) {
+    const __m128i lut = _mm_loadu_si128(reinterpret_cast<const __m128i*>(digits));
+    const __m128i low_nibble = _mm_set1_epi8(0x0F);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        __m128i hi = _mm_shuffle_epi8(lut, _mm_and_si128(_mm_srli_epi16(v, 4), low_nibble));
+        __m128i lo = _mm_shuffle_epi8(lut, _mm_and_si128(v, low_nibble));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2 * i), _mm_unpacklo_epi8(hi, lo));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2 * i + 16), _mm_unpackhi_epi8(hi, lo));
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+size_t hex_avx2(const uint8_t* in, size_t n, char* out, const char* digits) {
+    const __m256i lut = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(digits)));
+    const __m256i low_nibble = _mm256_set1_epi8(0x0F);
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+        __m256i hi = _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(v, 4), low_nibble));
+        __m256i lo = _mm256_shuffle_epi8(lut, _mm256_and_si256(v, low_nibble));
+        // The unpacks work per 128-bit lane: a holds bytes 0-7 and 16-23,
+        // b bytes 8-15 and 24-31.
+        __m256i a = _mm256_unpacklo_epi8(hi, lo);
+        __m256i b = _mm256_unpackhi_epi8(hi, lo);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 2 * i), _mm256_permute2x128_si256(a, b, 0x20));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 2 * i + 32), _mm256_permute2x128_si256(a, b, 0x31));
+    }
+    return i;
+}
+
+// Base64 after Wojciech Muła: a shuffle spreads each three input bytes over
+// a 32-bit word, two multiplies move the four 6-bit indices into separate
+// bytes, and a 16-entry table of offsets maps each index range to its
+// alphabet range.
+__attribute__((target("ssse3")))
+__m128i base64_indices_ssse3(__m128i v) {
+    v = _mm_shuffle_epi8(v, _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+    __m128i t0 = _mm_mulhi_epu16(_mm_and_si128(v, _mm_set1_epi32(0x0FC0FC00)), _mm_set1_epi32(0x04000040));
+    __m128i t1 = _mm_mullo_epi16(_mm_and_si128(v, _mm_set1_epi32(0x003F03F0)), _mm_set1_epi32(0x01000010));
+    return _mm_or_si128(t0, t1);
+}
+
+__attribute__((target("ssse3")))
+__m128i base64_ascii_ssse3(__m128i indices) {
+    const __m128i offsets = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                          '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+    // 0-25 -> 13, 26-51 -> 0, 52-61 -> 1..10, 62 -> 11, 63 -> 12
+    __m128i range = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+    range = _mm_or_si128(range, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), indices), _mm_set1_epi8(13)));
+    return _mm_add_epi8(indices, _mm_shuffle_epi8(offsets, range));
+}
+
+// Reads 16 bytes to encode 12, so stops 4 bytes short of the end.
+__attribute__((target("ssse3")))
+size_t base64_ssse3(const uint8_t* in, size_t n, char* out) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 12, out += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out), base64_ascii_ssse3(base64_indices_ssse3(v)));
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+size_t base64_avx2(const uint8_t* in, size_t n, char* out) {
+    const __m256i spread = _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+                                            1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+    const __m256i offsets = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                             '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+                                             'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                             '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+    size_t i = 0;
+    // Each lane takes 12 of the 24 bytes; the upper load ends at i + 28.
+    for (; i + 28 <= n; i += 24, out += 32) {
+        __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i + 12));
+        __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+        v = _mm256_shuffle_epi8(v, spread);
+        __m256i t0 = _mm256_mulhi_epu16(_mm256_and_si256(v, _mm256_set1_epi32(0x0FC0FC00)), _mm256_set1_epi32(0x04000040));
+        __m256i t1 = _mm256_mullo_epi16(_mm256_and_si256(v, _mm256_set1_epi32(0x003F03F0)), _mm256_set1_epi32(0x01000010));
+        __m256i indices = _mm256_or_si256(t0, t1);
+        __m256i range = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+        range = _mm256_or_si256(range, _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices), _mm256_set1_epi8(13)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), _mm256_add_epi8(indices, _mm256_shuffle_epi8(offsets, range)));
+    }
+    return i;
+}
+
+// SSE2 is part of x86-64, so the 16-byte scan needs no dispatch.
+size_t clean_prefix_sse2(const uint8_t* in, size_t n) {
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i control = _mm_set1_epi8(0x1F);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        __m128i special = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)),
+                                       _mm_cmpeq_epi8(_mm_min_epu8(v, control), v));
+        if (int mask = _mm_movemask_epi8(special)) return i + static_cast<size_t>(__builtin_ctz(mask));
+    }
+    return i + clean_prefix_scalar(in + i, n - i);
+}
+
+__attribute__((target("avx2")))
+size_t clean_prefix_avx2(const uint8_t* in, size_t n) {
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    const __m256i control = _mm256_set1_epi8(0x1F);
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+        __m256i special = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, quote), _mm256_cmpeq_epi8(v, backslash)),
+                                          _mm256_cmpeq_epi8(_mm256_min_epu8(v, control), v));
+        if (uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(special))) {
+            return i + static_cast<size_t>(__builtin_ctz(mask));
+        }
+    }
+    return i + clean_prefix_sse2(in + i, n - i);
+}
+
+bool have_ssse3() {
+    static const bool supported = __builtin_cpu_supports("ssse3");
+    return supported;
+}
+
+bool have_avx2() {
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported;
+}
+#endif
+
+size_t hex_prefix(const uint8_t* in, size_t n, char* out, const char* digits) {
+#ifdef TCP_MQTT_BRIDGE_HAVE_X86_SIMD
+    if (have_avx2()) return hex_avx2(in, n, out, digits);
+    if (have_ssse3()) return hex_ssse3(in, n, out, digits);
+#endif
+    return 0;
+}
+
+size_t base64_prefix(const uint8_t* in, size_t n, char* out) {
+#ifdef TCP_MQTT_BRIDGE_HAVE_X86_SIMD
+    if (have_avx2()) return base64_avx2(in, n, out);
+    if (have_ssse3()) return base64_ssse3(in, n, out);
+#endif
+    return 0;
+}
+
+size_t clean_prefix(const uint8_t* in, size_t n) {
+#ifdef TCP_MQTT_BRIDGE_HAVE_X86_SIMD
+    if (have_avx2()) return clean_prefix_avx2(in, n);
+    return clean_prefix_sse2(in, n);
+#else
+    return clean_prefix_scalar(in, n);
+#endif
+}
+
+int hex_digit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+int base64_digit(char c) {
+    if (c >= 'A' && c <= 'Z') return c - 'A';
+    if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+    if (c >= '0' && c <= '9') return c - '0' + 52;
+    if (c == '+') return 62;
+    if (c == '/') return 63;
+    return -1;
+}
+
+}
+
+std::optional<Encoding> parse(std::string_view name) {
+    if (name == "hex") return Encoding::Hex;
+    if (name == "base64") return Encoding::Base64;
+    if (name == "string") return Encoding::String;
+    if (name == "raw") return Encoding::Raw;
+    return std::nullopt;
+}
+
+const char* name(Encoding encoding) {
+    switch (encoding) {
+    case Encoding::Hex: return "hex";
+    case Encoding::Base64: return "base64";
+    case Encoding::String: return "string";
+    case Encoding::Raw: return "raw";
+    }
+    return "unknown";
+}
+
+void hex(std::span<const uint8_t> in, std::string& out, bool upper) {
+    const char* digits = upper ? UPPER_DIGITS : LOWER_DIGITS;
+    size_t start = out.size();
+    out.resize(start + 2 * in.size());
+    char* dst = out.data() + start;
+    size_t done = hex_prefix(in.data(), in.size(), dst, digits);
+    hex_scalar(in.data() + done, in.size() - done, dst + 2 * done, digits);
+}
+
+void base64(std::span<const uint8_t> in, std::string& out) {
+    size_t start = out.size();
+    out.resize(start + (in.size() + 2) / 3 * 4);
+    char* dst = out.data() + start;
+    size_t done = base64_prefix(in.data(), in.size(), dst);
+    done += base64_scalar(in.data() + done, in.size() - done, dst + done / 3 * 4);
+    dst += done / 3 * 4;
+    size_t rest = in.size() - done;
+    if (rest == 0) return;
+    uint32_t v = uint32_t(in[done]) << 16 | (rest == 2 ? uint32_t(in[done + 1]) << 8 : 0);
+    dst[0] = BASE64_ALPHABET[v >> 18];
+    dst[1] = BASE64_ALPHABET[(v >> 12) & 0x3F];
+    dst[2] = rest == 2 ? BASE64_ALPHABET[(v >> 6) & 0x3F] : '=';
+    dst[3] = '=';
+}
+
+void json_escape(std::span<const uint8_t> in, std::string& out) {
+    out.reserve(out.size() + in.size());
+    size_t i = 0;
+    while (i < in.size()) {
+        size_t clean = clean_prefix(in.data() + i, in.size() - i);
+        out.append(reinterpret_cast<const char*>(in.data() + i), clean);
+        i += clean;
+        if (i < in.size()) escape_byte(in[i++], out);
+    }
+}
+
+std::span<const uint8_t> trim_nuls(std::span<const uint8_t> in) {
+    size_t n = in.size();
+    while (n > 0 && in[n - 1] == 0) --n;
+    return in.first(n);
+}
+
+std::optional<std::vector<uint8_t>> from_hex(std::string_view text) {
+    if (text.size() % 2 != 0) return std::nullopt;
+    std::vector<uint8_t> bytes(text.size() / 2);
+    for (size_t i = 0; i < bytes.size(); ++i) {
+        int hi = hex_digit(text[2 * i]);
+        int lo = hex_digit(text[2 * i + 1]);
+        if (hi < 0 || lo < 0) return std::nullopt;
+        bytes[i] = static_cast<uint8_t>(hi << 4 | lo);
+    }
+    return bytes;
+}
+
+std::optional<std::vector<uint8_t>> from_base64(std::string_view text) {
+    // Padding is optional.
+    while (!text.empty() && text.back() == '=') text.remove_suffix(1);
+    if (text.size() % 4 == 1) return std::nullopt;
+    std::vector<uint8_t> bytes;
+    bytes.reserve(text.size() * 3 / 4);
+    uint32_t bits = 0;
+    int count = 0;
+    for (char c : text) {
+        int d = base64_digit(c);
+        if (d < 0) return std::nullopt;
+        bits = bits << 6 | static_cast<uint32_t>(d);
+        if (++count == 4) {
+            bytes.push_back(static_cast<uint8_t>(bits >> 16));
+            bytes.push_back(static_cast<uint8_t>(bits >> 8));
+            bytes.push_back(static_cast<uint8_t>(bits));
+            bits = 0;
+            count = 0;
+        }
+    }
+    if (count == 2) {
+        bytes.push_back(static_cast<uint8_t>(bits >> 4));
+    } else if (count == 3) {
+        bytes.push_back(static_cast<uint8_t>(bits >> 10));
+        bytes.push_back(static_cast<uint8_t>(bits >> 2));
+    }
+    return bytes;
+}
+
+}
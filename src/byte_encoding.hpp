@@ -0,0 +1,43 @@
+#ifndef TCP_MQTT_BRIDGE_BYTE_ENCODING_HPP
+#define TCP_MQTT_BRIDGE_BYTE_ENCODING_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Text forms of bytearray fields. The encoders append to the output string
+// and use SSSE3 (hex, base64) or SSE2 (escape scan) over 16 bytes at a time,
+// or AVX2 over 32 when the CPU has it; short tails go through the scalar
+// code.
+namespace byte_encoding {
+
+enum class Encoding : uint8_t {
+    Hex,        // lowercase hex digits, two per byte
+    Base64,     // RFC 4648 with padding
+    String,     // text with trailing NULs dropped, JSON-escaped in templates
+    Raw         // the bytes unchanged
+};
+
+std::optional<Encoding> parse(std::string_view name);
+const char* name(Encoding encoding);
+
+void hex(std::span<const uint8_t> in, std::string& out, bool upper = false);
+void base64(std::span<const uint8_t> in, std::string& out);
+// Escapes `"`, `\` and control characters for use inside a JSON string
+// literal. Other bytes, including UTF-8 sequences, are copied as they are.
+void json_escape(std::span<const uint8_t> in, std::string& out);
+
+// The bytes before the run of NULs that pads a fixed-length text field.
+std::span<const uint8_t> trim_nuls(std::span<const uint8_t> in);
+
+// Inverses for downlink payloads; nothing on malformed input.
+std::optional<std::vector<uint8_t>> from_hex(std::string_view text);
+std::optional<std::vector<uint8_t>> from_base64(std::string_view text);
+
+}
+
+#endif // TCP_MQTT_BRIDGE_BYTE_ENCODING_HPP
@@ -0,0 +1,152 @@
+#include "capture.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+namespace capture {
+
+namespace {
+
+constexpr char MAGIC[8] = {'B', 'R', 'C', 'A', 'P', 'T', 'U', 'R'};
+constexpr size_t HEADER_SIZE = 24;
+constexpr size_t FLUSH_THRESHOLD = 64 * 1024;
+
+void put_varint(std::vector<uint8_t>& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+uint64_t get_varint(const std::vector<uint8_t>& in, size_t& pos) {
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (pos >= in.size()) throw CaptureError("truncated capture record");
+        uint8_t byte = in[pos++];
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return value;
+    }
+    throw CaptureError("malformed varint in capture");
+}
+
+template <typename T>
+void put_le(std::vector<uint8_t>& out, T value) {
+    for (size_t i = 0; i < sizeof(T); ++i) out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+}
+
+template <typename T>
+T get_le(const std::vector<uint8_t>& in, size_t pos) {
+    T value = 0;
+    for (size_t i = 0; i < sizeof(T); ++i) value |= static_cast<T>(in[pos + i]) << (8 * i);
+    return value;
+}
+
+}
+
+Writer::Writer(const std::string& path)
+    : file_(std::fopen(path.c_str(), "wb"))
+    , last_(std::chrono::steady_clock::now())
+{
+    if (!file_) throw CaptureError("cannot open capture file " + path + ": " + std::strerror(errno));
+
+    std::vector<uint8_t> header(MAGIC, MAGIC + sizeof(MAGIC));
+    put_le<uint32_t>(header, VERSION);
+    put_le<uint32_t>(header, 0);
+    put_le<uint64_t>(header, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count()));
+    std::fwrite(header.data(), 1, header.size(), file_);
+    buffer_.reserve(2 * FLUSH_THRESHOLD);
+    spdlog::info("Capturing raw device streams to {}", path);
+}
+
+Writer::~Writer() {
+    flush();
+    std::fclose(file_);
+}
+
+uint32_t Writer::open(uint8_t framing, const std::string& remote) {
+    std::vector<uint8_t> payload;
+    payload.reserve(remote.size() + 1);
+    payload.push_back(framing);
+    payload.insert(payload.end(), remote.begin(), remote.end());
+    std::lock_guard lock(mutex_);
+    uint32_t id = next_connection_++;
+    append(RecordType::Open, id, payload);
+    return id;
+}
+
+void Writer::data(uint32_t connection, std::span<const uint8_t> bytes) {
+    std::lock_guard lock(mutex_);
+    append(RecordType::Data, connection, bytes);
+}
+
+void Writer::close(uint32_t connection) {
+    std::lock_guard lock(mutex_);
+    append(RecordType::Close, connection, {});
+    // Keep the file usable if the process dies later.
+    std::fwrite(buffer_.data(), 1, buffer_.size(), file_);
+    buffer_.clear();
+    std::fflush(file_);
+}
+
+void Writer::flush() {
+    std::lock_guard lock(mutex_);
+    std::fwrite(buffer_.data(), 1, buffer_.size(), file_);
+    buffer_.clear();
+    std::fflush(file_);
+}
+
+void Writer::append(RecordType type, uint32_t connection, std::span<const uint8_t> payload) {
+    auto now = std::chrono::steady_clock::now();
+    auto delta = std::chrono::duration_cast<std::chrono::nanoseconds>(now - last_).count();
+    last_ = now;
+
+    buffer_.push_back(static_cast<uint8_t>(type));
+    put_varint(buffer_, connection);
+    put_varint(buffer_, static_cast<uint64_t>(delta));
+    put_varint(buffer_, payload.size());
+    buffer_.insert(buffer_.end(), payload.begin(), payload.end());
+    if (buffer_.size() >= FLUSH_THRESHOLD) {
+        std::fwrite(buffer_.data(), 1, buffer_.size(), file_);
+        buffer_.clear();
+    }
+}
+
+Reader::Reader(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) throw CaptureError("cannot open capture file " + path);
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    if (data.size() < HEADER_SIZE || std::memcmp(data.data(), MAGIC, sizeof(MAGIC)) != 0)
+        throw CaptureError(path + " is not a capture file");
+    if (auto version = get_le<uint32_t>(data, 8); version != VERSION)
+        throw CaptureError(path + ": unsupported capture version " + std::to_string(version));
+    start_ns_ = get_le<uint64_t>(data, 16);
+
+    size_t pos = HEADER_SIZE;
+    std::chrono::nanoseconds offset{0};
+    while (pos < data.size()) {
+        Record record;
+        record.type = static_cast<RecordType>(data[pos++]);
+        if (record.type != RecordType::Open && record.type != RecordType::Data && record.type != RecordType::Close)
+            throw CaptureError("unknown capture record type at offset " + std::to_string(pos - 1));
+        record.connection = static_cast<uint32_t>(get_varint(data, pos));
+        offset += std::chrono::nanoseconds(get_varint(data, pos));
+        record.offset = offset;
+        uint64_t length = get_varint(data, pos);
+        if (length > data.size() - pos) {
+            // A capture cut short by a crash: keep what is complete.
+            spdlog::warn("Capture {} ends with a truncated record", path);
+            break;
+        }
+        record.payload.assign(data.begin() + static_cast<ptrdiff_t>(pos), data.begin() + static_cast<ptrdiff_t>(pos + length));
+        pos += length;
+        records_.push_back(std::move(record));
+    }
+}
+
+}
@@ -0,0 +1,82 @@
+#ifndef TCP_MQTT_BRIDGE_CAPTURE_HPP
+#define TCP_MQTT_BRIDGE_CAPTURE_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Raw stream capture. A capture file starts with a 24-byte header
+// ("BRCAPTUR", version, reserved, wall clock start in ns) followed by
+// records: type byte, then LEB128 connection id, nanoseconds since the
+// previous record and payload length, then the payload. Open records carry the
+// framing kind byte followed by the remote address; data records carry the
+// bytes exactly as returned by one socket read.
+namespace capture {
+
+constexpr uint32_t VERSION = 1;
+
+enum class RecordType : uint8_t {
+    Open = 1,
+    Data = 2,
+    Close = 3
+};
+
+class CaptureError : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+// Shared by every session of the process; records are appended under a lock.
+class Writer {
+public:
+    explicit Writer(const std::string& path);
+    ~Writer();
+
+    Writer(const Writer&) = delete;
+    Writer& operator=(const Writer&) = delete;
+
+    // Starts a connection and returns its id for the following records.
+    uint32_t open(uint8_t framing, const std::string& remote);
+    void data(uint32_t connection, std::span<const uint8_t> bytes);
+    void close(uint32_t connection);
+    void flush();
+
+private:
+    void append(RecordType type, uint32_t connection, std::span<const uint8_t> payload);
+
+    std::mutex mutex_;
+    std::FILE* file_;
+    std::vector<uint8_t> buffer_;
+    std::chrono::steady_clock::time_point last_;
+    uint32_t next_connection_{0};
+};
+
+struct Record {
+    RecordType type;
+    uint32_t connection;
+    std::chrono::nanoseconds offset;     // since the start of the capture
+    std::vector<uint8_t> payload;
+};
+
+// Reads a whole capture file into memory.
+class Reader {
+public:
+    explicit Reader(const std::string& path);
+
+    const std::vector<Record>& records() const { return records_; }
+    uint64_t startWallClockNs() const { return start_ns_; }
+
+private:
+    std::vector<Record> records_;
+    uint64_t start_ns_{0};
+};
+
+}
+
+#endif // TCP_MQTT_BRIDGE_CAPTURE_HPP
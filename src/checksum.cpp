@@ -0,0 +1,161 @@
+#include "checksum.hpp"
+
+#include <array>
+#include <bit>
+#include <cstring>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <nmmintrin.h>
+#define TCP_MQTT_BRIDGE_HAVE_SSE42_CRC 1
+#endif
+
+namespace checksum {
+
+namespace {
+
+using Tables = std::array<std::array<uint32_t, 256>, 8>;
+
+// Table k maps a byte followed by k zero bytes to its effect on the CRC, so
+// eight bytes are folded with eight independent lookups.
+constexpr Tables reflected_tables(uint32_t poly) {
+    Tables t{};
+    for (uint32_t b = 0; b < 256; ++b) {
+        uint32_t crc = b;
+        for (int i = 0; i < 8; ++i) crc = (crc >> 1) ^ ((crc & 1) ? poly : 0);
+        t[0][b] = crc;
+    }
+    for (size_t k = 1; k < 8; ++k) {
+        for (size_t b = 0; b < 256; ++b) t[k][b] = (t[k - 1][b] >> 8) ^ t[0][t[k - 1][b] & 0xFF];
+    }
+    return t;
+}
+
+// MSB-first variant for 16-bit CRCs that are not reflected.
+constexpr Tables msb16_tables(uint32_t poly) {
+    Tables t{};
+    for (uint32_t b = 0; b < 256; ++b) {
+        uint32_t crc = b << 8;
+        for (int i = 0; i < 8; ++i) crc = ((crc & 0x8000) ? (crc << 1) ^ poly : crc << 1) & 0xFFFF;
+        t[0][b] = crc;
+    }
+    for (size_t k = 1; k < 8; ++k) {
+        for (size_t b = 0; b < 256; ++b) t[k][b] = ((t[k - 1][b] << 8) & 0xFFFF) ^ t[0][t[k - 1][b] >> 8];
+    }
+    return t;
+}
+
+constexpr Tables CRC16_CCITT = msb16_tables(0x1021);
+constexpr Tables CRC16_MODBUS = reflected_tables(0xA001);
+constexpr Tables CRC32 = reflected_tables(0xEDB88320);
+constexpr Tables CRC32C = reflected_tables(0x82F63B78);
+
+uint32_t load_le32(const uint8_t* p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    if constexpr (std::endian::native == std::endian::big) v = __builtin_bswap32(v);
+    return v;
+}
+
+uint32_t crc_reflected(const Tables& t, uint32_t crc, const uint8_t* p, size_t n) {
+    for (; n >= 8; p += 8, n -= 8) {
+        uint32_t lo = load_le32(p) ^ crc;
+        uint32_t hi = load_le32(p + 4);
+        crc = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^ t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24] ^
+              t[3][hi & 0xFF] ^ t[2][(hi >> 8) & 0xFF] ^ t[1][(hi >> 16) & 0xFF] ^ t[0][hi >> 24];
+    }
+    for (; n > 0; ++p, --n) crc = (crc >> 8) ^ t[0][(crc ^ *p) & 0xFF];
+    return crc;
+}
+
+uint32_t crc_msb16(const Tables& t, uint32_t crc, const uint8_t* p, size_t n) {
+    for (; n >= 8; p += 8, n -= 8) {
+        crc = t[7][p[0] ^ (crc >> 8)] ^ t[6][p[1] ^ (crc & 0xFF)] ^ t[5][p[2]] ^ t[4][p[3]] ^
+              t[3][p[4]] ^ t[2][p[5]] ^ t[1][p[6]] ^ t[0][p[7]];
+    }
+    for (; n > 0; ++p, --n) crc = ((crc << 8) & 0xFFFF) ^ t[0][(crc >> 8) ^ *p];
+    return crc;
+}
+
+#ifdef TCP_MQTT_BRIDGE_HAVE_SSE42_CRC
+__attribute__((target("sse4.2")))
+uint32_t crc32c_sse42(uint32_t crc, const uint8_t* p, size_t n) {
+    uint64_t crc64 = crc;
+    for (; n >= 8; p += 8, n -= 8) {
+        uint64_t v;
+        std::memcpy(&v, p, sizeof(v));
+        crc64 = _mm_crc32_u64(crc64, v);
+    }
+    crc = static_cast<uint32_t>(crc64);
+    for (; n > 0; ++p, --n) crc = _mm_crc32_u8(crc, *p);
+    return crc;
+}
+
+bool have_sse42() {
+    static const bool supported = __builtin_cpu_supports("sse4.2");
+    return supported;
+}
+#endif
+
+uint32_t crc32c(const uint8_t* p, size_t n) {
+#ifdef TCP_MQTT_BRIDGE_HAVE_SSE42_CRC
+    if (have_sse42()) return ~crc32c_sse42(0xFFFFFFFF, p, n);
+#endif
+    return ~crc_reflected(CRC32C, 0xFFFFFFFF, p, n);
+}
+
+}
+
+std::optional<Algorithm> parse(std::string_view name) {
+    if (name == "crc16_ccitt") return Algorithm::Crc16Ccitt;
+    if (name == "crc16_modbus") return Algorithm::Crc16Modbus;
+    if (name == "crc32") return Algorithm::Crc32;
+    if (name == "crc32c") return Algorithm::Crc32c;
+    if (name == "xor8") return Algorithm::Xor8;
+    if (name == "sum8") return Algorithm::Sum8;
+    return std::nullopt;
+}
+
+const char* name(Algorithm algorithm) {
+    switch (algorithm) {
+    case Algorithm::Crc16Ccitt: return "crc16_ccitt";
+    case Algorithm::Crc16Modbus: return "crc16_modbus";
+    case Algorithm::Crc32: return "crc32";
+    case Algorithm::Crc32c: return "crc32c";
+    case Algorithm::Xor8: return "xor8";
+    case Algorithm::Sum8: return "sum8";
+    }
+    return "unknown";
+}
+
+size_t width(Algorithm algorithm) {
+    switch (algorithm) {
+    case Algorithm::Crc16Ccitt: case Algorithm::Crc16Modbus: return 2;
+    case Algorithm::Crc32: case Algorithm::Crc32c: return 4;
+    case Algorithm::Xor8: case Algorithm::Sum8: return 1;
+    }
+    return 0;
+}
+
+uint32_t compute(Algorithm algorithm, std::span<const uint8_t> data) {
+    const uint8_t* p = data.data();
+    size_t n = data.size();
+    switch (algorithm) {
+    case Algorithm::Crc16Ccitt: return crc_msb16(CRC16_CCITT, 0xFFFF, p, n);
+    case Algorithm::Crc16Modbus: return crc_reflected(CRC16_MODBUS, 0xFFFF, p, n);
+    case Algorithm::Crc32: return ~crc_reflected(CRC32, 0xFFFFFFFF, p, n);
+    case Algorithm::Crc32c: return crc32c(p, n);
+    case Algorithm::Xor8: {
+        uint8_t x = 0;
+        for (size_t i = 0; i < n; ++i) x ^= p[i];
+        return x;
+    }
+    case Algorithm::Sum8: {
+        uint8_t s = 0;
+        for (size_t i = 0; i < n; ++i) s = static_cast<uint8_t>(s + p[i]);
+        return s;
+    }
+    }
+    return 0;
+}
+
+}
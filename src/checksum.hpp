@@ -0,0 +1,32 @@
+#ifndef TCP_MQTT_BRIDGE_CHECKSUM_HPP
+#define TCP_MQTT_BRIDGE_CHECKSUM_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string_view>
+
+// Checksums devices append to their packets. CRCs use slice-by-8 tables;
+// CRC32C uses the SSE4.2 crc32 instruction when the CPU has it.
+namespace checksum {
+
+enum class Algorithm : uint8_t {
+    Crc16Ccitt,     // poly 0x1021, init 0xFFFF, not reflected (CRC-16/CCITT-FALSE)
+    Crc16Modbus,    // poly 0x8005 reflected, init 0xFFFF
+    Crc32,          // IEEE 802.3 (zlib, Ethernet)
+    Crc32c,         // Castagnoli (iSCSI, ext4)
+    Xor8,           // XOR of all bytes
+    Sum8            // sum of all bytes modulo 256
+};
+
+std::optional<Algorithm> parse(std::string_view name);
+const char* name(Algorithm algorithm);
+// Size of the checksum in bytes: 1, 2 or 4.
+size_t width(Algorithm algorithm);
+
+uint32_t compute(Algorithm algorithm, std::span<const uint8_t> data);
+
+}
+
+#endif // TCP_MQTT_BRIDGE_CHECKSUM_HPP
@@ -0,0 +1,299 @@
+#include "columnar_sink.hpp"
+#include "checksum.hpp"
+#include "metrics.hpp"
+
+#include <spdlog/spdlog.h>
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+
+namespace columnar {
+
+namespace {
+
+static_assert(std::endian::native == std::endian::little, "column files are written in host byte order");
+
+constexpr char FILE_MAGIC[8] = {'B', 'R', 'C', 'O', 'L', 'U', 'M', 'N'};
+constexpr char BLOCK_MAGIC[4] = {'C', 'B', 'L', 'K'};
+constexpr size_t BLOCK_HEADER_SIZE = 32;
+constexpr size_t MAX_SPARE_BLOCKS = 4;
+constexpr uint8_t TIMESTAMP_TYPE = static_cast<uint8_t>(FieldType::INT64);
+
+template <typename T>
+void put_le(std::vector<uint8_t>& out, T value) {
+    for (size_t i = 0; i < sizeof(T); ++i) out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+}
+
+void pad8(std::vector<uint8_t>& out) {
+    out.resize((out.size() + 7) & ~size_t(7), 0);
+}
+
+void copy_swapped(uint8_t* out, const uint8_t* in, size_t width, size_t elements) {
+    for (size_t e = 0; e < elements; ++e, in += width, out += width) {
+        switch (width) {
+        case 2: { uint16_t v; std::memcpy(&v, in, 2); v = __builtin_bswap16(v); std::memcpy(out, &v, 2); break; }
+        case 4: { uint32_t v; std::memcpy(&v, in, 4); v = __builtin_bswap32(v); std::memcpy(out, &v, 4); break; }
+        case 8: { uint64_t v; std::memcpy(&v, in, 8); v = __builtin_bswap64(v); std::memcpy(out, &v, 8); break; }
+        default: std::reverse_copy(in, in + width, out); break;
+        }
+    }
+}
+
+metrics::Counter& write_errors() {
+    static auto& counter = metrics::counter("columnar_write_errors_total", "Column blocks lost to file errors");
+    return counter;
+}
+
+}
+
+bool ColumnarSink::Column::sameLayout(const Column& other) const {
+    return name == other.name && type == other.type && offset == other.offset &&
+           width == other.width && elements == other.elements && swap == other.swap;
+}
+
+ColumnarSink::ColumnarSink(const Configuration::ColumnarConfig& config)
+    : config_(config)
+{
+    std::filesystem::create_directories(config_.directory);
+    writer_ = std::thread([this] { run(); });
+    spdlog::info("Writing columnar packets to {}", config_.directory);
+}
+
+ColumnarSink::~ColumnarSink() {
+    {
+        std::lock_guard lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_one();
+    writer_.join();
+}
+
+std::vector<ColumnarSink::Column> ColumnarSink::layout(const PacketDesc& packet) const {
+    std::vector<Column> columns;
+    columns.reserve(packet.fields.size() + 1);
+    columns.push_back(Column{"_time_ns", TIMESTAMP_TYPE, 0, sizeof(int64_t), 1, false, {}});
+    for (const auto& field : packet.fields) {
+        size_t size = field_size(field);
+        size_t elements = field.type == FieldType::BYTEARRAY ? size : field.count.value_or(1);
+        size_t width = elements ? size / elements : 0;
+        bool swap = field.big_endian && field.type != FieldType::BYTEARRAY && width > 1;
+        columns.push_back(Column{field.name, static_cast<uint8_t>(field.type), field.offset, width, elements, swap, {}});
+    }
+    for (auto& column : columns) column.data.resize(config_.block_rows * column.stride());
+    return columns;
+}
+
+ColumnarSink::Table& ColumnarSink::tableFor(const PacketDbSnapshotPtr& snapshot, const PacketDesc& packet) {
+    if (snapshot != current_) {
+        current_ = snapshot;
+        by_index_.assign(snapshot->db().size(), nullptr);
+    }
+    size_t index = static_cast<size_t>(&packet - snapshot->db().data());
+    if (Table* table = by_index_[index]) return *table;
+
+    // First packet of this type since the definitions were (re)loaded.
+    auto [it, created] = tables_.try_emplace(packet.name);
+    Table& table = it->second;
+    auto columns = layout(packet);
+    bool same = !created && columns.size() == table.columns.size() &&
+                std::equal(columns.begin(), columns.end(), table.columns.begin(),
+                           [](const Column& a, const Column& b) { return a.sameLayout(b); });
+    if (!same) {
+        if (!created) {
+            spdlog::info("Columnar table {} changed layout, starting a new block", packet.name);
+            seal(table);
+        }
+        table.name = packet.name;
+        table.columns = std::move(columns);
+    }
+    table.snapshot = snapshot;
+    table.desc = &packet;
+    by_index_[index] = &table;
+    return table;
+}
+
+void ColumnarSink::write(const PacketDbSnapshotPtr& snapshot, const PacketDesc& packet,
+                         std::span<const uint8_t> bytes, int64_t timestamp_ns) {
+    static auto& rows = metrics::counter("columnar_rows_total", "Packets appended to column tables");
+    static auto& dropped = metrics::counter("columnar_rows_dropped_total", "Rows dropped because the column writer fell behind");
+
+    std::lock_guard lock(mutex_);
+    Table& table = tableFor(snapshot, packet);
+    size_t row = table.rows;
+    std::memcpy(table.columns[0].data.data() + row * sizeof(int64_t), &timestamp_ns, sizeof(int64_t));
+    for (size_t c = 1; c < table.columns.size(); ++c) {
+        auto& column = table.columns[c];
+        size_t stride = column.stride();
+        uint8_t* out = column.data.data() + row * stride;
+        if (column.swap) {
+            copy_swapped(out, bytes.data() + column.offset, column.width, column.elements);
+        } else {
+            std::memcpy(out, bytes.data() + column.offset, stride);
+        }
+    }
+    rows.inc();
+    if (++table.rows < config_.block_rows) return;
+
+    if (queue_.size() >= config_.max_queued_blocks) {
+        dropped.inc(table.rows);
+        spdlog::warn("Column writer is {} blocks behind, dropping {} rows of {}", queue_.size(), table.rows, table.name);
+        table.rows = 0;
+        return;
+    }
+    seal(table);
+}
+
+void ColumnarSink::seal(Table& table) {
+    if (table.rows == 0) return;
+
+    std::vector<uint8_t> block;
+    if (!spare_.empty()) {
+        block = std::move(spare_.back());
+        spare_.pop_back();
+        block.clear();
+    }
+
+    block.insert(block.end(), BLOCK_MAGIC, BLOCK_MAGIC + sizeof(BLOCK_MAGIC));
+    put_le<uint32_t>(block, 0);     // header bytes, patched below
+    put_le<uint64_t>(block, 0);     // data bytes, patched below
+    put_le<uint32_t>(block, static_cast<uint32_t>(table.rows));
+    put_le<uint32_t>(block, static_cast<uint32_t>(table.columns.size()));
+    put_le<uint32_t>(block, static_cast<uint32_t>(table.name.size()));
+    put_le<uint32_t>(block, 0);
+    block.insert(block.end(), table.name.begin(), table.name.end());
+    for (const auto& column : table.columns) {
+        block.push_back(column.type);
+        block.push_back(0);
+        put_le<uint16_t>(block, static_cast<uint16_t>(column.name.size()));
+        put_le<uint32_t>(block, static_cast<uint32_t>(column.elements));
+        block.insert(block.end(), column.name.begin(), column.name.end());
+    }
+    pad8(block);
+    size_t header_bytes = block.size();
+
+    for (const auto& column : table.columns) {
+        block.insert(block.end(), column.data.begin(), column.data.begin() + static_cast<std::ptrdiff_t>(table.rows * column.stride()));
+        pad8(block);
+    }
+    uint32_t header32 = static_cast<uint32_t>(header_bytes);
+    uint64_t data_bytes = block.size() - header_bytes;
+    std::memcpy(block.data() + 4, &header32, sizeof(header32));
+    std::memcpy(block.data() + 8, &data_bytes, sizeof(data_bytes));
+
+    table.rows = 0;
+    queue_.push_back(std::move(block));
+    wake_.notify_one();
+}
+
+void ColumnarSink::run() {
+    const auto interval = std::chrono::milliseconds(config_.flush_interval_ms);
+    auto next_flush = std::chrono::steady_clock::now() + interval;
+
+    std::unique_lock lock(mutex_);
+    for (;;) {
+        wake_.wait_until(lock, next_flush, [this] { return stopping_ || !queue_.empty(); });
+        auto now = std::chrono::steady_clock::now();
+        bool flush = stopping_ || now >= next_flush;
+        if (flush) {
+            for (auto& [name, table] : tables_) seal(table);
+            next_flush = now + interval;
+        }
+        bool done = stopping_;
+        std::deque<std::vector<uint8_t>> blocks;
+        blocks.swap(queue_);
+        lock.unlock();
+
+        for (const auto& block : blocks) writeBlock(block);
+        if (flush && file_) {
+            std::fflush(file_);
+            if (config_.rotate_interval_s > 0 && now - opened_ >= std::chrono::seconds(config_.rotate_interval_s)) {
+                closeFile();
+            }
+        }
+
+        lock.lock();
+        for (auto& block : blocks) {
+            if (spare_.size() >= MAX_SPARE_BLOCKS) break;
+            spare_.push_back(std::move(block));
+        }
+        if (done) break;
+    }
+    lock.unlock();
+    closeFile();
+}
+
+void ColumnarSink::writeBlock(const std::vector<uint8_t>& block) {
+    static auto& blocks = metrics::counter("columnar_blocks_total", "Column blocks written");
+    static auto& bytes = metrics::counter("columnar_bytes_total", "Bytes written to column files");
+
+    if (!file_) openFile();
+    if (!file_) {
+        write_errors().inc();
+        return;
+    }
+    std::vector<uint8_t> trailer;
+    put_le<uint32_t>(trailer, checksum::compute(checksum::Algorithm::Crc32c, block));
+    put_le<uint32_t>(trailer, 0);
+    if (std::fwrite(block.data(), 1, block.size(), file_) != block.size() ||
+        std::fwrite(trailer.data(), 1, trailer.size(), file_) != trailer.size()) {
+        spdlog::error("Failed to write column file {}: {}", path_, std::strerror(errno));
+        write_errors().inc();
+        closeFile();
+        return;
+    }
+    file_bytes_ += block.size() + trailer.size();
+    blocks.inc();
+    bytes.inc(block.size() + trailer.size());
+    if (config_.rotate_bytes > 0 && file_bytes_ >= config_.rotate_bytes) closeFile();
+}
+
+void ColumnarSink::openFile() {
+    static auto& files = metrics::counter("columnar_files_total", "Column files started");
+
+    auto wall = std::chrono::system_clock::now();
+    std::time_t seconds = std::chrono::system_clock::to_time_t(wall);
+    std::tm utc{};
+    gmtime_r(&seconds, &utc);
+    char stamp[32];
+    std::strftime(stamp, sizeof(stamp), "%Y%m%dT%H%M%SZ", &utc);
+    path_ = fmt::format("{}/{}-{}-{}.col", config_.directory, config_.prefix, stamp, sequence_++);
+
+    file_ = std::fopen((path_ + ".part").c_str(), "wb");
+    if (!file_) {
+        spdlog::error("Cannot open column file {}: {}", path_, std::strerror(errno));
+        return;
+    }
+    std::vector<uint8_t> header(FILE_MAGIC, FILE_MAGIC + sizeof(FILE_MAGIC));
+    put_le<uint32_t>(header, VERSION);
+    put_le<uint32_t>(header, 0);
+    put_le<uint64_t>(header, static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(wall.time_since_epoch()).count()));
+    std::fwrite(header.data(), 1, header.size(), file_);
+    file_bytes_ = header.size();
+    opened_ = std::chrono::steady_clock::now();
+    files.inc();
+}
+
+void ColumnarSink::closeFile() {
+    if (!file_) return;
+    bool failed = std::fclose(file_) != 0;
+    file_ = nullptr;
+    if (failed) {
+        spdlog::error("Failed to close column file {}: {}", path_, std::strerror(errno));
+        write_errors().inc();
+    }
+    std::error_code ec;
+    std::filesystem::rename(path_ + ".part", path_, ec);
+    if (ec) {
+        spdlog::error("Cannot rename {}.part: {}", path_, ec.message());
+    } else {
+        spdlog::info("Closed column file {} ({} bytes)", path_, file_bytes_);
+    }
+}
+
+}
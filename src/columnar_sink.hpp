@@ -0,0 +1,111 @@
+#ifndef TCP_MQTT_BRIDGE_COLUMNAR_SINK_HPP
+#define TCP_MQTT_BRIDGE_COLUMNAR_SINK_HPP
+
+#include "config.hpp"
+#include "sink.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Append-only column files for high-rate packets. Rows are appended to one
+// table per packet type, each field to its own typed column, and a table is
+// sealed into a block once it holds block_rows rows or flush_interval_ms has
+// passed. A writer thread appends sealed blocks to the current file and
+// rotates it by size or age; a file is written as <name>.col.part and
+// renamed to <name>.col when it is closed.
+//
+// A file is a 24-byte header ("BRCOLUMN", version, reserved, wall clock
+// creation time in ns) followed by blocks. All integers are little-endian.
+// Each block is self-describing:
+//
+//   "CBLK", header bytes (u32), data bytes (u64), rows (u32), columns (u32),
+//   table name length (u32), reserved (u32), table name, then per column:
+//   type (u8, FieldType order, 10 = bytes), reserved (u8), name length (u16),
+//   elements per row (u32), name; zero padded to a multiple of 8.
+//
+// The column data follows, one column after the other, each padded to a
+// multiple of 8 bytes, then a trailer: CRC32C of the block so far (u32) and
+// four zero bytes. The first column is `_time_ns`, the int64 wall clock time
+// the frame was decoded. Field values are stored as the packet carries them,
+// converted to little-endian; derived fields are not stored.
+namespace columnar {
+
+constexpr uint32_t VERSION = 1;
+
+class ColumnarSink : public Sink {
+public:
+    explicit ColumnarSink(const Configuration::ColumnarConfig& config);
+    // Writes everything still buffered and closes the current file.
+    ~ColumnarSink() override;
+
+    ColumnarSink(const ColumnarSink&) = delete;
+    ColumnarSink& operator=(const ColumnarSink&) = delete;
+
+    void write(const PacketDbSnapshotPtr& snapshot, const PacketDesc& packet,
+               std::span<const uint8_t> bytes, int64_t timestamp_ns) override;
+
+private:
+    struct Column {
+        std::string name;
+        uint8_t type;
+        size_t offset;              // in the packet
+        size_t width;               // bytes per element
+        size_t elements;            // per row
+        bool swap;                  // big-endian elements, reversed on the way in
+        std::vector<uint8_t> data;  // block_rows rows
+
+        size_t stride() const { return width * elements; }
+        bool sameLayout(const Column& other) const;
+    };
+
+    struct Table {
+        std::string name;
+        // Pins the definitions `desc` points into, so its address cannot be
+        // reused by a later snapshot while the table still compares against it.
+        PacketDbSnapshotPtr snapshot;
+        const PacketDesc* desc = nullptr;
+        std::vector<Column> columns;    // `_time_ns` first
+        size_t rows = 0;
+    };
+
+    Table& tableFor(const PacketDbSnapshotPtr& snapshot, const PacketDesc& packet);
+    std::vector<Column> layout(const PacketDesc& packet) const;
+    void seal(Table& table);
+    void run();
+    void writeBlock(const std::vector<uint8_t>& block);
+    void openFile();
+    void closeFile();
+
+    const Configuration::ColumnarConfig config_;
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::unordered_map<std::string, Table> tables_;
+    PacketDbSnapshotPtr current_;       // snapshot by_index_ refers to
+    std::vector<Table*> by_index_;      // tables by packet index in current_
+    std::deque<std::vector<uint8_t>> queue_;    // sealed blocks for the writer
+    std::vector<std::vector<uint8_t>> spare_;   // written blocks kept for reuse
+    bool stopping_{false};
+
+    // Writer thread only.
+    std::FILE* file_{nullptr};
+    std::string path_;
+    uint64_t file_bytes_{0};
+    std::chrono::steady_clock::time_point opened_;
+    uint32_t sequence_{0};
+
+    std::thread writer_;
+};
+
+}
+
+#endif // TCP_MQTT_BRIDGE_COLUMNAR_SINK_HPP
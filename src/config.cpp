@@ -1,12 +1,79 @@
 #include "config.hpp"
 
+#include <filesystem>
+
+namespace {
+
+Configuration::RateLimitConfig parseRateLimit(const YAML::Node& node) {
+    Configuration::RateLimitConfig limit;
+    if (!node) return limit;
+    limit.frames_per_sec = node["frames_per_sec"].as<double>(0);
+    limit.bytes_per_sec = node["bytes_per_sec"].as<double>(0);
+    limit.burst_s = node["burst_s"].as<double>(1.0);
+    limit.max_queued_frames = node["max_queued_frames"].as<size_t>(256);
+    return limit;
+}
+
+// `raw: {ring_bytes, max_resync_bytes}` for listeners with raw framing.
+void parseRawFraming(const YAML::Node& node, Configuration::TcpConfig& tcp) {
+    if (!node) return;
+    tcp.raw_ring_bytes = node["ring_bytes"].as<size_t>(64 * 1024);
+    tcp.raw_max_resync_bytes = node["max_resync_bytes"].as<size_t>(4096);
+    if (tcp.raw_ring_bytes == 0) throw std::runtime_error("raw.ring_bytes must be positive");
+}
+
+Configuration::TlsConfig parseTls(const YAML::Node& node, bool verify_default) {
+    Configuration::TlsConfig tls;
+    tls.verify_peer = verify_default;
+    if (!node) return tls;
+    tls.enabled = node["enabled"].as<bool>(true);
+    tls.cert_file = node["cert"].as<std::string>("");
+    tls.key_file = node["key"].as<std::string>("");
+    tls.ca_file = node["ca"].as<std::string>("");
+    tls.verify_peer = node["verify_peer"].as<bool>(verify_default);
+    tls.server_name = node["server_name"].as<std::string>("");
+    tls.ktls = node["ktls"].as<bool>(true);
+    tls.session_cache_size = node["session_cache_size"].as<size_t>(1024);
+    return tls;
+}
+
+}
+
 Configuration Configuration::fromYaml(const std::string& path) {
     Configuration config;
+    config.packet_defs.base_dir = std::filesystem::path(path).parent_path().string();
     try {
         auto yaml = YAML::LoadFile(path);
         if (const auto& tcp = yaml["tcp"]) {
             config.tcp.port = tcp["port"].as<unsigned short>();
             config.tcp.bind_address = tcp["bind"].as<std::string>();
+            config.tcp.framing = tcp["framing"].as<std::string>("slip");
+            parseRawFraming(tcp["raw"], config.tcp);
+            config.tcp.rate_limit = parseRateLimit(tcp["rate_limit"]);
+            config.tcp.tls = parseTls(tcp["tls"], false);
+        }
+        if (const auto& listeners = yaml["listeners"]) {
+            for (const auto& listener : listeners) {
+                TcpConfig tcp;
+                tcp.port = listener["port"].as<unsigned short>();
+                tcp.bind_address = listener["bind"].as<std::string>("0.0.0.0");
+                tcp.framing = listener["framing"].as<std::string>("slip");
+                parseRawFraming(listener["raw"], tcp);
+                tcp.rate_limit = parseRateLimit(listener["rate_limit"]);
+                tcp.tls = parseTls(listener["tls"], false);
+                config.listeners.push_back(std::move(tcp));
+            }
+        }
+        if (const auto& udp = yaml["udp"]) {
+            for (const auto& listener : udp) {
+                UdpConfig cfg;
+                cfg.port = listener["port"].as<unsigned short>();
+                cfg.bind_address = listener["bind"].as<std::string>("0.0.0.0");
+                cfg.ack = listener["ack"].as<bool>(true);
+                cfg.batch = listener["batch"].as<size_t>(64);
+                cfg.max_datagram = listener["max_datagram"].as<size_t>(2048);
+                config.udp.push_back(std::move(cfg));
+            }
         }
         if (const auto& mqtt = yaml["mqtt"]) {
             if (mqtt["broker"]) {
@@ -27,10 +94,82 @@ Configuration Configuration::fromYaml(const std::string& path) {
                 config.mqtt.port = mqtt["port"].as<uint16_t>(1883);
             }
             config.mqtt.client_id = mqtt["client_id"].as<std::string>();
+            config.mqtt.max_inflight = mqtt["max_inflight"].as<size_t>(config.mqtt.max_inflight);
+            if (const auto& lanes = mqtt["lanes"]) {
+                const char* names[] = {"high", "normal", "low"};
+                for (size_t i = 0; i < config.mqtt.lanes.size(); ++i) {
+                    auto& lane = config.mqtt.lanes[i];
+                    if (const auto& node = lanes[names[i]]) {
+                        lane.max_queued = node["max_queued"].as<size_t>(lane.max_queued);
+                        lane.dedicated_connection = node["dedicated_connection"].as<bool>(false);
+                    }
+                }
+            }
+            // The broker's certificate is checked unless turned off explicitly.
+            config.mqtt.tls = parseTls(mqtt["tls"], true);
+            if (const auto& overload = mqtt["overload"]) {
+                auto& o = config.mqtt.overload;
+                o.latency_ms = overload["latency_ms"].as<uint32_t>(0);
+                o.queue_depth = overload["queue_depth"].as<size_t>(0);
+                o.recover_ratio = overload["recover_ratio"].as<double>(0.5);
+                auto mode = overload["mode"].as<std::string>("shed");
+                if (mode == "shed") {
+                    o.mode = Configuration::OverloadConfig::Mode::Shed;
+                } else if (mode == "latest") {
+                    o.mode = Configuration::OverloadConfig::Mode::Latest;
+                } else {
+                    throw std::runtime_error("Unknown mqtt.overload.mode '" + mode + "' (expected shed or latest)");
+                }
+            }
         }
         if (const auto& logging = yaml["logging"]) {
             config.log_level = logging["level"].as<std::string>("debug");
         }
+        if (const auto& metrics = yaml["metrics"]) {
+            config.metrics.log_interval_s = metrics["log_interval_s"].as<uint32_t>(0);
+            config.metrics.bind_address = metrics["bind"].as<std::string>("127.0.0.1");
+            config.metrics.port = metrics["port"].as<unsigned short>(0);
+        }
+        if (const auto& trace = yaml["trace"]) {
+            config.trace.sample_every = trace["sample_every"].as<uint32_t>(0);
+            config.trace.buffer_events = trace["buffer_events"].as<size_t>(4096);
+            config.trace.output = trace["output"].as<std::string>("bridge_trace.json");
+            config.trace.dump_interval_s = trace["dump_interval_s"].as<uint32_t>(0);
+        }
+        if (const auto& capture = yaml["capture"]) {
+            config.capture.path = capture["path"].as<std::string>("");
+        }
+        if (const auto& columnar = yaml["columnar"]) {
+            auto& c = config.columnar;
+            c.directory = columnar["directory"].as<std::string>("");
+            c.prefix = columnar["prefix"].as<std::string>("bridge");
+            c.block_rows = columnar["block_rows"].as<size_t>(65536);
+            c.flush_interval_ms = columnar["flush_interval_ms"].as<uint32_t>(1000);
+            c.rotate_bytes = columnar["rotate_mb"].as<uint64_t>(256) << 20;
+            c.rotate_interval_s = columnar["rotate_interval_s"].as<uint32_t>(3600);
+            c.max_queued_blocks = columnar["max_queued_blocks"].as<size_t>(64);
+            if (c.block_rows == 0 || c.block_rows > UINT32_MAX)
+                throw std::runtime_error("columnar.block_rows must be between 1 and 2^32-1");
+            if (c.flush_interval_ms == 0)
+                throw std::runtime_error("columnar.flush_interval_ms must be positive");
+        }
+        if (const auto& memory = yaml["memory"]) {
+            config.memory.sample_interval_s = memory["sample_interval_s"].as<uint32_t>(0);
+            config.memory.top_n = memory["top_n"].as<size_t>(10);
+            if (const auto& soak = memory["soak"]) {
+                config.memory.soak_duration_s = soak["duration_s"].as<uint32_t>(0);
+                config.memory.soak_warmup_s = soak["warmup_s"].as<uint32_t>(60);
+                config.memory.soak_max_growth = soak["max_growth_pct"].as<double>(10.0) / 100.0;
+            }
+        }
+        if (const auto& scheduler = yaml["scheduler"]) {
+            config.scheduler.quantum_bytes = scheduler["quantum_bytes"].as<size_t>(1024);
+            config.scheduler.budget_bytes = scheduler["budget_bytes"].as<size_t>(65536);
+        }
+        if (const auto& pipeline = yaml["pipeline"]) {
+            config.pipeline.workers = pipeline["workers"].as<size_t>(0);
+            config.pipeline.queue_capacity = pipeline["queue_capacity"].as<size_t>(1024);
+        }
         if (const auto& packet_defs = yaml["packet_defs"]) {
             if (const auto& paths = packet_defs["paths"]) {
                 config.packet_defs.paths = paths.as<std::vector<std::string>>();
@@ -38,6 +177,8 @@ Configuration Configuration::fromYaml(const std::string& path) {
             if (const auto& patterns = packet_defs["patterns"]) {
                 config.packet_defs.patterns = patterns.as<std::vector<std::string>>();
             }
+            config.packet_defs.watch_interval_ms = packet_defs["watch_interval_ms"].as<uint32_t>(0);
+            config.packet_defs.cache = packet_defs["cache"].as<std::string>("");
         }
     } catch (const YAML::Exception& e) {
         spdlog::warn("Config parse error: {}. Using defaults.", e.what());
@@ -45,6 +186,12 @@ Configuration Configuration::fromYaml(const std::string& path) {
     return config;
 }
 
+std::vector<Configuration::TcpConfig> Configuration::allListeners() const {
+    std::vector<TcpConfig> all{tcp};
+    all.insert(all.end(), listeners.begin(), listeners.end());
+    return all;
+}
+
 spdlog::level::level_enum Configuration::parseLogLevel(const std::string& level) {
     static const std::unordered_map<std::string, spdlog::level::level_enum> levels = {
         {"trace", spdlog::level::trace},
@@ -3,37 +3,159 @@
 
 #include <yaml-cpp/yaml.h>
 #include <spdlog/spdlog.h>
+#include <array>
 #include <string>
 #include <vector>
 #include <unordered_map>
 
 class Configuration {
 public:
+    // Per-session limits; a rate of 0 means unlimited.
+    struct RateLimitConfig {
+        double frames_per_sec = 0;
+        double bytes_per_sec = 0;
+        double burst_s = 1.0;           // bucket depth, in seconds of traffic
+        size_t max_queued_frames = 256; // frames beyond this are NAKed
+    };
+
+    // TLS for a device listener (server side) or the broker link (client side).
+    struct TlsConfig {
+        bool enabled = false;
+        std::string cert_file;          // PEM chain; required for listeners
+        std::string key_file;
+        std::string ca_file;            // trusted CAs for verifying the peer
+        bool verify_peer = false;       // listeners: require client certificates
+        std::string server_name;        // broker link: SNI and name to verify, default mqtt.host
+        bool ktls = true;               // hand record encryption to the kernel when possible
+        size_t session_cache_size = 1024;
+    };
+
     struct TcpConfig {
         unsigned short port = 12345;
         std::string bind_address = "0.0.0.0";
+        std::string framing = "slip";   // slip | cobs | length_prefix | raw
+        size_t raw_ring_bytes = 64 * 1024;      // raw framing: bytes buffered per session
+        size_t raw_max_resync_bytes = 4096;     // raw framing: unmatched bytes skipped before dropping the buffer
+        RateLimitConfig rate_limit;
+        TlsConfig tls;
+    };
+
+    struct UdpConfig {
+        unsigned short port = 12346;
+        std::string bind_address = "0.0.0.0";
+        bool ack = true;            // reply with a one-byte ACK/NAK datagram
+        size_t batch = 64;          // datagrams per recvmmsg call
+        size_t max_datagram = 2048;
+    };
+
+    struct LaneConfig {
+        size_t max_queued = 0;              // 0 = unbounded; beyond this publishes fail
+        bool dedicated_connection = false;  // publish over a separate broker connection
+    };
+
+    // Sheds QoS 0 publishes while the broker falls behind. The load ratio is
+    // the larger of smoothed latency / latency_ms and queued / queue_depth;
+    // each whole step of it sheds one more priority lane from the bottom.
+    struct OverloadConfig {
+        enum class Mode { Shed, Latest };
+
+        uint32_t latency_ms = 0;            // 0 = latency is not watched
+        size_t queue_depth = 0;             // 0 = queue depth is not watched
+        double recover_ratio = 0.5;         // a level is left below this share of its threshold
+        Mode mode = Mode::Shed;             // Latest: keep only the newest queued value per topic
+
+        bool enabled() const { return latency_ms > 0 || queue_depth > 0; }
     };
 
     struct MqttConfig {
         std::string host = "localhost";
         uint16_t port = 1883;
         std::string client_id = "tcp_bridge";
+        size_t max_inflight = 256;          // outstanding publishes on the shared connection, 0 = unlimited
+        // Indexed by packet priority: high, normal, low.
+        std::array<LaneConfig, 3> lanes = {LaneConfig{0, false}, LaneConfig{10000, false}, LaneConfig{1000, false}};
+        OverloadConfig overload;
+        TlsConfig tls;
 
         std::string getBrokerUrl() const {
             return fmt::format("tcp://{}:{}", host, port);
         }
     };
 
-    TcpConfig tcp;
+    struct MetricsConfig {
+        uint32_t log_interval_s = 0;    // 0 disables the periodic metrics log line
+        std::string bind_address = "127.0.0.1";
+        unsigned short port = 0;        // 0 disables the HTTP /metrics endpoint
+    };
+
+    struct TraceConfig {
+        uint32_t sample_every = 0;      // trace one in N frames, 0 = off
+        size_t buffer_events = 4096;    // per-thread ring of recorded stages
+        std::string output = "bridge_trace.json";
+        uint32_t dump_interval_s = 0;   // 0 = dump on SIGUSR1 only
+    };
+
+    struct CaptureConfig {
+        std::string path;               // raw stream capture file, empty = off
+    };
+
+    // Append-only column files for packets with `output: columnar`.
+    struct ColumnarConfig {
+        std::string directory;              // empty = off
+        std::string prefix = "bridge";      // file names are <prefix>-<UTC time>-<n>.col
+        size_t block_rows = 65536;          // rows per packet type before a block is sealed
+        uint32_t flush_interval_ms = 1000;  // partial blocks are sealed and written this often
+        uint64_t rotate_bytes = 256ull << 20;   // start a new file past this size, 0 = never
+        uint32_t rotate_interval_s = 3600;      // or once a file is this old, 0 = never
+        size_t max_queued_blocks = 64;      // sealed blocks waiting for the disk before rows are dropped
+    };
+
+    // Deficit round robin across sessions with queued frames.
+    struct SchedulerConfig {
+        size_t quantum_bytes = 1024;    // credit each session earns per round
+        size_t budget_bytes = 65536;    // work per turn before yielding to socket I/O
+    };
+
+    // Parsing and rendering on worker threads instead of the I/O thread.
+    struct PipelineConfig {
+        size_t workers = 0;             // 0 = everything runs on the I/O thread
+        size_t queue_capacity = 1024;   // frames queued per worker
+    };
+
+    // Memory accounting, reported on /memory and as memory_* gauges.
+    struct MemoryConfig {
+        uint32_t sample_interval_s = 0; // 0 = gauges only refresh when /memory is read
+        size_t top_n = 10;              // connections listed by /memory
+        uint32_t soak_duration_s = 0;   // run a soak test for this long, then exit; 0 = off
+        uint32_t soak_warmup_s = 60;    // samples before this are ignored
+        double soak_max_growth = 0.10;  // allowed growth between the first and last quarter
+    };
+
+    TcpConfig tcp;                      // primary listener (`tcp:` section)
+    std::vector<TcpConfig> listeners;   // additional listeners (`listeners:` section)
+    std::vector<UdpConfig> udp;
     MqttConfig mqtt;
+    MetricsConfig metrics;
+    SchedulerConfig scheduler;
+    PipelineConfig pipeline;
+    TraceConfig trace;
+    CaptureConfig capture;
+    ColumnarConfig columnar;
+    MemoryConfig memory;
     struct PacketDefsConfig {
         std::vector<std::string> paths;
         std::vector<std::string> patterns = {"*.yaml", "*.yml"};
+        std::string base_dir;               // relative paths are resolved against this
+        uint32_t watch_interval_ms = 0;     // 0 disables polling for changed files
+        std::string cache;                  // compiled definition cache file, empty = off
     };
 
     std::string log_level = "debug";
     PacketDefsConfig packet_defs;
 
+    // The primary listener followed by any additional ones.
+    std::vector<TcpConfig> allListeners() const;
+
     static Configuration fromYaml(const std::string& path);
     static spdlog::level::level_enum parseLogLevel(const std::string& level);
 };
@@ -1,62 +1,300 @@
 #include "connection_manager.hpp"
+#include "tcp_session.hpp"
 #include "packet_parser.hpp"
+#include "metrics.hpp"
+#include "handler_memory.hpp"
+#include "trace.hpp"
 #include <spdlog/spdlog.h>
 #include <inja/inja.hpp>
+#include <algorithm>
 
-ConnectionManager::ConnectionManager(boost::asio::ip::tcp::socket& socket, const PacketDb& packet_db, MqttClient& mqtt_client)
-    : socket_(socket)
-    , address_(socket.remote_endpoint().address().to_string())
-    , packet_processor_(packet_db, mqtt_client)
+namespace {
+
+metrics::Gauge& queued_frames() {
+    static auto& gauge = metrics::gauge("session_queued_frames", "Frames waiting for their session's turn");
+    return gauge;
+}
+
+// How long a raw stream waits before offering its head packet again to a
+// worker whose queue was full.
+constexpr auto worker_full_retry = std::chrono::milliseconds(1);
+
+}
+
+ConnectionManager::ConnectionManager(DeviceStream& stream, const PacketDbStore& packet_db, MqttClient& mqtt_client,
+                                     PublishBatcher& batcher, DeviceRouter& router, FairScheduler& scheduler, Pipeline* pipeline,
+                                     const Configuration::RateLimitConfig& limits, framing::Kind framing,
+                                     framing::RawLimits raw_limits, Sink* sink)
+    : stream_(stream)
+    , address_(stream.socket().remote_endpoint().address().to_string())
+    , packet_processor_(packet_db, sink)
+    , codec_(framing, &packet_db, raw_limits)
+    , raw_(codec_.raw())
     , mqtt_client_(mqtt_client)
+    , batcher_(batcher)
+    , router_(router)
+    , scheduler_(scheduler)
+    , pipeline_(pipeline)
+    , sink_(sink)
+    , worker_(pipeline ? pipeline->assignWorker() : 0)
+    , max_queued_frames_(limits.max_queued_frames)
+    , frame_limit_(limits.frames_per_sec, limits.frames_per_sec * limits.burst_s)
+    , byte_limit_(limits.bytes_per_sec, limits.bytes_per_sec * limits.burst_s)
 {
-    decoder_.setPacketHandler([this](std::span<const uint8_t> packet) {
+    codec_.setPacketHandler([this](std::span<const uint8_t> packet) {
         this->handlePacket(packet);
     });
 }
 
+ConnectionManager::~ConnectionManager() {
+    queued_frames().sub(static_cast<int64_t>(pending_frames_.size()));
+    for (const auto& device_id : device_ids_) {
+        router_.forget(device_id, this);
+    }
+}
+
+memstats::SessionUsage ConnectionManager::memoryUsage() const {
+    // Hash nodes carry a next pointer and the cached hash; deque elements are
+    // counted without their block overhead.
+    constexpr size_t HASH_NODE_OVERHEAD = 2 * sizeof(void*);
+    memstats::SessionUsage usage;
+    usage.session = sizeof(TcpSession) + sizeof(ConnectionManager) + memstats::string_bytes(address_) +
+                    device_ids_.capacity() * sizeof(std::string) +
+                    packet_limits_.bucket_count() * sizeof(void*);
+    for (const auto& device_id : device_ids_) usage.session += memstats::string_bytes(device_id);
+    for (const auto& [name, limit] : packet_limits_) {
+        usage.session += HASH_NODE_OVERHEAD + sizeof(decltype(packet_limits_)::value_type) + memstats::string_bytes(name);
+    }
+    usage.decoder = codec_.bufferCapacity();
+    usage.decoder_high_water = codec_.highWater();
+    usage.json = packet_processor_.memoryUsage();
+    for (const auto& frame : pending_frames_) usage.queues += sizeof(PendingFrame) + frame.data.capacity();
+    for (const auto& [data, on_written] : write_queue_) usage.queues += sizeof(decltype(write_queue_)::value_type) + data.capacity();
+    return usage;
+}
+
 void ConnectionManager::handlePacket(std::span<const uint8_t> packet) {
+    static auto& throttled = metrics::counter("session_frames_throttled_total", "Frames NAKed because the session queue was full");
     spdlog::debug("Decoded packet of {} bytes from {}", packet.size(), address_);
-    
-    if (auto mqtt_message = packet_processor_.processPacket(packet)) {
-        mqtt_client_.publish(
-            mqtt_message->topic,
-            mqtt_message->payload,
-            [this](boost::system::error_code ec) {
-                if (ec) {
-                    spdlog::error("Failed to publish MQTT message: {}", ec.message());
-                    sendResponse(slip::Decoder::makeResponse(slip::NAK));
-                } else {
-                    spdlog::debug("MQTT message published successfully");
-                    sendResponse(slip::Decoder::makeResponse(slip::ACK));
-                }
-            },
-            mqtt_message->qos,
-            mqtt_message->retain
-        );
+
+    if (pending_frames_.size() >= max_queued_frames_) {
+        throttled.inc();
+        spdlog::debug("Session queue full for {}, rejecting frame", address_);
+        sendResponse(codec_.makeResponse(slip::NAK));
+        return;
+    }
+    uint64_t trace_id = trace::sample();
+    if (trace_id != 0) {
+        trace::record_at(trace_id, trace::Stage::SocketRead, last_read_ns_);
+        trace::record(trace_id, trace::Stage::FrameComplete);
+    }
+    // The decoder reuses its buffer, so the frame is copied before queueing.
+    pending_frames_.push_back(PendingFrame{std::vector<uint8_t>(packet.begin(), packet.end()), trace_id});
+    queued_frames().add(1);
+    scheduler_.activate(shared_from_this());
+}
+
+size_t ConnectionManager::headCost() const {
+    if (raw_) return raw_->front().size();
+    return pending_frames_.empty() ? 0 : std::max<size_t>(pending_frames_.front().data.size(), 1);
+}
+
+std::chrono::steady_clock::duration ConnectionManager::headReadyIn(std::chrono::steady_clock::time_point now) {
+    if (worker_full_) {
+        worker_full_ = false;
+        return worker_full_retry;
+    }
+    auto size = static_cast<double>(raw_ ? raw_->front().size() : pending_frames_.front().data.size());
+    return std::max(frame_limit_.waitFor(1, now), byte_limit_.waitFor(size, now));
+}
+
+void ConnectionManager::runRawHead() {
+    auto packet = raw_->front();
+    uint64_t trace_id = trace::sample();
+    if (trace_id != 0) {
+        trace::record_at(trace_id, trace::Stage::SocketRead, last_read_ns_);
+        trace::record(trace_id, trace::Stage::FrameComplete);
+    }
+    if (!pipeline_) {
+        processFrame(packet, trace_id);
+    } else if (!pipeline_->submit(worker_, shared_from_this(), std::vector<uint8_t>(packet.begin(), packet.end()), trace_id)) {
+        // There is no NAK on a raw stream, so the packet stays at the head;
+        // if the worker stays behind, the session ring fills and drops new
+        // reads rather than packets already framed.
+        worker_full_ = true;
+        return;
+    }
+    frame_limit_.consume(1);
+    byte_limit_.consume(static_cast<double>(packet.size()));
+    raw_->pop();
+}
+
+void ConnectionManager::runHead() {
+    if (raw_) {
+        runRawHead();
+        return;
+    }
+    auto frame = std::move(pending_frames_.front());
+    pending_frames_.pop_front();
+    queued_frames().sub(1);
+    frame_limit_.consume(1);
+    byte_limit_.consume(static_cast<double>(frame.data.size()));
+    if (!pipeline_) {
+        processFrame(frame.data, frame.trace_id);
+        return;
+    }
+    if (!pipeline_->submit(worker_, shared_from_this(), std::move(frame.data), frame.trace_id)) {
+        sendResponse(codec_.makeResponse(slip::NAK));
+    }
+}
+
+void ConnectionManager::onProcessed(Pipeline::Processed processed) {
+    for (const auto& packet : processed.limited) {
+        if (!admitPacket(packet.name, packet.limit)) {
+            spdlog::debug("Packet {} rejected by rate limit", packet.name);
+            processed.messages.reset();
+            break;
+        }
+    }
+    // Only now is the frame accepted; a NAKed one is resent and must not
+    // leave rows behind.
+    if (processed.messages && sink_) processed.sink_rows.writeTo(*sink_);
+    publishFrame(processed.messages, processed.trace_id);
+}
+
+bool ConnectionManager::admitPacket(const std::string& name, const PacketRateLimit& config) {
+    static auto& throttled = metrics::counter("packet_rate_limited_total", "Packets rejected by a per-packet rate limit");
+    auto it = packet_limits_.find(name);
+    if (it == packet_limits_.end() || it->second.config.per_sec != config.per_sec || it->second.config.burst != config.burst) {
+        // First packet of this type, or the definitions were reloaded with a new limit.
+        it = packet_limits_.insert_or_assign(name, PacketLimit{config, TokenBucket(config.per_sec, config.burst)}).first;
+    }
+    auto& bucket = it->second.bucket;
+    if (bucket.waitFor(1, std::chrono::steady_clock::now()) > std::chrono::steady_clock::duration::zero()) {
+        throttled.inc();
+        return false;
+    }
+    bucket.consume(1);
+    return true;
+}
+
+void ConnectionManager::processFrame(std::span<const uint8_t> packet, uint64_t trace_id) {
+    auto messages = packet_processor_.processFrame(packet, [this](const PacketDesc& desc) {
+        return !desc.rate_limit || admitPacket(desc.name, *desc.rate_limit);
+    }, trace_id);
+    publishFrame(messages, trace_id);
+}
+
+void ConnectionManager::publishFrame(const std::optional<std::vector<PacketProcessor::MqttMessage>>& processed, uint64_t trace_id) {
+    WriteCallback on_written;
+    if (trace_id != 0) {
+        on_written = [trace_id](boost::system::error_code) { trace::record(trace_id, trace::Stage::AckWritten); };
+    }
+    if (!processed) {
+        sendResponse(codec_.makeResponse(slip::NAK), std::move(on_written));
+        return;
+    }
+    const auto& messages = *processed;
+    if (messages.empty()) {
+        // Every packet went to a sink; there is no publish to wait for.
+        sendResponse(codec_.makeResponse(slip::ACK), std::move(on_written));
+        return;
     }
+
+    for (const auto& message : messages) {
+        if (!message.device_id.empty()) {
+            learnDevice(message.device_id);
+        }
+    }
+
+    batcher_.submitFrame(messages, handler_memory::bind([self = shared_from_this(), count = messages.size(),
+                                                        on_written = std::move(on_written)](boost::system::error_code ec) mutable {
+        if (ec) {
+            spdlog::error("Failed to publish MQTT message: {}", ec.message());
+            self->sendResponse(self->codec_.makeResponse(slip::NAK), std::move(on_written));
+        } else {
+            spdlog::debug("{} MQTT message(s) published successfully", count);
+            self->sendResponse(self->codec_.makeResponse(slip::ACK), std::move(on_written));
+        }
+    }));
 }
 
 void ConnectionManager::handleData(std::span<const uint8_t> data) {
     spdlog::debug("Raw data {} bytes from {}", data.size(), address_);
+    if (trace::enabled()) {
+        last_read_ns_ = trace::now_ns();
+    }
+    if (raw_) {
+        raw_->append(data);
+        if (!raw_->front().empty()) scheduler_.activate(shared_from_this());
+        return;
+    }
     try {
-        decoder_.decode(data);
+        codec_.decode(data);
     } catch (const slip::SlipError& e) {
         spdlog::error("SLIP decode error from {}: {}", address_, e.what());
         reset();
+    } catch (const framing::FramingError& e) {
+        spdlog::error("{} decode error from {}: {}", framing::kind_name(codec_.kind()), address_, e.what());
+        reset();
     }
 }
 
-void ConnectionManager::sendResponse(const std::vector<uint8_t>& response) {
-    boost::asio::async_write(socket_, boost::asio::buffer(response),
-        [addr = address_](const boost::system::error_code& ec, std::size_t bytes_transferred) {
+void ConnectionManager::learnDevice(const std::string& device_id) {
+    if (std::find(device_ids_.begin(), device_ids_.end(), device_id) != device_ids_.end()) return;
+    device_ids_.push_back(device_id);
+    router_.learn(device_id, shared_from_this());
+    spdlog::info("Device {} is reachable via {}", device_id, address_);
+}
+
+void ConnectionManager::sendFrame(std::span<const uint8_t> packet, WriteCallback on_written) {
+    sendResponse(codec_.encode(packet), std::move(on_written));
+}
+
+void ConnectionManager::sendResponse(std::vector<uint8_t> response, WriteCallback on_written) {
+    if (closed_) {
+        if (on_written) on_written(boost::asio::error::not_connected);
+        return;
+    }
+    if (response.empty()) {
+        // Raw streams have no acknowledgements to send.
+        if (on_written) on_written({});
+        return;
+    }
+    write_queue_.emplace_back(std::move(response), std::move(on_written));
+    if (write_queue_.size() == 1) {
+        doWrite();
+    }
+}
+
+void ConnectionManager::doWrite() {
+    // Writes go out one at a time so frames from ACKs and downlink messages
+    // never interleave on the socket.
+    stream_.asyncWrite(boost::asio::buffer(write_queue_.front().first), handler_memory::bind(
+        [self = shared_from_this()](const boost::system::error_code& ec, std::size_t bytes_transferred) {
+            auto on_written = std::move(self->write_queue_.front().second);
+            self->write_queue_.pop_front();
             if (ec) {
-                spdlog::error("Error sending packet to {}: {}", addr, ec.message());
+                spdlog::error("Error sending packet to {}: {}", self->address_, ec.message());
             } else {
-                spdlog::debug("Sent SLIP packet {} bytes to {}", bytes_transferred, addr);
+                spdlog::debug("Sent frame {} bytes to {}", bytes_transferred, self->address_);
             }
-        });
+            if (on_written) on_written(ec);
+            if (ec || self->closed_) {
+                for (auto& [frame, callback] : self->write_queue_) {
+                    if (callback) callback(ec ? ec : boost::asio::error::not_connected);
+                }
+                self->write_queue_.clear();
+            } else if (!self->write_queue_.empty()) {
+                self->doWrite();
+            }
+        }));
+}
+
+void ConnectionManager::close() {
+    closed_ = true;
 }
 
 void ConnectionManager::reset() {
-    decoder_.reset();
+    codec_.reset();
 }
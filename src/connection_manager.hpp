@@ -2,19 +2,42 @@
 #define TCP_MQTT_BRIDGE_CONNECTION_MANAGER_HPP
 
 #include "tcp_context.hpp"
-#include "slip.hpp"
+#include "device_stream.hpp"
+#include "framing.hpp"
 #include "packet_parser.hpp"
 #include "packet_processor.hpp"
 #include "mqtt_client.hpp"
+#include "publish_batcher.hpp"
+#include "device_router.hpp"
+#include "fair_scheduler.hpp"
+#include "pipeline.hpp"
+#include "rate_limiter.hpp"
+#include "config.hpp"
+#include "memory_stats.hpp"
 
 #include <boost/asio.hpp>
+#include <deque>
 #include <memory>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
-class ConnectionManager {
+// Decoded frames are queued and processed when the FairScheduler gives the
+// session its turn, subject to the listener's frame and byte rate limits.
+// With a Pipeline the frame is rendered on a worker thread instead and the
+// result comes back through onProcessed(). Raw streams have no frame queue:
+// each packet is parsed in place from the decoder's ring when its turn comes
+// (and copied only to hand it to a pipeline worker).
+class ConnectionManager : public std::enable_shared_from_this<ConnectionManager>, public FairScheduler::Flow,
+                          public Pipeline::Client {
 public:
-    explicit ConnectionManager(boost::asio::ip::tcp::socket& socket, const PacketDb& packet_db, MqttClient& mqtt_client);
-    ~ConnectionManager() = default;
+    using WriteCallback = std::function<void(boost::system::error_code)>;
+
+    explicit ConnectionManager(DeviceStream& stream, const PacketDbStore& packet_db, MqttClient& mqtt_client,
+                               PublishBatcher& batcher, DeviceRouter& router, FairScheduler& scheduler, Pipeline* pipeline,
+                               const Configuration::RateLimitConfig& limits, framing::Kind framing = framing::Kind::Slip,
+                               framing::RawLimits raw_limits = {}, Sink* sink = nullptr);
+    ~ConnectionManager();
 
     ConnectionManager(const ConnectionManager&) = delete;
     ConnectionManager& operator=(const ConnectionManager&) = delete;
@@ -26,16 +49,63 @@ public:
     void handleData(std::span<const uint8_t> data);
     void reset();
 
+    size_t headCost() const override;
+    std::chrono::steady_clock::duration headReadyIn(std::chrono::steady_clock::time_point now) override;
+    void runHead() override;
+
+    void onProcessed(Pipeline::Processed processed) override;
+
+    // Frames and queues a packet for the device; on_written runs once it has
+    // been handed to the socket (the kernel, or OpenSSL for TLS).
+    void sendFrame(std::span<const uint8_t> packet, WriteCallback on_written = {});
+
+    // Called when the session's socket goes away; later sends are dropped.
+    void close();
+
     const std::string& address() const { return address_; }
 
+    // Bytes held for this connection, including its TcpSession.
+    memstats::SessionUsage memoryUsage() const;
+
 private:
-    void sendResponse(const std::vector<uint8_t>& response);
+    void sendResponse(std::vector<uint8_t> response, WriteCallback on_written = {});
+    void doWrite();
+    void learnDevice(const std::string& device_id);
+    void runRawHead();
+    void processFrame(std::span<const uint8_t> frame, uint64_t trace_id);
+    void publishFrame(const std::optional<std::vector<PacketProcessor::MqttMessage>>& processed, uint64_t trace_id);
+    bool admitPacket(const std::string& name, const PacketRateLimit& config);
 
-    boost::asio::ip::tcp::socket& socket_;
+    DeviceStream& stream_;
     std::string address_;
     PacketProcessor packet_processor_;
-    slip::Decoder decoder_;
+    framing::FrameCodec codec_;
+    framing::RawStream* raw_;       // codec_'s decoder for raw streams, else null
     MqttClient& mqtt_client_;
+    PublishBatcher& batcher_;
+    DeviceRouter& router_;
+    FairScheduler& scheduler_;
+    Pipeline* pipeline_;
+    Sink* sink_;
+    size_t worker_ = 0;
+    size_t max_queued_frames_;
+    TokenBucket frame_limit_;
+    TokenBucket byte_limit_;
+    struct PacketLimit {
+        PacketRateLimit config;
+        TokenBucket bucket;
+    };
+    std::unordered_map<std::string, PacketLimit> packet_limits_;
+    struct PendingFrame {
+        std::vector<uint8_t> data;
+        uint64_t trace_id;
+    };
+    std::deque<PendingFrame> pending_frames_;
+    uint64_t last_read_ns_{0};      // only kept while tracing is enabled
+    bool worker_full_{false};       // the raw head was refused by the pipeline; back off once
+    std::vector<std::string> device_ids_;
+    std::deque<std::pair<std::vector<uint8_t>, WriteCallback>> write_queue_;
+    bool closed_{false};
 };
 
 #endif // TCP_MQTT_BRIDGE_CONNECTION_MANAGER_HPP
@@ -0,0 +1,59 @@
+#ifndef TCP_MQTT_BRIDGE_DEVICE_ROUTER_HPP
+#define TCP_MQTT_BRIDGE_DEVICE_ROUTER_HPP
+
+#include "packet_parser.hpp"
+
+#include <fmt/format.h>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+class ConnectionManager;
+
+// Canonical text form of a device identifier field, as it appears in a
+// downlink topic: decimal for numbers, lowercase hex for byte arrays.
+inline std::string device_key(const FieldValue& value) {
+    return std::visit([](const auto& v) -> std::string {
+        using T = std::decay_t<decltype(v)>;
+        if constexpr (std::is_same_v<T, std::vector<uint8_t>>) {
+            std::string hex;
+            byte_encoding::hex(v, hex);
+            return hex;
+        } else if constexpr (std::is_same_v<T, NumericArray>) {
+            return v.to_string();
+        } else if constexpr (std::is_same_v<T, uint8_t> || std::is_same_v<T, int8_t>) {
+            return std::to_string(static_cast<int>(v));
+        } else {
+            return fmt::format("{}", v);
+        }
+    }, value.value());
+}
+
+// Maps device ids learned from uplink packets to the connection that sent
+// them, so a downlink message reaches the right live session in O(1).
+class DeviceRouter {
+public:
+    void learn(const std::string& device_id, const std::shared_ptr<ConnectionManager>& connection) {
+        routes_[device_id] = connection;
+    }
+
+    std::shared_ptr<ConnectionManager> find(const std::string& device_id) const {
+        auto it = routes_.find(device_id);
+        return it != routes_.end() ? it->second.lock() : nullptr;
+    }
+
+    // Drops the route unless another connection has claimed the id since.
+    void forget(const std::string& device_id, const ConnectionManager* connection) {
+        auto it = routes_.find(device_id);
+        if (it == routes_.end()) return;
+        auto current = it->second.lock();
+        if (!current || current.get() == connection) routes_.erase(it);
+    }
+
+    size_t size() const { return routes_.size(); }
+
+private:
+    std::unordered_map<std::string, std::weak_ptr<ConnectionManager>> routes_;
+};
+
+#endif // TCP_MQTT_BRIDGE_DEVICE_ROUTER_HPP
@@ -0,0 +1,95 @@
+#include "device_stream.hpp"
+#include "tls.hpp"
+
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <stdexcept>
+
+DeviceStream::DeviceStream(boost::asio::ip::tcp::socket socket, boost::asio::ssl::context* tls)
+    : socket_(std::move(socket))
+{
+    if (!tls) return;
+    ssl_ = SSL_new(tls->native_handle());
+    if (!ssl_) throw std::runtime_error("TLS: SSL_new failed");
+    // OpenSSL reads and writes the descriptor itself; asio only tells it
+    // when the socket is ready, so the socket must not block.
+    socket_.non_blocking(true);
+    SSL_set_fd(ssl_, static_cast<int>(socket_.native_handle()));
+    SSL_set_accept_state(ssl_);
+    SSL_set_mode(ssl_, SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+}
+
+DeviceStream::~DeviceStream() {
+    if (ssl_) SSL_free(ssl_);
+}
+
+void DeviceStream::asyncHandshake(HandshakeHandler handler) {
+    if (!ssl_) {
+        handler({});
+        return;
+    }
+    startSsl(SslCall::Handshake, nullptr, 0,
+        [this, handler = std::move(handler)](boost::system::error_code ec, size_t) {
+            if (!ec) {
+                handshake_done_ = true;
+                ktls_ = tls::record_handshake(ssl_);
+                spdlog::debug("TLS handshake done ({}, {}{})", SSL_get_version(ssl_),
+                              SSL_session_reused(ssl_) ? "resumed" : "full", ktls_ ? ", kernel TLS" : "");
+            }
+            handler(ec);
+        });
+}
+
+DeviceStream::SslResult DeviceStream::sslCall(SslCall call, void* data, size_t size) {
+    ERR_clear_error();
+    errno = 0;
+    int length = static_cast<int>(std::min<size_t>(size, INT_MAX));
+    int rc = 0;
+    switch (call) {
+    case SslCall::Handshake: rc = SSL_do_handshake(ssl_); break;
+    case SslCall::Read: rc = SSL_read(ssl_, data, length); break;
+    case SslCall::Write: rc = SSL_write(ssl_, data, length); break;
+    }
+
+    SslResult result;
+    if (rc > 0) {
+        result.bytes = static_cast<size_t>(rc);
+        return result;
+    }
+    switch (SSL_get_error(ssl_, rc)) {
+    case SSL_ERROR_WANT_READ:
+        result.wait = boost::asio::ip::tcp::socket::wait_read;
+        break;
+    case SSL_ERROR_WANT_WRITE:
+        result.wait = boost::asio::ip::tcp::socket::wait_write;
+        break;
+    case SSL_ERROR_ZERO_RETURN:
+        result.ec = boost::asio::error::eof;
+        break;
+    case SSL_ERROR_SYSCALL:
+        // No queued OpenSSL error and no errno means the peer just hung up.
+        result.ec = errno != 0 ? boost::system::error_code(errno, boost::system::system_category())
+                               : boost::system::error_code(boost::asio::error::eof);
+        break;
+    default:
+        result.ec = boost::system::error_code(static_cast<int>(ERR_get_error()), boost::asio::error::get_ssl_category());
+        break;
+    }
+    return result;
+}
+
+void DeviceStream::close() {
+    boost::system::error_code ec;
+    if (ssl_ && handshake_done_) {
+        // Best effort: the socket does not block, so this never waits.
+        ERR_clear_error();
+        SSL_shutdown(ssl_);
+    }
+    socket_.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
+    socket_.close(ec);
+}
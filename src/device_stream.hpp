@@ -0,0 +1,136 @@
+#ifndef TCP_MQTT_BRIDGE_DEVICE_STREAM_HPP
+#define TCP_MQTT_BRIDGE_DEVICE_STREAM_HPP
+
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+#include <functional>
+#include <optional>
+
+// A device connection, plaintext or TLS. TLS runs OpenSSL directly on the
+// socket (a socket BIO driven by asio readiness waits) rather than through
+// asio::ssl::stream, whose memory BIOs would rule out kernel TLS: with
+// SSL_OP_ENABLE_KTLS OpenSSL then hands the record layer to the kernel after
+// the handshake and reads and writes no longer copy through userspace crypto.
+//
+// Like the socket it wraps, a stream must outlive its pending operations
+// unless they complete with operation_aborted, and at most one read and one
+// write may be pending at a time.
+class DeviceStream {
+public:
+    using HandshakeHandler = std::function<void(boost::system::error_code)>;
+
+    // tls == nullptr makes a plaintext stream.
+    DeviceStream(boost::asio::ip::tcp::socket socket, boost::asio::ssl::context* tls);
+    ~DeviceStream();
+
+    DeviceStream(const DeviceStream&) = delete;
+    DeviceStream& operator=(const DeviceStream&) = delete;
+
+    boost::asio::ip::tcp::socket& socket() { return socket_; }
+    bool secure() const { return ssl_ != nullptr; }
+    // True once the handshake has moved both directions into the kernel.
+    bool kernelTls() const { return ktls_; }
+
+    // Completes immediately for plaintext streams.
+    void asyncHandshake(HandshakeHandler handler);
+
+    // Reads and writes take any completion token with the signature
+    // void(error_code, size_t). The handler's associated allocator is used
+    // for the operation on both paths, so a session's read and write chains
+    // can run without heap allocations (see handler_memory).
+    template <typename Token>
+    auto asyncReadSome(boost::asio::mutable_buffer buffer, Token&& token) {
+        return boost::asio::async_initiate<Token, void(boost::system::error_code, size_t)>(
+            [this](auto handler, boost::asio::mutable_buffer buffer) {
+                if (!ssl_) {
+                    socket_.async_read_some(buffer, std::move(handler));
+                    return;
+                }
+                startSsl(SslCall::Read, buffer.data(), buffer.size(), std::move(handler));
+            }, token, buffer);
+    }
+
+    // Writes the whole buffer.
+    template <typename Token>
+    auto asyncWrite(boost::asio::const_buffer buffer, Token&& token) {
+        return boost::asio::async_initiate<Token, void(boost::system::error_code, size_t)>(
+            [this](auto handler, boost::asio::const_buffer buffer) {
+                if (!ssl_) {
+                    boost::asio::async_write(socket_, buffer, std::move(handler));
+                    return;
+                }
+                // Without SSL_MODE_ENABLE_PARTIAL_WRITE, SSL_write only
+                // reports success once the whole buffer is sent.
+                startSsl(SslCall::Write, const_cast<void*>(buffer.data()), buffer.size(), std::move(handler));
+            }, token, buffer);
+    }
+
+    // Sends close_notify if possible, then shuts the socket down.
+    void close();
+
+private:
+    enum class SslCall { Handshake, Read, Write };
+
+    struct SslResult {
+        size_t bytes = 0;
+        boost::system::error_code ec;
+        // Set when OpenSSL needs the socket to become readable or writable.
+        std::optional<boost::asio::ip::tcp::socket::wait_type> wait;
+    };
+
+    // One attempt at an SSL_* call.
+    SslResult sslCall(SslCall call, void* data, size_t size);
+
+    // Runs an SSL_* call until it succeeds or fails, waiting for the socket
+    // whenever OpenSSL asks for more input or output room.
+    struct SslOperation {
+        DeviceStream* stream;
+        SslCall call;
+        void* data;
+        size_t size;
+        enum class State { Starting, Waiting, Done } state = State::Starting;
+        SslResult result{};
+
+        template <typename Self>
+        void operator()(Self& self, boost::system::error_code ec = {}) {
+            if (state == State::Done) {
+                self.complete(result.ec, result.bytes);
+                return;
+            }
+            // On a failed wait the stream may already be gone, so only the
+            // handler is touched.
+            if (state == State::Waiting && ec) {
+                self.complete(ec, 0);
+                return;
+            }
+            result = stream->sslCall(call, data, size);
+            auto& socket = stream->socket_;
+            if (result.wait) {
+                auto wait = *result.wait;
+                state = State::Waiting;
+                socket.async_wait(wait, std::move(self));
+                return;
+            }
+            if (state == State::Starting) {
+                // Completions never run inside the initiating call, as with asio.
+                state = State::Done;
+                boost::asio::post(socket.get_executor(), std::move(self));
+                return;
+            }
+            self.complete(result.ec, result.bytes);
+        }
+    };
+
+    template <typename Handler>
+    void startSsl(SslCall call, void* data, size_t size, Handler&& handler) {
+        boost::asio::async_compose<Handler, void(boost::system::error_code, size_t)>(
+            SslOperation{this, call, data, size}, handler, socket_);
+    }
+
+    boost::asio::ip::tcp::socket socket_;
+    SSL* ssl_ = nullptr;
+    bool handshake_done_ = false;
+    bool ktls_ = false;
+};
+
+#endif // TCP_MQTT_BRIDGE_DEVICE_STREAM_HPP
@@ -0,0 +1,99 @@
+#include "downlink.hpp"
+#include "connection_manager.hpp"
+#include "packet_encoder.hpp"
+#include "metrics.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <chrono>
+
+std::optional<std::string_view> match_downlink_topic(std::string_view filter, std::string_view topic) {
+    std::optional<std::string_view> device_id;
+    while (true) {
+        auto filter_end = filter.find('/');
+        auto topic_end = topic.find('/');
+        auto filter_level = filter.substr(0, filter_end);
+        auto topic_level = topic.substr(0, topic_end);
+
+        if (filter_level == "#") return device_id;
+        if (filter_level == "+") {
+            if (!device_id) device_id = topic_level;
+        } else if (filter_level != topic_level) {
+            return std::nullopt;
+        }
+
+        if (filter_end == std::string_view::npos || topic_end == std::string_view::npos) {
+            return filter_end == topic_end ? device_id : std::nullopt;
+        }
+        filter.remove_prefix(filter_end + 1);
+        topic.remove_prefix(topic_end + 1);
+    }
+}
+
+DownlinkDispatcher::DownlinkDispatcher(MqttClient& mqtt_client, const PacketDbStore& packet_db, DeviceRouter& router)
+    : mqtt_client_(mqtt_client)
+    , packet_db_(packet_db)
+    , router_(router)
+{
+}
+
+void DownlinkDispatcher::subscribe() {
+    auto snapshot = packet_db_.load();
+    for (const auto& packet : snapshot->db()) {
+        if (!packet.downlink || !subscribed_.insert(packet.downlink->topic).second) continue;
+        mqtt_client_.subscribe({packet.downlink->topic}, packet.downlink->qos);
+    }
+}
+
+void DownlinkDispatcher::handleMessage(const std::string& topic, const std::string& payload) {
+    static auto& received = metrics::counter("downlink_messages_total", "Downlink MQTT messages received");
+    static auto& unroutable = metrics::counter("downlink_unroutable_total", "Downlink messages for devices with no live session");
+    static auto& errors = metrics::counter("downlink_errors_total", "Downlink messages that could not be encoded or written");
+    static auto& latency = metrics::histogram("downlink_latency_us", "MQTT receive to socket write completion");
+
+    auto start = std::chrono::steady_clock::now();
+    received.inc();
+
+    auto snapshot = packet_db_.load();
+    for (const auto& packet : snapshot->db()) {
+        if (!packet.downlink) continue;
+        auto device_id = match_downlink_topic(packet.downlink->topic, topic);
+        if (!device_id) continue;
+
+        auto connection = router_.find(std::string(*device_id));
+        if (!connection) {
+            unroutable.inc();
+            spdlog::warn("Downlink {} for device {}: no live session", packet.name, *device_id);
+            return;
+        }
+
+        std::vector<uint8_t> frame;
+        try {
+            PacketProcessor::json_t values;
+            switch (packet.mqtt.format) {
+            case PayloadFormat::Cbor:    values = PacketProcessor::json_t::from_cbor(payload); break;
+            case PayloadFormat::MsgPack: values = PacketProcessor::json_t::from_msgpack(payload); break;
+            default:                     values = PacketProcessor::json_t::parse(payload); break;
+            }
+            frame = encode_packet(packet, values);
+        } catch (const std::exception& e) {
+            errors.inc();
+            spdlog::error("Downlink {} for device {}: {}", packet.name, *device_id, e.what());
+            return;
+        }
+
+        connection->sendFrame(frame,
+            [start, name = packet.name, device = std::string(*device_id)](boost::system::error_code ec) {
+                if (ec) {
+                    errors.inc();
+                    return;
+                }
+                auto elapsed = std::chrono::steady_clock::now() - start;
+                latency.record(elapsed);
+                spdlog::debug("Downlink {} to device {} written in {} us", name, device,
+                              std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+            });
+        return;
+    }
+    spdlog::warn("Downlink message on {} matches no packet definition", topic);
+}
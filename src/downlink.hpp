@@ -0,0 +1,36 @@
+#ifndef TCP_MQTT_BRIDGE_DOWNLINK_HPP
+#define TCP_MQTT_BRIDGE_DOWNLINK_HPP
+
+#include "packet_db_snapshot.hpp"
+#include "device_router.hpp"
+#include "mqtt_client.hpp"
+
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+
+// Matches an MQTT topic against a subscription filter and returns the topic
+// level that sits under the filter's first '+', or nullopt on no match.
+std::optional<std::string_view> match_downlink_topic(std::string_view filter, std::string_view topic);
+
+// MQTT -> device path. Messages on a packet's downlink topic are encoded with
+// that packet's field layout and written to the session that last sent
+// uplink traffic for the device id taken from the topic.
+class DownlinkDispatcher {
+public:
+    DownlinkDispatcher(MqttClient& mqtt_client, const PacketDbStore& packet_db, DeviceRouter& router);
+
+    // Subscribes to every downlink topic of the current definitions that is
+    // not subscribed yet; call again after a reload.
+    void subscribe();
+    void handleMessage(const std::string& topic, const std::string& payload);
+
+private:
+    MqttClient& mqtt_client_;
+    const PacketDbStore& packet_db_;
+    DeviceRouter& router_;
+    std::unordered_set<std::string> subscribed_;
+};
+
+#endif // TCP_MQTT_BRIDGE_DOWNLINK_HPP
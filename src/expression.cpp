@@ -0,0 +1,376 @@
+#include "expression.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <tuple>
+
+namespace expr {
+
+namespace {
+
+int64_t require_int(const Value& v, const char* op) {
+    if (v.is_float) throw ExpressionError(std::string("operator ") + op + " needs integer operands");
+    return v.i;
+}
+
+Value apply_unary(Op op, const Value& a) {
+    switch (op) {
+    case Op::Neg: return a.is_float ? Value::real(-a.f) : Value::integer(static_cast<int64_t>(0ull - static_cast<uint64_t>(a.i)));
+    case Op::Not: return Value::integer(a.as_double() == 0);
+    case Op::Bool: return Value::integer(a.as_double() != 0);
+    case Op::BitNot: return Value::integer(~require_int(a, "~"));
+    case Op::Abs: return a.is_float ? Value::real(std::fabs(a.f)) : (a.i < 0 ? apply_unary(Op::Neg, a) : a);
+    case Op::Round: return Value::real(std::round(a.as_double()));
+    case Op::Floor: return Value::real(std::floor(a.as_double()));
+    case Op::Ceil: return Value::real(std::ceil(a.as_double()));
+    case Op::Sqrt: return Value::real(std::sqrt(a.as_double()));
+    case Op::ToInt: return Value::integer(a.as_int());
+    case Op::ToFloat: return Value::real(a.as_double());
+    default: break;
+    }
+    throw ExpressionError("not a unary operation");
+}
+
+Value apply_binary(Op op, const Value& a, const Value& b) {
+    const bool real = a.is_float || b.is_float;
+    auto arith = [&](auto int_op, auto float_op) {
+        return real ? Value::real(float_op(a.as_double(), b.as_double()))
+                    : Value::integer(static_cast<int64_t>(int_op(static_cast<uint64_t>(a.i), static_cast<uint64_t>(b.i))));
+    };
+    auto compare = [&](auto cmp) {
+        return Value::integer(real ? cmp(a.as_double(), b.as_double()) : cmp(a.i, b.i));
+    };
+    switch (op) {
+    // Integer +, - and * wrap instead of overflowing.
+    case Op::Add: return arith([](uint64_t x, uint64_t y) { return x + y; }, [](double x, double y) { return x + y; });
+    case Op::Sub: return arith([](uint64_t x, uint64_t y) { return x - y; }, [](double x, double y) { return x - y; });
+    case Op::Mul: return arith([](uint64_t x, uint64_t y) { return x * y; }, [](double x, double y) { return x * y; });
+    case Op::Div:
+        if (real) return Value::real(a.as_double() / b.as_double());
+        if (b.i == 0) throw ExpressionError("integer division by zero");
+        if (b.i == -1) return apply_unary(Op::Neg, a);
+        return Value::integer(a.i / b.i);
+    case Op::Mod:
+        if (real) return Value::real(std::fmod(a.as_double(), b.as_double()));
+        if (b.i == 0) throw ExpressionError("integer modulo by zero");
+        if (b.i == -1) return Value::integer(0);
+        return Value::integer(a.i % b.i);
+    case Op::Shl: return Value::integer(static_cast<int64_t>(static_cast<uint64_t>(require_int(a, "<<")) << (require_int(b, "<<") & 63)));
+    case Op::Shr: return Value::integer(require_int(a, ">>") >> (require_int(b, ">>") & 63));
+    case Op::BitAnd: return Value::integer(require_int(a, "&") & require_int(b, "&"));
+    case Op::BitOr: return Value::integer(require_int(a, "|") | require_int(b, "|"));
+    case Op::BitXor: return Value::integer(require_int(a, "^") ^ require_int(b, "^"));
+    case Op::Lt: return compare([](auto x, auto y) { return x < y; });
+    case Op::Le: return compare([](auto x, auto y) { return x <= y; });
+    case Op::Gt: return compare([](auto x, auto y) { return x > y; });
+    case Op::Ge: return compare([](auto x, auto y) { return x >= y; });
+    case Op::Eq: return compare([](auto x, auto y) { return x == y; });
+    case Op::Ne: return compare([](auto x, auto y) { return x != y; });
+    case Op::Min: return (real ? a.as_double() <= b.as_double() : a.i <= b.i) ? a : b;
+    case Op::Max: return (real ? a.as_double() >= b.as_double() : a.i >= b.i) ? a : b;
+    case Op::Pow: return Value::real(std::pow(a.as_double(), b.as_double()));
+    default: break;
+    }
+    throw ExpressionError("not a binary operation");
+}
+
+int arity(Op op) {
+    switch (op) {
+    case Op::Const: case Op::Load: case Op::Jump: return 0;
+    case Op::Neg: case Op::Not: case Op::BitNot: case Op::Bool: case Op::Abs: case Op::Round: case Op::Floor:
+    case Op::Ceil: case Op::Sqrt: case Op::ToInt: case Op::ToFloat:
+    case Op::JumpIfZero: case Op::AndJump: case Op::OrJump: return 1;
+    default: return 2;
+    }
+}
+
+}
+
+// Recursive descent over the C precedence levels, emitting code as it goes.
+// Operations on constants are folded at compile time, except across a jump
+// target, where the operands may come from different branches.
+class Compiler {
+public:
+    Compiler(std::string_view source, const Resolver& resolve) : src_(source), resolve_(resolve) {}
+
+    Program run() {
+        ternary();
+        skip_space();
+        if (pos_ != src_.size()) fail("unexpected '" + std::string(1, src_[pos_]) + "'");
+        if (max_depth_ > Program::MAX_STACK) fail("expression is nested too deeply");
+        return std::move(program_);
+    }
+
+private:
+    [[noreturn]] void fail(const std::string& message) const {
+        throw ExpressionError(message + " at position " + std::to_string(pos_) + " in '" + std::string(src_) + "'");
+    }
+
+    void skip_space() {
+        while (pos_ < src_.size() && std::isspace(static_cast<unsigned char>(src_[pos_]))) ++pos_;
+    }
+
+    bool accept(std::string_view token) {
+        skip_space();
+        if (src_.substr(pos_, token.size()) != token) return false;
+        // Keep "<" from matching the start of "<<" or "<=", "&" of "&&", etc.
+        if (token.size() == 1 && pos_ + 1 < src_.size()) {
+            char next = src_[pos_ + 1];
+            if ((token == "<" && (next == '<' || next == '=')) || (token == ">" && (next == '>' || next == '=')) ||
+                (token == "&" && next == '&') || (token == "|" && next == '|') || (token == "!" && next == '=')) {
+                return false;
+            }
+        }
+        pos_ += token.size();
+        return true;
+    }
+
+    void expect(std::string_view token) {
+        if (!accept(token)) fail("expected '" + std::string(token) + "'");
+    }
+
+    void emit(Op op, uint32_t arg = 0) {
+        int n = arity(op);
+        auto& code = program_.code_;
+        // Fold when every operand is a constant emitted just before.
+        if (n > 0 && code.size() >= label_ + static_cast<size_t>(n) &&
+            std::all_of(code.end() - n, code.end(), [](const Instr& in) { return in.op == Op::Const; })) {
+            std::array<Value, 2> args;
+            for (int k = 0; k < n; ++k) args[k] = program_.constants_[code[code.size() - n + k].arg];
+            std::optional<Value> folded;
+            try {
+                folded = n == 1 ? apply_unary(op, args[0]) : apply_binary(op, args[0], args[1]);
+            } catch (const ExpressionError& e) {
+                // An operand that may never run fails at run time, if at all.
+                if (conditional_ == 0) fail(e.what());
+            }
+            if (folded) {
+                code.resize(code.size() - n);
+                depth_ -= n;
+                push_const(*folded);
+                return;
+            }
+        }
+        code.push_back(Instr{op, arg});
+        depth_ = depth_ - n + 1;
+        max_depth_ = std::max(max_depth_, depth_);
+    }
+
+    // Emits a jump whose target is filled in by place_label().
+    size_t emit_jump(Op op) {
+        program_.code_.push_back(Instr{op, 0});
+        depth_ -= arity(op);
+        return program_.code_.size() - 1;
+    }
+
+    void place_label(size_t jump) {
+        label_ = program_.code_.size();
+        program_.code_[jump].arg = static_cast<uint32_t>(label_);
+    }
+
+    void push_const(Value v) {
+        program_.constants_.push_back(v);
+        program_.code_.push_back(Instr{Op::Const, static_cast<uint32_t>(program_.constants_.size() - 1)});
+        max_depth_ = std::max(max_depth_, ++depth_);
+    }
+
+    void ternary() {
+        logical_or();
+        if (accept("?")) {
+            size_t to_else = emit_jump(Op::JumpIfZero);
+            size_t depth = depth_;
+            ++conditional_;
+            ternary();
+            expect(":");
+            size_t to_end = emit_jump(Op::Jump);
+            place_label(to_else);
+            depth_ = depth;
+            ternary();
+            --conditional_;
+            place_label(to_end);
+        }
+    }
+
+    // `a && b` is a; AndJump end; b; Bool; end: and likewise for ||.
+    template <typename Next>
+    void logical_level(Next next, std::string_view token, Op jump) {
+        next();
+        while (accept(token)) {
+            size_t to_end = emit_jump(jump);
+            ++conditional_;
+            next();
+            emit(Op::Bool);
+            --conditional_;
+            place_label(to_end);
+        }
+    }
+
+    template <typename Next>
+    void binary_level(Next next, std::initializer_list<std::pair<std::string_view, Op>> ops) {
+        next();
+        for (;;) {
+            bool matched = false;
+            for (const auto& [token, op] : ops) {
+                if (accept(token)) {
+                    next();
+                    emit(op);
+                    matched = true;
+                    break;
+                }
+            }
+            if (!matched) return;
+        }
+    }
+
+    void logical_or() { logical_level([this] { logical_and(); }, "||", Op::OrJump); }
+    void logical_and() { logical_level([this] { bit_or(); }, "&&", Op::AndJump); }
+    void bit_or() { binary_level([this] { bit_xor(); }, {{"|", Op::BitOr}}); }
+    void bit_xor() { binary_level([this] { bit_and(); }, {{"^", Op::BitXor}}); }
+    void bit_and() { binary_level([this] { equality(); }, {{"&", Op::BitAnd}}); }
+    void equality() { binary_level([this] { relational(); }, {{"==", Op::Eq}, {"!=", Op::Ne}}); }
+    void relational() {
+        binary_level([this] { shift(); }, {{"<=", Op::Le}, {">=", Op::Ge}, {"<", Op::Lt}, {">", Op::Gt}});
+    }
+    void shift() { binary_level([this] { additive(); }, {{"<<", Op::Shl}, {">>", Op::Shr}}); }
+    void additive() { binary_level([this] { multiplicative(); }, {{"+", Op::Add}, {"-", Op::Sub}}); }
+    void multiplicative() { binary_level([this] { unary(); }, {{"*", Op::Mul}, {"/", Op::Div}, {"%", Op::Mod}}); }
+
+    void unary() {
+        if (accept("-")) { unary(); emit(Op::Neg); return; }
+        if (accept("+")) { unary(); return; }
+        if (accept("!")) { unary(); emit(Op::Not); return; }
+        if (accept("~")) { unary(); emit(Op::BitNot); return; }
+        primary();
+    }
+
+    void primary() {
+        skip_space();
+        if (pos_ >= src_.size()) fail("unexpected end of expression");
+        char c = src_[pos_];
+        if (accept("(")) {
+            ternary();
+            expect(")");
+        } else if (std::isdigit(static_cast<unsigned char>(c)) || c == '.') {
+            number();
+        } else if (std::isalpha(static_cast<unsigned char>(c)) || c == '_') {
+            size_t start = pos_;
+            while (pos_ < src_.size() && (std::isalnum(static_cast<unsigned char>(src_[pos_])) || src_[pos_] == '_')) ++pos_;
+            std::string_view name = src_.substr(start, pos_ - start);
+            if (accept("(")) {
+                call(name);
+            } else if (auto slot = resolve_(name)) {
+                emit(Op::Load, *slot);
+            } else {
+                pos_ = start;
+                fail("unknown field '" + std::string(name) + "'");
+            }
+        } else {
+            fail("unexpected '" + std::string(1, c) + "'");
+        }
+    }
+
+    void call(std::string_view name) {
+        static const std::initializer_list<std::tuple<std::string_view, Op, int>> functions = {
+            {"min", Op::Min, 2}, {"max", Op::Max, 2}, {"pow", Op::Pow, 2},
+            {"abs", Op::Abs, 1}, {"round", Op::Round, 1}, {"floor", Op::Floor, 1}, {"ceil", Op::Ceil, 1},
+            {"sqrt", Op::Sqrt, 1}, {"int", Op::ToInt, 1}, {"float", Op::ToFloat, 1},
+        };
+        for (const auto& [fname, op, args] : functions) {
+            if (fname != name) continue;
+            for (int k = 0; k < args; ++k) {
+                if (k > 0) expect(",");
+                ternary();
+            }
+            expect(")");
+            emit(op);
+            return;
+        }
+        fail("unknown function '" + std::string(name) + "'");
+    }
+
+    void number() {
+        // Leading zeros do not mean octal; only 0x and 0b change the base.
+        std::string text(src_.substr(pos_));
+        int base = 10;
+        size_t prefix = 0;
+        if (text.size() > 2 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X')) { base = 16; prefix = 2; }
+        if (text.size() > 2 && text[0] == '0' && (text[1] == 'b' || text[1] == 'B')) { base = 2; prefix = 2; }
+
+        char* stop = nullptr;
+        errno = 0;
+        uint64_t v = std::strtoull(text.c_str() + prefix, &stop, base);
+        bool overflow = errno == ERANGE;
+        size_t len = static_cast<size_t>(stop - text.c_str());
+        if (base == 10 && len < text.size() && (text[len] == '.' || text[len] == 'e' || text[len] == 'E')) {
+            double d = std::strtod(text.c_str(), &stop);
+            pos_ += static_cast<size_t>(stop - text.c_str());
+            push_const(Value::real(d));
+            return;
+        }
+        if (len == prefix) fail("malformed number");
+        if (overflow) fail("integer literal does not fit in 64 bits");
+        pos_ += len;
+        push_const(Value::integer(static_cast<int64_t>(v)));
+    }
+
+    std::string_view src_;
+    const Resolver& resolve_;
+    size_t pos_ = 0;
+    size_t depth_ = 0;
+    size_t max_depth_ = 0;
+    size_t label_ = 0;          // code before the last jump target is not folded
+    int conditional_ = 0;       // nesting of operands that may not be evaluated
+    Program program_;
+};
+
+Program Program::compile(std::string_view source, const Resolver& resolve) {
+    return Compiler(source, resolve).run();
+}
+
+Value Program::eval(std::span<const Value> slots) const {
+    std::array<Value, MAX_STACK> stack;
+    size_t sp = 0;
+    for (size_t pc = 0; pc < code_.size(); ++pc) {
+        const Instr& in = code_[pc];
+        switch (in.op) {
+        case Op::Const: stack[sp++] = constants_[in.arg]; break;
+        case Op::Load: stack[sp++] = slots[in.arg]; break;
+        // Jump targets may be code_.size(); the loop increment follows.
+        case Op::Jump: pc = in.arg - 1; break;
+        case Op::JumpIfZero:
+            if (stack[--sp].as_double() == 0) pc = in.arg - 1;
+            break;
+        case Op::AndJump:
+            if (stack[sp - 1].as_double() == 0) {
+                stack[sp - 1] = Value::integer(0);
+                pc = in.arg - 1;
+            } else {
+                --sp;
+            }
+            break;
+        case Op::OrJump:
+            if (stack[sp - 1].as_double() != 0) {
+                stack[sp - 1] = Value::integer(1);
+                pc = in.arg - 1;
+            } else {
+                --sp;
+            }
+            break;
+        default:
+            if (arity(in.op) == 1) {
+                stack[sp - 1] = apply_unary(in.op, stack[sp - 1]);
+            } else {
+                --sp;
+                stack[sp - 1] = apply_binary(in.op, stack[sp - 1], stack[sp]);
+            }
+            break;
+        }
+    }
+    return stack[0];
+}
+
+}
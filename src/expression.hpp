@@ -0,0 +1,89 @@
+#ifndef TCP_MQTT_BRIDGE_EXPRESSION_HPP
+#define TCP_MQTT_BRIDGE_EXPRESSION_HPP
+
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Arithmetic/bitwise expressions for derived fields, compiled once into a
+// flat stack bytecode. Syntax follows C: + - * / % << >> & | ^ ~ ! && ||,
+// comparisons, `c ? a : b`, integer (decimal, 0x, 0b) and float literals,
+// and the functions min, max, abs, round, floor, ceil, sqrt, pow, int, float.
+// Values are 64-bit integers or doubles; integer operands stay integers
+// (so 7 / 2 == 3) and any float operand makes the result a float. As in C,
+// `?:`, `&&` and `||` only evaluate the operands they need, so
+// `m != 0 ? x / m : 0` is safe.
+namespace expr {
+
+class ExpressionError : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+struct Value {
+    bool is_float = false;
+    int64_t i = 0;
+    double f = 0;
+
+    static Value integer(int64_t v) { return Value{false, v, 0}; }
+    static Value real(double v) { return Value{true, 0, v}; }
+    double as_double() const { return is_float ? f : static_cast<double>(i); }
+    int64_t as_int() const { return is_float ? static_cast<int64_t>(f) : i; }
+};
+
+enum class Op : uint8_t {
+    Const, Load,
+    Neg, Not, BitNot,
+    Add, Sub, Mul, Div, Mod,
+    Shl, Shr, BitAnd, BitOr, BitXor,
+    Lt, Le, Gt, Ge, Eq, Ne, Bool,
+    Min, Max, Abs, Round, Floor, Ceil, Sqrt, Pow, ToInt, ToFloat,
+    // Control flow for ?:, && and ||, so the operand not chosen never runs.
+    Jump,           // continue at arg
+    JumpIfZero,     // pop the condition; continue at arg if it is zero
+    AndJump,        // if the top is zero replace it with 0 and jump, else pop it
+    OrJump          // if the top is non-zero replace it with 1 and jump, else pop it
+};
+
+struct Instr {
+    Op op;
+    uint32_t arg;   // constant index for Const, slot index for Load, target of jumps
+};
+
+// Maps a variable name to its slot index, or nullopt if it is unknown.
+using Resolver = std::function<std::optional<uint32_t>(std::string_view name)>;
+
+class Program {
+public:
+    static constexpr size_t MAX_STACK = 32;
+
+    Program() = default;
+
+    // Throws ExpressionError with the offending position on syntax errors,
+    // unknown variables or expressions nested too deeply.
+    static Program compile(std::string_view source, const Resolver& resolve);
+
+    // Throws ExpressionError on integer division by zero or bitwise
+    // operations on floats in an operand that is evaluated.
+    Value eval(std::span<const Value> slots) const;
+
+    bool empty() const { return code_.empty(); }
+    size_t size() const { return code_.size(); }
+    // Heap bytes of the compiled code and constants.
+    size_t memoryUsage() const { return code_.capacity() * sizeof(Instr) + constants_.capacity() * sizeof(Value); }
+
+private:
+    friend class Compiler;
+
+    std::vector<Instr> code_;
+    std::vector<Value> constants_;
+};
+
+}
+
+#endif // TCP_MQTT_BRIDGE_EXPRESSION_HPP
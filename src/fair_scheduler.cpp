@@ -0,0 +1,98 @@
+#include "fair_scheduler.hpp"
+#include "metrics.hpp"
+
+FairScheduler::FairScheduler(boost::asio::io_context& ioc, size_t quantum, size_t budget)
+    : ioc_(ioc)
+    , timer_(ioc)
+    , quantum_(std::max<size_t>(quantum, 1))
+    , budget_(std::max(budget, quantum_))
+{
+}
+
+void FairScheduler::activate(const std::shared_ptr<Flow>& flow) {
+    if (!flow->active_) {
+        flow->active_ = true;
+        flow->deficit_ = 0;
+        active_.push_back(flow);
+        if (timer_armed_) {
+            // Everyone else is rate limited; the new flow should not wait for them.
+            timer_armed_ = false;
+            timer_.cancel();
+        }
+    }
+    schedule();
+}
+
+void FairScheduler::schedule() {
+    if (scheduled_ || timer_armed_) return;
+    scheduled_ = true;
+    boost::asio::post(ioc_, [this] { run(); });
+}
+
+void FairScheduler::run() {
+    static auto& deferred = metrics::counter("scheduler_deferred_total", "Frames held back by a session rate limit");
+    static auto& turns = metrics::counter("scheduler_turns_total", "Scheduler turns run");
+    static auto& yields = metrics::counter("scheduler_yields_total", "Turns that used their whole budget and yielded");
+    static auto& active_flows = metrics::gauge("scheduler_active_flows", "Sessions with queued frames");
+
+    scheduled_ = false;
+    turns.inc();
+
+    size_t spent = 0;
+    size_t throttled_in_a_row = 0;
+    auto min_wait = std::chrono::steady_clock::duration::max();
+
+    while (!active_.empty() && spent < budget_) {
+        auto flow = std::move(active_.front());
+        active_.pop_front();
+
+        flow->deficit_ += quantum_;
+        bool throttled = false;
+        auto now = std::chrono::steady_clock::now();
+        while (size_t cost = flow->headCost()) {
+            if (cost > flow->deficit_) break;
+            auto wait = flow->headReadyIn(now);
+            if (wait > std::chrono::steady_clock::duration::zero()) {
+                deferred.inc();
+                min_wait = std::min(min_wait, wait);
+                throttled = true;
+                break;
+            }
+            flow->deficit_ -= cost;
+            spent += cost;
+            flow->runHead();
+            if (spent >= budget_) break;
+        }
+
+        if (flow->headCost() == 0) {
+            flow->active_ = false;
+            flow->deficit_ = 0;
+            continue;
+        }
+        if (throttled) {
+            // A rate-limited flow does not bank credit while it waits.
+            flow->deficit_ = 0;
+        }
+        active_.push_back(flow);
+
+        // Every remaining flow is waiting on its rate limit: sleep instead of spinning.
+        throttled_in_a_row = throttled ? throttled_in_a_row + 1 : 0;
+        if (throttled_in_a_row >= active_.size()) {
+            timer_armed_ = true;
+            timer_.expires_after(min_wait);
+            timer_.async_wait([this](boost::system::error_code ec) {
+                if (ec) return;
+                timer_armed_ = false;
+                schedule();
+            });
+            active_flows.set(static_cast<int64_t>(active_.size()));
+            return;
+        }
+    }
+
+    active_flows.set(static_cast<int64_t>(active_.size()));
+    if (!active_.empty()) {
+        yields.inc();
+        schedule();
+    }
+}
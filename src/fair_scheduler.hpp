@@ -0,0 +1,54 @@
+#ifndef TCP_MQTT_BRIDGE_FAIR_SCHEDULER_HPP
+#define TCP_MQTT_BRIDGE_FAIR_SCHEDULER_HPP
+
+#include <boost/asio.hpp>
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <memory>
+
+// Deficit round robin over sessions with queued frames. Each round a flow
+// earns `quantum` bytes of credit and runs queued frames while it has
+// credit, so a session sending large or many frames gets the same byte share
+// as a quiet one. At most `budget` bytes are processed per turn before the
+// scheduler yields back to the io_context so socket reads keep flowing.
+class FairScheduler {
+public:
+    class Flow {
+    public:
+        virtual ~Flow() = default;
+
+        // Cost in bytes of the next queued frame, 0 when the queue is empty.
+        virtual size_t headCost() const = 0;
+        // Time until the next frame is allowed to run (rate limiting, or a
+        // full downstream queue).
+        virtual std::chrono::steady_clock::duration headReadyIn(std::chrono::steady_clock::time_point now) = 0;
+        virtual void runHead() = 0;
+
+    private:
+        friend class FairScheduler;
+        size_t deficit_ = 0;
+        bool active_ = false;
+    };
+
+    FairScheduler(boost::asio::io_context& ioc, size_t quantum, size_t budget);
+
+    // Call whenever a frame is queued on the flow.
+    void activate(const std::shared_ptr<Flow>& flow);
+
+private:
+    void schedule();
+    void run();
+
+    boost::asio::io_context& ioc_;
+    boost::asio::steady_timer timer_;
+    size_t quantum_;
+    size_t budget_;
+    // Flows are kept alive while they have queued frames, so frames received
+    // before a disconnect are still published.
+    std::deque<std::shared_ptr<Flow>> active_;
+    bool scheduled_ = false;
+    bool timer_armed_ = false;
+};
+
+#endif // TCP_MQTT_BRIDGE_FAIR_SCHEDULER_HPP
@@ -0,0 +1,224 @@
+#include "framing.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace framing {
+
+Kind parse_kind(const std::string& name) {
+    if (name == "slip") return Kind::Slip;
+    if (name == "cobs") return Kind::Cobs;
+    if (name == "length_prefix") return Kind::LengthPrefix;
+    if (name == "raw") return Kind::Raw;
+    throw std::runtime_error("Unknown framing: " + name);
+}
+
+const char* kind_name(Kind kind) {
+    switch (kind) {
+    case Kind::Slip: return "slip";
+    case Kind::Cobs: return "cobs";
+    case Kind::LengthPrefix: return "length_prefix";
+    case Kind::Raw: return "raw";
+    }
+    return "unknown";
+}
+
+namespace cobs {
+
+std::vector<uint8_t> encode(std::span<const uint8_t> data) {
+    std::vector<uint8_t> encoded;
+    encoded.reserve(data.size() + data.size() / 254 + 2);
+
+    size_t code_pos = encoded.size();
+    encoded.push_back(0);
+    uint8_t code = 1;
+    for (uint8_t byte : data) {
+        if (byte == 0) {
+            encoded[code_pos] = code;
+            code_pos = encoded.size();
+            encoded.push_back(0);
+            code = 1;
+            continue;
+        }
+        encoded.push_back(byte);
+        if (++code == 0xFF) {
+            encoded[code_pos] = code;
+            code_pos = encoded.size();
+            encoded.push_back(0);
+            code = 1;
+        }
+    }
+    encoded[code_pos] = code;
+    encoded.push_back(0);   // frame delimiter
+    return encoded;
+}
+
+void Decoder::decode(std::span<const uint8_t> data) {
+    while (!data.empty()) {
+        const auto* delim = static_cast<const uint8_t*>(std::memchr(data.data(), 0, data.size()));
+        if (!delim) {
+            if (buffer_.size() + data.size() > MAX_FRAME_SIZE) {
+                buffer_.clear();
+                throw FramingError("COBS frame exceeds maximum size");
+            }
+            buffer_.insert(buffer_.end(), data.begin(), data.end());
+            return;
+        }
+
+        size_t len = static_cast<size_t>(delim - data.data());
+        if (buffer_.empty()) {
+            emit(data.first(len));
+        } else {
+            buffer_.insert(buffer_.end(), data.begin(), data.begin() + static_cast<std::ptrdiff_t>(len));
+            high_water_ = std::max(high_water_, buffer_.size());
+            std::vector<uint8_t> encoded;
+            encoded.swap(buffer_);
+            emit(encoded);
+        }
+        data = data.subspan(len + 1);
+    }
+}
+
+void Decoder::emit(std::span<const uint8_t> encoded) {
+    if (encoded.empty()) return;
+
+    decoded_.clear();
+    size_t pos = 0;
+    while (pos < encoded.size()) {
+        uint8_t code = encoded[pos++];
+        size_t run = code - 1u;
+        if (code == 0 || pos + run > encoded.size()) {
+            throw FramingError("Invalid COBS block");
+        }
+        decoded_.insert(decoded_.end(), encoded.begin() + static_cast<std::ptrdiff_t>(pos),
+                        encoded.begin() + static_cast<std::ptrdiff_t>(pos + run));
+        pos += run;
+        if (code != 0xFF && pos < encoded.size()) {
+            decoded_.push_back(0);
+        }
+    }
+    if (onPacket_ && !decoded_.empty()) {
+        onPacket_(std::span<const uint8_t>(decoded_));
+    }
+}
+
+}
+
+namespace length_prefix {
+
+std::vector<uint8_t> encode(std::span<const uint8_t> data) {
+    std::vector<uint8_t> encoded;
+    encoded.reserve(data.size() + 5);
+    size_t len = data.size();
+    do {
+        uint8_t byte = len & 0x7F;
+        len >>= 7;
+        encoded.push_back(len ? (byte | 0x80) : byte);
+    } while (len);
+    encoded.insert(encoded.end(), data.begin(), data.end());
+    return encoded;
+}
+
+void Decoder::reset() {
+    buffer_.clear();
+    expected_ = 0;
+    length_ = 0;
+    length_shift_ = 0;
+    in_payload_ = false;
+}
+
+void Decoder::decode(std::span<const uint8_t> data) {
+    while (!data.empty()) {
+        if (!in_payload_) {
+            uint8_t byte = data.front();
+            data = data.subspan(1);
+            length_ |= uint32_t(byte & 0x7F) << length_shift_;
+            length_shift_ += 7;
+            if (byte & 0x80) {
+                if (length_shift_ >= 28) {
+                    reset();
+                    throw FramingError("Length prefix too long");
+                }
+                continue;
+            }
+            if (length_ > MAX_FRAME_SIZE) {
+                reset();
+                throw FramingError("Frame exceeds maximum size");
+            }
+            expected_ = length_;
+            length_ = 0;
+            length_shift_ = 0;
+            in_payload_ = expected_ > 0;
+            continue;
+        }
+
+        // The length is known up front: whole frames already in the read
+        // buffer are handed out in place, partial ones are copied once.
+        if (buffer_.empty() && data.size() >= expected_) {
+            auto frame = data.first(expected_);
+            data = data.subspan(expected_);
+            in_payload_ = false;
+            if (onPacket_) onPacket_(frame);
+            continue;
+        }
+
+        size_t take = std::min(expected_ - buffer_.size(), data.size());
+        buffer_.insert(buffer_.end(), data.begin(), data.begin() + static_cast<std::ptrdiff_t>(take));
+        data = data.subspan(take);
+        if (buffer_.size() == expected_) {
+            high_water_ = std::max(high_water_, buffer_.size());
+            in_payload_ = false;
+            std::vector<uint8_t> frame;
+            frame.swap(buffer_);
+            if (onPacket_) onPacket_(frame);
+        }
+    }
+}
+
+}
+
+FrameCodec::FrameCodec(Kind kind, const PacketDbStore* packet_db, RawLimits raw_limits)
+    : kind_(kind)
+{
+    switch (kind) {
+    case Kind::Slip: decoder_.emplace<Codec<Kind::Slip>::Decoder>(); break;
+    case Kind::Cobs: decoder_.emplace<Codec<Kind::Cobs>::Decoder>(); break;
+    case Kind::LengthPrefix: decoder_.emplace<Codec<Kind::LengthPrefix>::Decoder>(); break;
+    case Kind::Raw:
+        if (!packet_db) throw std::invalid_argument("raw framing needs the packet definitions");
+        decoder_.emplace<Codec<Kind::Raw>::Decoder>(*packet_db, raw_limits);
+        break;
+    }
+}
+
+void FrameCodec::setPacketHandler(PacketHandler handler) {
+    std::visit([&handler](auto& decoder) { decoder.setPacketHandler(std::move(handler)); }, decoder_);
+}
+
+void FrameCodec::decode(std::span<const uint8_t> data) {
+    std::visit([data](auto& decoder) { decoder.decode(data); }, decoder_);
+}
+
+void FrameCodec::reset() {
+    std::visit([](auto& decoder) { decoder.reset(); }, decoder_);
+}
+
+size_t FrameCodec::bufferCapacity() const {
+    return std::visit([](const auto& decoder) { return decoder.bufferCapacity(); }, decoder_);
+}
+
+size_t FrameCodec::highWater() const {
+    return std::visit([](const auto& decoder) { return decoder.highWater(); }, decoder_);
+}
+
+std::vector<uint8_t> FrameCodec::encode(std::span<const uint8_t> data) const {
+    switch (kind_) {
+    case Kind::Slip: return Codec<Kind::Slip>::encode(data);
+    case Kind::Cobs: return Codec<Kind::Cobs>::encode(data);
+    case Kind::LengthPrefix: return Codec<Kind::LengthPrefix>::encode(data);
+    case Kind::Raw: return Codec<Kind::Raw>::encode(data);
+    }
+    return {};
+}
+
+}
@@ -0,0 +1,141 @@
+#ifndef TCP_MQTT_BRIDGE_FRAMING_HPP
+#define TCP_MQTT_BRIDGE_FRAMING_HPP
+
+#include "slip.hpp"
+#include "raw_stream.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <variant>
+#include <vector>
+
+namespace framing {
+
+enum class Kind {
+    Slip,           // RFC 1055, END-delimited with escaping
+    Cobs,           // consistent overhead byte stuffing, 0x00-delimited
+    LengthPrefix,   // unsigned LEB128 length followed by the payload
+    Raw             // no framing; packet boundaries come from the definitions
+};
+
+Kind parse_kind(const std::string& name);
+const char* kind_name(Kind kind);
+
+class FramingError : public std::runtime_error {
+public:
+    explicit FramingError(const std::string& message) : std::runtime_error(message) {}
+};
+
+using PacketHandler = slip::PacketHandler;
+
+// Frames larger than this are rejected instead of growing the buffer forever.
+constexpr size_t MAX_FRAME_SIZE = 64 * 1024;
+
+namespace cobs {
+    std::vector<uint8_t> encode(std::span<const uint8_t> data);
+
+    class Decoder {
+    public:
+        void setPacketHandler(PacketHandler handler) { onPacket_ = std::move(handler); }
+        void decode(std::span<const uint8_t> data);
+        void reset() { buffer_.clear(); }
+        size_t bufferCapacity() const { return buffer_.capacity() + decoded_.capacity(); }
+        size_t highWater() const { return std::max(high_water_, buffer_.size()); }
+
+    private:
+        void emit(std::span<const uint8_t> encoded);
+
+        std::vector<uint8_t> buffer_;   // encoded bytes of an incomplete frame
+        std::vector<uint8_t> decoded_;
+        size_t high_water_ = 0;
+        PacketHandler onPacket_;
+    };
+}
+
+namespace length_prefix {
+    std::vector<uint8_t> encode(std::span<const uint8_t> data);
+
+    class Decoder {
+    public:
+        void setPacketHandler(PacketHandler handler) { onPacket_ = std::move(handler); }
+        void decode(std::span<const uint8_t> data);
+        void reset();
+        size_t bufferCapacity() const { return buffer_.capacity(); }
+        size_t highWater() const { return std::max(high_water_, buffer_.size()); }
+
+    private:
+        std::vector<uint8_t> buffer_;
+        size_t high_water_ = 0;
+        size_t expected_ = 0;       // payload bytes still missing for the current frame
+        uint32_t length_ = 0;
+        unsigned length_shift_ = 0;
+        bool in_payload_ = false;
+        PacketHandler onPacket_;
+    };
+}
+
+template <Kind K> struct Codec;
+
+template <> struct Codec<Kind::Slip> {
+    using Decoder = slip::Decoder;
+    static std::vector<uint8_t> encode(std::span<const uint8_t> data) { return slip::encode(data); }
+};
+
+template <> struct Codec<Kind::Cobs> {
+    using Decoder = cobs::Decoder;
+    static std::vector<uint8_t> encode(std::span<const uint8_t> data) { return cobs::encode(data); }
+};
+
+template <> struct Codec<Kind::LengthPrefix> {
+    using Decoder = length_prefix::Decoder;
+    static std::vector<uint8_t> encode(std::span<const uint8_t> data) { return length_prefix::encode(data); }
+};
+
+template <> struct Codec<Kind::Raw> {
+    using Decoder = RawStream;
+    static std::vector<uint8_t> encode(std::span<const uint8_t> data) { return {data.begin(), data.end()}; }
+};
+
+// Stream decoder and encoder for one connection. The framing is picked once
+// per listener; each alternative is a concrete type, so the per-byte work is
+// fully specialised and dispatch happens once per read.
+class FrameCodec {
+public:
+    // Raw streams need the packet definitions to find packet boundaries.
+    explicit FrameCodec(Kind kind, const PacketDbStore* packet_db = nullptr, RawLimits raw_limits = {});
+
+    Kind kind() const { return kind_; }
+    void setPacketHandler(PacketHandler handler);
+    void decode(std::span<const uint8_t> data);
+    void reset();
+    std::vector<uint8_t> encode(std::span<const uint8_t> data) const;
+
+    // Bytes the decoder holds for reassembly, and the largest frame it has
+    // had to buffer (frames decoded in place from the read buffer count as
+    // zero).
+    size_t bufferCapacity() const;
+    size_t highWater() const;
+
+    // Empty for raw streams: devices that do not frame their packets do not
+    // expect ACK or NAK either.
+    std::vector<uint8_t> makeResponse(uint8_t type) const {
+        if (kind_ == Kind::Raw) return {};
+        return encode(std::span<const uint8_t>(&type, 1));
+    }
+
+    // The raw stream decoder, for sessions that pull packets from it; null
+    // for framed kinds.
+    RawStream* raw() { return std::get_if<RawStream>(&decoder_); }
+
+private:
+    Kind kind_;
+    std::variant<Codec<Kind::Slip>::Decoder, Codec<Kind::Cobs>::Decoder, Codec<Kind::LengthPrefix>::Decoder,
+                 Codec<Kind::Raw>::Decoder> decoder_;
+};
+
+}
+
+#endif // TCP_MQTT_BRIDGE_FRAMING_HPP
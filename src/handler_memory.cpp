@@ -0,0 +1,75 @@
+#include "handler_memory.hpp"
+#include "metrics.hpp"
+
+#include <array>
+#include <new>
+#include <vector>
+
+namespace handler_memory {
+
+namespace {
+
+constexpr std::array<size_t, 6> SIZE_CLASSES = {64, 128, 256, 512, 1024, 2048};
+constexpr size_t MAX_FREE_BLOCKS = 1024;    // kept per size class and thread
+
+// Set once the thread's pool is gone; handlers destroyed during thread
+// teardown then go straight to the heap.
+thread_local bool pool_destroyed = false;
+
+struct Pool {
+    std::array<std::vector<void*>, SIZE_CLASSES.size()> free;
+
+    Pool() {
+        for (auto& blocks : free) blocks.reserve(MAX_FREE_BLOCKS);
+    }
+
+    ~Pool() {
+        pool_destroyed = true;
+        for (auto& blocks : free) {
+            for (void* block : blocks) ::operator delete(block);
+        }
+    }
+};
+
+Pool& pool() {
+    thread_local Pool instance;
+    return instance;
+}
+
+// Index of the smallest class that fits, or SIZE_CLASSES.size() if none does.
+size_t size_class(size_t size) {
+    size_t c = 0;
+    while (c < SIZE_CLASSES.size() && SIZE_CLASSES[c] < size) ++c;
+    return c;
+}
+
+}
+
+void* allocate(size_t size) {
+    static auto& heap = metrics::counter("handler_heap_allocations_total", "Handler allocations not served from a free list");
+    size_t c = size_class(size);
+    if (c < SIZE_CLASSES.size() && !pool_destroyed) {
+        auto& blocks = pool().free[c];
+        if (!blocks.empty()) {
+            void* block = blocks.back();
+            blocks.pop_back();
+            return block;
+        }
+    }
+    heap.inc();
+    return ::operator new(c < SIZE_CLASSES.size() ? SIZE_CLASSES[c] : size);
+}
+
+void deallocate(void* pointer, size_t size) noexcept {
+    size_t c = size_class(size);
+    if (c < SIZE_CLASSES.size() && !pool_destroyed) {
+        auto& blocks = pool().free[c];
+        if (blocks.size() < MAX_FREE_BLOCKS) {
+            blocks.push_back(pointer);
+            return;
+        }
+    }
+    ::operator delete(pointer);
+}
+
+}
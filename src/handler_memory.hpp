@@ -0,0 +1,50 @@
+#ifndef TCP_MQTT_BRIDGE_HANDLER_MEMORY_HPP
+#define TCP_MQTT_BRIDGE_HANDLER_MEMORY_HPP
+
+#include <boost/asio.hpp>
+
+#include <cstddef>
+#include <utility>
+
+// Memory for completion handlers and the asynchronous operations that carry
+// them. Each thread keeps free lists of released blocks by size class, so a
+// read, write or publish whose completion starts the next operation reuses
+// the block the previous one gave back instead of going to the heap.
+// asio::recycling_allocator works the same way but caches only two blocks
+// per thread, too few with hundreds of publishes in flight.
+//
+// A block released on another thread joins that thread's free lists.
+namespace handler_memory {
+
+void* allocate(size_t size);
+void deallocate(void* pointer, size_t size) noexcept;
+
+// Stateless, so handlers bound to it can be destroyed after their owner.
+template <typename T>
+class Allocator {
+public:
+    using value_type = T;
+
+    Allocator() noexcept = default;
+    template <typename U>
+    Allocator(const Allocator<U>&) noexcept {}
+
+    T* allocate(size_t n) { return static_cast<T*>(handler_memory::allocate(n * sizeof(T))); }
+    void deallocate(T* pointer, size_t n) noexcept { handler_memory::deallocate(pointer, n * sizeof(T)); }
+
+    template <typename U>
+    bool operator==(const Allocator<U>&) const noexcept { return true; }
+    template <typename U>
+    bool operator!=(const Allocator<U>&) const noexcept { return false; }
+};
+
+// Associates the free lists with a handler. Asio, Boost.MQTT5 and
+// any_completion_handler then allocate the operation state through them.
+template <typename Handler>
+auto bind(Handler&& handler) {
+    return boost::asio::bind_allocator(Allocator<void>(), std::forward<Handler>(handler));
+}
+
+}
+
+#endif // TCP_MQTT_BRIDGE_HANDLER_MEMORY_HPP
@@ -1,11 +1,11 @@
 #include "config.hpp"
 #include "server_manager.hpp"
-#include "packet_parser_yaml.hpp"
+#include "packet_db_loader.hpp"
+#include "packet_db_snapshot.hpp"
 #include <boost/program_options.hpp>
 #include <cpptrace/cpptrace.hpp>
 #include <spdlog/spdlog.h>
 
-#include <fstream>
 #include <iostream>
 #include <filesystem>
 
@@ -21,6 +21,8 @@ int main(int argc, char* argv[]) {
         ("port,p", po::value<unsigned short>(), "TCP port (overrides config)")
         ("bind,b", po::value<std::string>(), "Bind address (overrides config)")
         ("log-level,l", po::value<std::string>(), "Log level (trace,debug,info,warn,error,critical,off)")
+        ("capture", po::value<std::string>(), "Record raw device streams to this file (see bridge_replay)")
+        ("soak", po::value<uint32_t>(), "Run a memory soak test for this many seconds, then exit (non-zero if memory grew)")
         ("verbose,v", "Enable debug logging (shorthand)");
 
     po::variables_map vm;
@@ -65,63 +67,17 @@ int main(int argc, char* argv[]) {
         // Override with command line if specified
         if (vm.count("port")) config.tcp.port = vm["port"].as<unsigned short>();
         if (vm.count("bind")) config.tcp.bind_address = vm["bind"].as<std::string>();
+        if (vm.count("capture")) config.capture.path = vm["capture"].as<std::string>();
+        if (vm.count("soak")) config.memory.soak_duration_s = vm["soak"].as<uint32_t>();
 
-        // Process each packet definition directory
-        PacketDb packet_db;
-        std::filesystem::path config_dir = std::filesystem::path(config_path).parent_path();
-        
-        for (const auto& path : config.packet_defs.paths) {
-            std::filesystem::path full_path = path[0] == '/' ? 
-                std::filesystem::path{path}: config_dir / path;
-            
-            if (!std::filesystem::exists(full_path)) {
-                spdlog::warn("Packet definitions path does not exist: {}", full_path.string());
-                continue;
-            }
-
-            try {
-                for (const auto& pattern : config.packet_defs.patterns) {
-                    for (const auto& entry : std::filesystem::recursive_directory_iterator(full_path)) {
-                        if (!entry.is_regular_file()) continue;
-                        
-                        const auto& file_path = entry.path();
-                        if (!std::filesystem::path(pattern).filename().string().empty() && 
-                            !file_path.filename().string().ends_with(pattern.substr(1))) {
-                            continue;
-                        }
-
-                        std::ifstream packet_file(file_path);
-                        if (!packet_file) {
-                            spdlog::error("Could not open packet definitions file: {}", file_path.string());
-                            continue;
-                        }
-
-                        std::string yaml_content((std::istreambuf_iterator<char>(packet_file)),
-                                            std::istreambuf_iterator<char>());
-                        auto new_packets = packetdb_from_yaml(yaml_content);
-                        packet_db.insert(packet_db.end(), new_packets.begin(), new_packets.end());
-                        spdlog::info("Loaded {} packet definitions from {}", 
-                                    new_packets.size(), file_path.string());
-                    }
-                }
-            } catch (const std::exception& e) {
-                spdlog::error("Error processing packet definitions in {}: {}", 
-                            full_path.string(), e.what());
-                return 1;
-            }
-        }
-
-        if (packet_db.empty()) {
-            spdlog::error("No packet definitions were loaded");
-            return 1;
-        }
-        
-        spdlog::info("Loaded {} total packet definitions", packet_db.size());
+        PacketDbStore packet_db(std::make_shared<const PacketDbSnapshot>(load_packet_db(config.packet_defs)));
+        spdlog::info("Loaded {} total packet definitions", packet_db.load()->db().size());
 
         spdlog::info("Starting TCP <-> MQTT Bridge");
 
         ServerManager server(config, packet_db);
         server.run();
+        if (server.soakFailed()) return 2;
     } catch (const std::exception& e) {
         spdlog::error("Failed to parse packet definitions: {}", e.what());
         return 1;
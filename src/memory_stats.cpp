@@ -0,0 +1,196 @@
+#include "memory_stats.hpp"
+#include "metrics.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+
+#include <unistd.h>
+
+namespace memstats {
+
+namespace {
+
+// A std::map / std::set node: three links and a colour ahead of the element.
+constexpr size_t TREE_NODE_OVERHEAD = 32;
+
+size_t value_bytes(const FieldValue& value) {
+    if (const auto* bytes = value.get_if<std::vector<uint8_t>>()) return bytes->capacity();
+    return 0;
+}
+
+std::string format_session(const SessionUsage& usage) {
+    return fmt::format("session {}, decoder {} (high water {}), json {}, queues {}",
+                       usage.session, usage.decoder, usage.decoder_high_water, usage.json, usage.queues);
+}
+
+}
+
+size_t string_bytes(const std::string& s) {
+    const auto* begin = reinterpret_cast<const char*>(&s);
+    bool inline_buffer = s.data() >= begin && s.data() < begin + sizeof(s);
+    return inline_buffer ? 0 : s.capacity() + 1;
+}
+
+size_t json_bytes(const nlohmann::json& value) {
+    using json = nlohmann::json;
+    switch (value.type()) {
+    case json::value_t::object: {
+        size_t bytes = sizeof(json::object_t);
+        for (const auto& [key, element] : value.get_ref<const json::object_t&>()) {
+            bytes += TREE_NODE_OVERHEAD + sizeof(json::object_t::value_type) + string_bytes(key) + json_bytes(element);
+        }
+        return bytes;
+    }
+    case json::value_t::array: {
+        const auto& array = value.get_ref<const json::array_t&>();
+        size_t bytes = sizeof(json::array_t) + array.capacity() * sizeof(json);
+        for (const auto& element : array) bytes += json_bytes(element);
+        return bytes;
+    }
+    case json::value_t::string:
+        return sizeof(json::string_t) + string_bytes(value.get_ref<const json::string_t&>());
+    case json::value_t::binary:
+        return sizeof(json::binary_t) + value.get_binary().capacity();
+    default:
+        return 0;
+    }
+}
+
+size_t packet_db_bytes(const PacketDb& db) {
+    size_t bytes = db.capacity() * sizeof(PacketDesc);
+    for (const auto& pkt : db) {
+        bytes += string_bytes(pkt.name) + string_bytes(pkt.mqtt.topic) + string_bytes(pkt.mqtt.payload) +
+                 string_bytes(pkt.device_id_field) + value_bytes(pkt.id_value);
+        if (pkt.downlink) bytes += string_bytes(pkt.downlink->topic);
+        bytes += pkt.fields.capacity() * sizeof(FieldDesc);
+        for (const auto& field : pkt.fields) {
+            bytes += string_bytes(field.name);
+            if (field.value) bytes += value_bytes(*field.value);
+        }
+        bytes += pkt.derived.capacity() * sizeof(DerivedField);
+        for (const auto& derived : pkt.derived) {
+            bytes += string_bytes(derived.name) + string_bytes(derived.expression) + derived.program.memoryUsage();
+        }
+    }
+    return bytes;
+}
+
+size_t rss_bytes() {
+    std::ifstream statm("/proc/self/statm");
+    size_t total_pages = 0, resident_pages = 0;
+    if (!(statm >> total_pages >> resident_pages)) return 0;
+    return resident_pages * static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+}
+
+void Report::addConnection(std::string address, const SessionUsage& usage) {
+    ++connections_;
+    sessions_.session += usage.session;
+    sessions_.decoder += usage.decoder;
+    sessions_.decoder_high_water = std::max(sessions_.decoder_high_water, usage.decoder_high_water);
+    sessions_.json += usage.json;
+    sessions_.queues += usage.queues;
+    top_.push_back(ConnectionUsage{std::move(address), usage});
+}
+
+void Report::keepTop(size_t n) {
+    auto larger = [](const ConnectionUsage& a, const ConnectionUsage& b) { return a.usage.total() > b.usage.total(); };
+    if (top_.size() > n) {
+        std::partial_sort(top_.begin(), top_.begin() + static_cast<std::ptrdiff_t>(n), top_.end(), larger);
+        top_.resize(n);
+    } else {
+        std::sort(top_.begin(), top_.end(), larger);
+    }
+}
+
+void Report::publish() const {
+    static auto& session = metrics::gauge("memory_sessions_bytes", "Bytes held by TCP sessions and connection managers");
+    static auto& decoder = metrics::gauge("memory_decoder_bytes", "Bytes held by frame decoder buffers");
+    static auto& high_water = metrics::gauge("memory_decoder_high_water_bytes", "Largest frame any decoder has had to buffer");
+    static auto& json = metrics::gauge("memory_json_bytes", "Bytes held by packet field scopes");
+    static auto& queues = metrics::gauge("memory_session_queues_bytes", "Bytes held by per-session frame and write queues");
+    static auto& mqtt = metrics::gauge("memory_mqtt_pending_bytes", "Bytes held by queued and in-flight MQTT publishes");
+    static auto& packet_db_gauge = metrics::gauge("memory_packet_db_bytes", "Bytes held by the packet definitions");
+    static auto& tracked_gauge = metrics::gauge("memory_tracked_bytes", "Sum of all tracked memory");
+    static auto& rss_gauge = metrics::gauge("memory_rss_bytes", "Resident set size of the process");
+    session.set(static_cast<int64_t>(sessions_.session));
+    decoder.set(static_cast<int64_t>(sessions_.decoder));
+    high_water.set(static_cast<int64_t>(sessions_.decoder_high_water));
+    json.set(static_cast<int64_t>(sessions_.json));
+    queues.set(static_cast<int64_t>(sessions_.queues));
+    mqtt.set(static_cast<int64_t>(mqtt_pending));
+    packet_db_gauge.set(static_cast<int64_t>(packet_db));
+    tracked_gauge.set(static_cast<int64_t>(tracked()));
+    rss_gauge.set(static_cast<int64_t>(rss));
+}
+
+std::string Report::render() const {
+    std::string out = fmt::format("tracked {} bytes, rss {} bytes\n", tracked(), rss);
+    out += fmt::format("connections {}: {} bytes ({})\n", connections_, sessions_.total(), format_session(sessions_));
+    out += fmt::format("mqtt pending {} bytes\n", mqtt_pending);
+    out += fmt::format("packet db {} bytes\n", packet_db);
+    if (!top_.empty()) {
+        out += "\ntop connections:\n";
+        for (const auto& connection : top_) {
+            out += fmt::format("  {} {} bytes ({})\n", connection.address, connection.usage.total(), format_session(connection.usage));
+        }
+    }
+    return out;
+}
+
+SoakCheck::SoakCheck(std::chrono::seconds warmup, double max_growth)
+    : warm_at_(std::chrono::steady_clock::now() + warmup)
+    , max_growth_(max_growth)
+{
+}
+
+void SoakCheck::sample(const Report& report) {
+    if (std::chrono::steady_clock::now() < warm_at_) return;
+    samples_.push_back(Sample{report.tracked(), report.rss, report.connections()});
+}
+
+namespace {
+
+struct Growth {
+    size_t before;      // largest sample of the first quarter
+    size_t after;       // smallest sample of the last quarter
+};
+
+template <typename Samples, typename Get>
+Growth growth(const Samples& samples, Get get) {
+    size_t quarter = std::max<size_t>(1, samples.size() / 4);
+    Growth g{0, SIZE_MAX};
+    for (size_t i = 0; i < quarter; ++i) g.before = std::max(g.before, get(samples[i]));
+    for (size_t i = samples.size() - quarter; i < samples.size(); ++i) g.after = std::min(g.after, get(samples[i]));
+    return g;
+}
+
+bool grew(const Growth& g, double max_growth) {
+    return static_cast<double>(g.after) > static_cast<double>(g.before) * (1.0 + max_growth);
+}
+
+}
+
+bool SoakCheck::flat() const {
+    if (samples_.size() < 4) return false;
+    return !grew(growth(samples_, [](const Sample& s) { return s.tracked; }), max_growth_) &&
+           !grew(growth(samples_, [](const Sample& s) { return s.rss; }), max_growth_);
+}
+
+std::string SoakCheck::summary() const {
+    if (samples_.size() < 4) {
+        return fmt::format("only {} samples after the warm-up, need at least 4", samples_.size());
+    }
+    auto tracked = growth(samples_, [](const Sample& s) { return s.tracked; });
+    auto rss = growth(samples_, [](const Sample& s) { return s.rss; });
+    auto percent = [](const Growth& g) {
+        return g.before ? 100.0 * (static_cast<double>(g.after) - static_cast<double>(g.before)) / static_cast<double>(g.before) : 0.0;
+    };
+    return fmt::format("{} samples, {} -> {} connections; tracked {} -> {} bytes ({:+.1f}%), rss {} -> {} bytes ({:+.1f}%)",
+                       samples_.size(), samples_.front().connections, samples_.back().connections,
+                       tracked.before, tracked.after, percent(tracked), rss.before, rss.after, percent(rss));
+}
+
+}
@@ -0,0 +1,98 @@
+#ifndef TCP_MQTT_BRIDGE_MEMORY_STATS_HPP
+#define TCP_MQTT_BRIDGE_MEMORY_STATS_HPP
+
+#include "packet_parser.hpp"
+
+#include <nlohmann/json.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Memory accounting. Each owner reports the bytes it holds (containers by
+// capacity, strings beyond the small-string buffer, node-based containers
+// with a per-node estimate), so the figures are close to, not exactly, what
+// the allocator hands out. Reports are built on demand on the I/O thread.
+namespace memstats {
+
+// Heap bytes of a string beyond its inline buffer.
+size_t string_bytes(const std::string& s);
+// Approximate heap bytes of a JSON value: nodes, keys and strings.
+size_t json_bytes(const nlohmann::json& value);
+// Approximate heap bytes of packet definitions, excluding the vector itself.
+size_t packet_db_bytes(const PacketDb& db);
+// Resident set size of this process, or 0 if it cannot be read.
+size_t rss_bytes();
+
+// Bytes held for one device connection.
+struct SessionUsage {
+    size_t session = 0;             // TcpSession (with its read buffer) and ConnectionManager
+    size_t decoder = 0;             // frame decoder buffers
+    size_t decoder_high_water = 0;  // largest frame the decoder had to buffer
+    size_t json = 0;                // PacketProcessor field scopes
+    size_t queues = 0;              // frames waiting for a turn, responses waiting for the socket
+
+    size_t total() const { return session + decoder + json + queues; }
+};
+
+struct ConnectionUsage {
+    std::string address;
+    SessionUsage usage;
+};
+
+class Report {
+public:
+    void addConnection(std::string address, const SessionUsage& usage);
+    // Keeps only the n largest connections; call after the last addConnection().
+    void keepTop(size_t n);
+
+    size_t mqtt_pending = 0;        // queued and in-flight publishes with their closures
+    size_t packet_db = 0;           // current definitions and compiled templates
+    size_t rss = 0;
+
+    size_t connections() const { return connections_; }
+    // Summed over all connections; decoder_high_water is the largest one.
+    const SessionUsage& sessions() const { return sessions_; }
+    const std::vector<ConnectionUsage>& top() const { return top_; }
+    size_t tracked() const { return sessions_.total() + mqtt_pending + packet_db; }
+
+    // Sets the memory_* gauges.
+    void publish() const;
+    // Plain-text report for the /memory endpoint.
+    std::string render() const;
+
+private:
+    size_t connections_ = 0;
+    SessionUsage sessions_;
+    std::vector<ConnectionUsage> top_;
+};
+
+// Soak test: collects tracked and resident memory after a warm-up and
+// decides whether it stayed flat. Memory counts as grown when the smallest
+// sample of the last quarter exceeds the largest of the first quarter by
+// more than max_growth (a ratio), which tolerates noise in both directions.
+class SoakCheck {
+public:
+    SoakCheck(std::chrono::seconds warmup, double max_growth);
+
+    void sample(const Report& report);
+    // Needs at least four samples after the warm-up; fewer count as a failure.
+    bool flat() const;
+    std::string summary() const;
+
+private:
+    struct Sample {
+        size_t tracked;
+        size_t rss;
+        size_t connections;
+    };
+
+    std::chrono::steady_clock::time_point warm_at_;
+    double max_growth_;
+    std::vector<Sample> samples_;
+};
+
+}
+
+#endif // TCP_MQTT_BRIDGE_MEMORY_STATS_HPP
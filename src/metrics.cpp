@@ -0,0 +1,109 @@
+#include "metrics.hpp"
+
+#include <fmt/format.h>
+
+#include <bit>
+
+namespace metrics {
+
+void Histogram::record(std::chrono::nanoseconds elapsed) {
+    auto us = static_cast<uint64_t>(std::max<int64_t>(0, std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count()));
+    size_t index = std::min<size_t>(std::bit_width(us), BUCKETS - 1);
+    buckets_[index].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_us_.fetch_add(us, std::memory_order_relaxed);
+}
+
+uint64_t Histogram::quantileMicros(double q) const {
+    uint64_t total = count();
+    if (total == 0) return 0;
+    auto target = static_cast<uint64_t>(q * static_cast<double>(total));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; ++i) {
+        seen += bucket(i);
+        if (seen > target) return uint64_t{1} << i;
+    }
+    return uint64_t{1} << (BUCKETS - 1);
+}
+
+Registry& Registry::instance() {
+    static Registry registry;
+    return registry;
+}
+
+namespace {
+
+template <typename T, typename Map>
+T& find_or_create(Map& map, const std::string& name, const std::string& help) {
+    auto& entry = map[name];
+    if (!entry.metric) {
+        entry.metric = std::make_unique<T>();
+        entry.help = help;
+    }
+    return *entry.metric;
+}
+
+}
+
+Counter& Registry::counter(const std::string& name, const std::string& help) {
+    std::lock_guard lock(mutex_);
+    return find_or_create<Counter>(counters_, name, help);
+}
+
+Gauge& Registry::gauge(const std::string& name, const std::string& help) {
+    std::lock_guard lock(mutex_);
+    return find_or_create<Gauge>(gauges_, name, help);
+}
+
+Histogram& Registry::histogram(const std::string& name, const std::string& help) {
+    std::lock_guard lock(mutex_);
+    return find_or_create<Histogram>(histograms_, name, help);
+}
+
+std::string Registry::renderText() const {
+    std::lock_guard lock(mutex_);
+    std::string out;
+    auto header = [&out](const std::string& name, const std::string& help, const char* type) {
+        if (!help.empty()) out += fmt::format("# HELP {} {}\n", name, help);
+        out += fmt::format("# TYPE {} {}\n", name, type);
+    };
+    for (const auto& [name, entry] : counters_) {
+        header(name, entry.help, "counter");
+        out += fmt::format("{} {}\n", name, entry.metric->value());
+    }
+    for (const auto& [name, entry] : gauges_) {
+        header(name, entry.help, "gauge");
+        out += fmt::format("{} {}\n", name, entry.metric->value());
+    }
+    for (const auto& [name, entry] : histograms_) {
+        header(name, entry.help, "histogram");
+        uint64_t cumulative = 0;
+        for (size_t i = 0; i < Histogram::BUCKETS; ++i) {
+            cumulative += entry.metric->bucket(i);
+            out += fmt::format("{}_bucket{{le=\"{}\"}} {}\n", name, uint64_t{1} << i, cumulative);
+        }
+        out += fmt::format("{}_bucket{{le=\"+Inf\"}} {}\n", name, entry.metric->count());
+        out += fmt::format("{}_sum {}\n", name, entry.metric->sumMicros());
+        out += fmt::format("{}_count {}\n", name, entry.metric->count());
+    }
+    return out;
+}
+
+std::string Registry::renderSummary() const {
+    std::lock_guard lock(mutex_);
+    std::string out;
+    for (const auto& [name, entry] : counters_) {
+        out += fmt::format("{}={} ", name, entry.metric->value());
+    }
+    for (const auto& [name, entry] : gauges_) {
+        out += fmt::format("{}={} ", name, entry.metric->value());
+    }
+    for (const auto& [name, entry] : histograms_) {
+        const auto& h = *entry.metric;
+        out += fmt::format("{}{{n={} p50<{}us p99<{}us}} ", name, h.count(), h.quantileMicros(0.5), h.quantileMicros(0.99));
+    }
+    if (!out.empty()) out.pop_back();
+    return out;
+}
+
+}
@@ -0,0 +1,97 @@
+#ifndef TCP_MQTT_BRIDGE_METRICS_HPP
+#define TCP_MQTT_BRIDGE_METRICS_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+// Process-wide counters and latency histograms. Updates are lock-free and may
+// happen from any thread; only registration and rendering take the lock.
+namespace metrics {
+
+class Counter {
+public:
+    void inc(uint64_t n = 1) { value_.fetch_add(n, std::memory_order_relaxed); }
+    uint64_t value() const { return value_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> value_{0};
+};
+
+class Gauge {
+public:
+    void set(int64_t v) { value_.store(v, std::memory_order_relaxed); }
+    void add(int64_t n) { value_.fetch_add(n, std::memory_order_relaxed); }
+    void sub(int64_t n) { value_.fetch_sub(n, std::memory_order_relaxed); }
+    int64_t value() const { return value_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<int64_t> value_{0};
+};
+
+// Power-of-two microsecond buckets: bucket i counts samples below 2^i us.
+class Histogram {
+public:
+    static constexpr size_t BUCKETS = 32;
+
+    void record(std::chrono::nanoseconds elapsed);
+    uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+    uint64_t sumMicros() const { return sum_us_.load(std::memory_order_relaxed); }
+    uint64_t bucket(size_t i) const { return buckets_[i].load(std::memory_order_relaxed); }
+    // Upper bound of the bucket holding quantile q (0..1), in microseconds.
+    uint64_t quantileMicros(double q) const;
+
+private:
+    std::array<std::atomic<uint64_t>, BUCKETS> buckets_{};
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> sum_us_{0};
+};
+
+class Registry {
+public:
+    static Registry& instance();
+
+    // Returns the metric registered under name, creating it on first use.
+    // References stay valid for the lifetime of the process.
+    Counter& counter(const std::string& name, const std::string& help = {});
+    Gauge& gauge(const std::string& name, const std::string& help = {});
+    Histogram& histogram(const std::string& name, const std::string& help = {});
+
+    // Prometheus text exposition format.
+    std::string renderText() const;
+    // One line per metric, for periodic logging.
+    std::string renderSummary() const;
+
+private:
+    template <typename T>
+    struct Entry {
+        std::string help;
+        std::unique_ptr<T> metric;
+    };
+
+    mutable std::mutex mutex_;
+    std::map<std::string, Entry<Counter>> counters_;
+    std::map<std::string, Entry<Gauge>> gauges_;
+    std::map<std::string, Entry<Histogram>> histograms_;
+};
+
+inline Counter& counter(const std::string& name, const std::string& help = {}) {
+    return Registry::instance().counter(name, help);
+}
+
+inline Gauge& gauge(const std::string& name, const std::string& help = {}) {
+    return Registry::instance().gauge(name, help);
+}
+
+inline Histogram& histogram(const std::string& name, const std::string& help = {}) {
+    return Registry::instance().histogram(name, help);
+}
+
+}
+
+#endif // TCP_MQTT_BRIDGE_METRICS_HPP
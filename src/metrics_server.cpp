@@ -0,0 +1,72 @@
+#include "metrics_server.hpp"
+#include "metrics.hpp"
+
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+
+namespace {
+
+constexpr size_t MAX_REQUEST_SIZE = 8192;
+
+}
+
+MetricsServer::MetricsServer(boost::asio::io_context& io_context, const boost::asio::ip::address& addr, unsigned short port)
+    : acceptor_(io_context, boost::asio::ip::tcp::endpoint(addr, port))
+{
+    addRoute("/metrics", [] { return metrics::Registry::instance().renderText(); });
+    do_accept();
+}
+
+void MetricsServer::stop() {
+    boost::system::error_code ec;
+    acceptor_.close(ec);
+}
+
+void MetricsServer::do_accept() {
+    acceptor_.async_accept([this](boost::system::error_code ec, boost::asio::ip::tcp::socket socket) {
+        if (ec == boost::asio::error::operation_aborted) return;
+        if (!ec) {
+            serve(std::make_shared<boost::asio::ip::tcp::socket>(std::move(socket)));
+        }
+        do_accept();
+    });
+}
+
+void MetricsServer::serve(std::shared_ptr<boost::asio::ip::tcp::socket> socket) {
+    auto request = std::make_shared<boost::asio::streambuf>(MAX_REQUEST_SIZE);
+    boost::asio::async_read_until(*socket, *request, "\r\n\r\n",
+        [this, socket, request](boost::system::error_code ec, std::size_t) {
+            if (ec) return;
+            std::istream stream(request.get());
+            std::string request_line;
+            std::getline(stream, request_line);
+            auto response = std::make_shared<std::string>(respond(request_line));
+            boost::asio::async_write(*socket, boost::asio::buffer(*response),
+                [socket, response](boost::system::error_code, std::size_t) {
+                    boost::system::error_code ignored;
+                    socket->shutdown(boost::asio::ip::tcp::socket::shutdown_both, ignored);
+                });
+        });
+}
+
+std::string MetricsServer::respond(const std::string& request_line) const {
+    // "GET /metrics HTTP/1.1": only the method and path matter.
+    auto method_end = request_line.find(' ');
+    auto path_end = request_line.find_first_of(" ?", method_end + 1);
+    std::string method = request_line.substr(0, method_end);
+    std::string path = method_end == std::string::npos ? "" : request_line.substr(method_end + 1, path_end - method_end - 1);
+
+    auto reply = [](const char* status, const std::string& body) {
+        return fmt::format("HTTP/1.0 {}\r\nContent-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+                           "Content-Length: {}\r\nConnection: close\r\n\r\n{}", status, body.size(), body);
+    };
+    if (method != "GET") return reply("405 Method Not Allowed", "");
+    auto it = routes_.find(path);
+    if (it == routes_.end()) return reply("404 Not Found", "");
+    try {
+        return reply("200 OK", it->second());
+    } catch (const std::exception& e) {
+        spdlog::error("Metrics handler for {} failed: {}", path, e.what());
+        return reply("500 Internal Server Error", "");
+    }
+}
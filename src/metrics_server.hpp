@@ -0,0 +1,33 @@
+#ifndef TCP_MQTT_BRIDGE_METRICS_SERVER_HPP
+#define TCP_MQTT_BRIDGE_METRICS_SERVER_HPP
+
+#include <boost/asio.hpp>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+
+// Minimal HTTP/1.0 endpoint for scrapers: serves the metrics registry at
+// /metrics plus any extra plain-text routes. One request per connection.
+class MetricsServer {
+public:
+    using Handler = std::function<std::string()>;
+
+    MetricsServer(boost::asio::io_context& io_context, const boost::asio::ip::address& addr, unsigned short port);
+
+    MetricsServer(const MetricsServer&) = delete;
+    MetricsServer& operator=(const MetricsServer&) = delete;
+
+    void addRoute(const std::string& path, Handler handler) { routes_[path] = std::move(handler); }
+    void stop();
+
+private:
+    void do_accept();
+    void serve(std::shared_ptr<boost::asio::ip::tcp::socket> socket);
+    std::string respond(const std::string& request_line) const;
+
+    boost::asio::ip::tcp::acceptor acceptor_;
+    std::map<std::string, Handler> routes_;
+};
+
+#endif // TCP_MQTT_BRIDGE_METRICS_SERVER_HPP
@@ -0,0 +1,74 @@
+#include "mirrored_ring.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace {
+
+[[noreturn]] void fail(const char* what) {
+    throw std::system_error(errno, std::generic_category(), what);
+}
+
+size_t round_to_pages(size_t capacity) {
+    auto page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+    return (std::max<size_t>(capacity, 1) + page - 1) / page * page;
+}
+
+}
+
+MirroredRing::MirroredRing(size_t capacity)
+    : capacity_(round_to_pages(capacity))
+{
+    int fd = ::memfd_create("bridge-ring", MFD_CLOEXEC);
+    if (fd < 0) fail("memfd_create");
+    if (::ftruncate(fd, static_cast<off_t>(capacity_)) != 0) {
+        ::close(fd);
+        fail("ftruncate");
+    }
+    // Reserve both halves first so the second mapping cannot land on
+    // something else, then map the same pages into each.
+    void* reserved = ::mmap(nullptr, 2 * capacity_, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (reserved == MAP_FAILED) {
+        ::close(fd);
+        fail("mmap");
+    }
+    base_ = static_cast<uint8_t*>(reserved);
+    for (size_t half = 0; half < 2; ++half) {
+        void* mapped = ::mmap(base_ + half * capacity_, capacity_, PROT_READ | PROT_WRITE,
+                              MAP_SHARED | MAP_FIXED, fd, 0);
+        if (mapped == MAP_FAILED) {
+            int error = errno;
+            ::munmap(base_, 2 * capacity_);
+            ::close(fd);
+            errno = error;
+            fail("mmap");
+        }
+    }
+    ::close(fd);
+}
+
+MirroredRing::~MirroredRing() {
+    ::munmap(base_, 2 * capacity_);
+}
+
+void MirroredRing::write(std::span<const uint8_t> bytes) {
+    assert(bytes.size() <= space());
+    size_t tail = head_ + size_;
+    if (tail >= capacity_) tail -= capacity_;
+    // The mirror takes whatever runs past the end of the first half.
+    std::memcpy(base_ + tail, bytes.data(), bytes.size());
+    size_ += bytes.size();
+}
+
+void MirroredRing::consume(size_t n) {
+    assert(n <= size_);
+    head_ += n;
+    if (head_ >= capacity_) head_ -= capacity_;
+    size_ -= n;
+}
@@ -0,0 +1,39 @@
+#ifndef TCP_MQTT_BRIDGE_MIRRORED_RING_HPP
+#define TCP_MQTT_BRIDGE_MIRRORED_RING_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+// Byte ring whose pages are mapped twice, back to back, so the buffered
+// bytes are always one contiguous span even when they wrap around the end.
+// Readers parse in place instead of stitching the two halves together.
+// The capacity is rounded up to a whole number of pages.
+class MirroredRing {
+public:
+    explicit MirroredRing(size_t capacity);
+    ~MirroredRing();
+
+    MirroredRing(const MirroredRing&) = delete;
+    MirroredRing& operator=(const MirroredRing&) = delete;
+
+    size_t capacity() const { return capacity_; }
+    size_t size() const { return size_; }
+    size_t space() const { return capacity_ - size_; }
+
+    // The buffered bytes, oldest first; valid until the next write or consume.
+    std::span<const uint8_t> data() const { return {base_ + head_, size_}; }
+
+    // Appends all of bytes, which must fit in space().
+    void write(std::span<const uint8_t> bytes);
+    void consume(size_t n);
+    void clear() { head_ = 0; size_ = 0; }
+
+private:
+    uint8_t* base_ = nullptr;
+    size_t capacity_;
+    size_t head_ = 0;       // offset of the oldest byte, below capacity_
+    size_t size_ = 0;
+};
+
+#endif // TCP_MQTT_BRIDGE_MIRRORED_RING_HPP
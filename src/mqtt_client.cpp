@@ -1,14 +1,74 @@
 #include "mqtt_client.hpp"
+#include "metrics.hpp"
+#include "handler_memory.hpp"
+#include "trace.hpp"
+#include "tls.hpp"
 
 #include <spdlog/spdlog.h>
+#include <algorithm>
+#include <utility>
 #include <boost/asio/ip/tcp.hpp>
 #include <boost/asio/strand.hpp>
 
+// Customization points boost::mqtt5 uses for TLS streams: the bridge is the
+// client side of the handshake, and each new connection gets SNI, host name
+// verification and the last session for resumption.
+namespace boost::mqtt5 {
+
+template <typename StreamBase>
+struct tls_handshake_type<boost::asio::ssl::stream<StreamBase>> {
+    static constexpr auto client = boost::asio::ssl::stream_base::client;
+};
+
+template <typename StreamBase>
+void assign_tls_sni(const authority_path& ap, boost::asio::ssl::context&, boost::asio::ssl::stream<StreamBase>& stream) {
+    tls::prepare_client(stream.native_handle(), ap.host);
+}
+
+}
+
+namespace {
+
+// Weight of the newest sample in the smoothed publish latency.
+constexpr double LATENCY_SMOOTHING = 0.2;
+
+struct LaneMetrics {
+    metrics::Gauge& queued;
+    metrics::Counter& dropped;
+    metrics::Counter& shed;
+    metrics::Counter& coalesced;
+    metrics::Histogram& latency;
+};
+
+const LaneMetrics& lane_metrics_for(size_t lane) {
+    auto make = [](Priority priority) {
+        std::string prefix = fmt::format("mqtt_lane_{}_", priority_name(priority));
+        return LaneMetrics{
+            metrics::gauge(prefix + "queued", "Publishes waiting for an in-flight slot"),
+            metrics::counter(prefix + "dropped_total", "Publishes rejected because the lane was full"),
+            metrics::counter(prefix + "shed_total", "QoS 0 publishes dropped by the overload controller"),
+            metrics::counter(prefix + "coalesced_total", "Queued QoS 0 publishes replaced by a newer value for the topic"),
+            metrics::histogram(prefix + "latency_us", "Time from publish request to broker completion")
+        };
+    };
+    static const std::array<LaneMetrics, PRIORITY_LANES> lanes = {
+        make(Priority::High), make(Priority::Normal), make(Priority::Low)
+    };
+    return lanes[lane];
+}
+
+}
+
 MqttClient::MqttClient(boost::asio::io_context& ioc, const Configuration::MqttConfig& config)
-    : config_(config)
-    , client_(ioc, {} /* tls_context */, boost::mqtt5::logger(boost::mqtt5::log_level::error))
+    : ioc_(ioc)
+    , config_(config)
+    , client_(make_connection(ioc))
 {
-    setup_client();
+    for (size_t lane = 0; lane < PRIORITY_LANES; ++lane) {
+        if (config_.lanes[lane].dedicated_connection) {
+            lane_clients_[lane] = make_connection(ioc);
+        }
+    }
 }
 
 MqttClient::~MqttClient()
@@ -16,80 +76,360 @@ MqttClient::~MqttClient()
     stop();
 }
 
-void MqttClient::setup_client()
+MqttClient::Connection MqttClient::make_connection(boost::asio::io_context& ioc)
 {
-    client_.brokers(config_.host, config_.port);
+    if (config_.tls.enabled) {
+        // Each connection gets its own context, so each remembers its own session.
+        auto client = std::make_unique<tls_client_t>(ioc, tls::make_client_context(config_.tls),
+                                                     boost::mqtt5::logger(boost::mqtt5::log_level::error));
+        client->brokers(config_.host, config_.port);
+        return client;
+    }
+    auto client = std::make_unique<tcp_client_t>(ioc, std::monostate{}, boost::mqtt5::logger(boost::mqtt5::log_level::error));
+    client->brokers(config_.host, config_.port);
+    return client;
 }
 
 void MqttClient::connect()
 {
-    spdlog::info("Connecting to MQTT broker at {}:{}", config_.host, config_.port);
-    client_.async_run(
-        [this](boost::system::error_code ec) {
-            if (ec) {
-                spdlog::error("Failed to connect to MQTT broker: {}", ec.message());
-                handle_error(ec);
-            } else {
-                spdlog::info("Connected to MQTT broker at {}:{}", config_.host, config_.port);
+    spdlog::info("Connecting to MQTT broker at {}:{}{}", config_.host, config_.port, config_.tls.enabled ? " (TLS)" : "");
+    visit(client_, [this](auto& client) {
+        client.async_run(
+            [this](boost::system::error_code ec) {
+                if (ec) {
+                    spdlog::error("Failed to connect to MQTT broker: {}", ec.message());
+                    handle_error(ec);
+                } else {
+                    spdlog::info("Connected to MQTT broker at {}:{}", config_.host, config_.port);
+                }
             }
-        }
-    );
+        );
+    });
+    for (size_t lane = 0; lane < PRIORITY_LANES; ++lane) {
+        if (!exists(lane_clients_[lane])) continue;
+        visit(lane_clients_[lane], [lane](auto& client) {
+            client.async_run([lane](boost::system::error_code ec) {
+                if (ec) {
+                    spdlog::error("MQTT {} lane connection ended: {}", priority_name(static_cast<Priority>(lane)), ec.message());
+                }
+            });
+        });
+    }
+    if (message_handler_) {
+        receive_loop();
+    }
 }
 
-void MqttClient::publish(const std::string& topic, const std::string& payload, PublishCallback callback, uint8_t qos, bool retain)
+void MqttClient::subscribe(const std::vector<std::string>& topics, uint8_t qos)
 {
-    auto retain_flag = retain ? boost::mqtt5::retain_e::yes : boost::mqtt5::retain_e::no;
-    boost::mqtt5::publish_props props;
-
-    switch (qos) {
-        case 0:
-            client_.async_publish<boost::mqtt5::qos_e::at_most_once>(
-                topic, payload,
-                retain_flag, props,
-                [this, callback = std::move(callback)](boost::system::error_code ec) {
-                    handle_error(ec);
-                    callback(ec);
+    std::vector<boost::mqtt5::subscribe_topic> subscriptions;
+    for (const auto& topic : topics) {
+        boost::mqtt5::subscribe_topic sub;
+        sub.topic_filter = topic;
+        sub.sub_opts.max_qos = static_cast<boost::mqtt5::qos_e>(std::min<uint8_t>(qos, 2));
+        subscriptions.push_back(std::move(sub));
+    }
+    visit(client_, [&subscriptions, &topics](auto& client) {
+        client.async_subscribe(
+            subscriptions, boost::mqtt5::subscribe_props{},
+            [topics](boost::system::error_code ec, std::vector<boost::mqtt5::reason_code> codes, boost::mqtt5::suback_props) {
+                if (ec) {
+                    spdlog::error("Failed to subscribe to {} topics: {}", topics.size(), ec.message());
+                    return;
                 }
-            );
-            break;
-        case 1:
-            client_.async_publish<boost::mqtt5::qos_e::at_least_once>(
-                topic, payload,
-                retain_flag, props,
-                [this, callback = std::move(callback)](boost::system::error_code ec, boost::mqtt5::reason_code rc, boost::mqtt5::puback_props) {
-                    handle_error(ec);
-                    callback(ec);
+                for (size_t i = 0; i < codes.size() && i < topics.size(); ++i) {
+                    if (codes[i]) {
+                        spdlog::error("Subscription to {} rejected: {}", topics[i], codes[i].message());
+                    } else {
+                        spdlog::info("Subscribed to {}", topics[i]);
+                    }
                 }
-            );
-            break;
-        case 2:
-            client_.async_publish<boost::mqtt5::qos_e::exactly_once>(
-                topic, payload,
-                retain_flag, props,
-                [this, callback = std::move(callback)](boost::system::error_code ec, boost::mqtt5::reason_code rc, boost::mqtt5::pubcomp_props) {
-                    handle_error(ec);
-                    callback(ec);
+            }
+        );
+    });
+}
+
+void MqttClient::receive_loop()
+{
+    visit(client_, [this](auto& client) {
+        client.async_receive(
+            [this](boost::system::error_code ec, std::string topic, std::string payload, boost::mqtt5::publish_props) {
+                if (ec == boost::asio::error::operation_aborted) {
+                    return;
+                }
+                if (ec) {
+                    spdlog::warn("MQTT receive error: {}", ec.message());
+                } else {
+                    message_handler_(topic, payload);
                 }
-            );
-            break;
-        default:
-            spdlog::error("Invalid QoS value: {}. Must be 0, 1, or 2.", qos);
-            callback(boost::asio::error::invalid_argument);
-            break;
+                receive_loop();
+            }
+        );
+    });
+}
+
+void MqttClient::startPublish(const std::string& topic, const std::string& payload, PublishCallback callback, uint8_t qos, bool retain,
+                              const std::string& content_type, Priority priority, uint64_t trace_id)
+{
+    const auto lane = static_cast<size_t>(priority);
+    const auto& lane_metrics = lane_metrics_for(lane);
+    const bool overload = config_.overload.enabled();
+
+    if (overload) {
+        update_overload();
+        if (shed_eligible(lane, qos) && config_.overload.mode == Configuration::OverloadConfig::Mode::Shed) {
+            lane_metrics.shed.inc();
+            spdlog::debug("MQTT overloaded, shedding {} publish to {}", priority_name(priority), topic);
+            post_completion(std::move(callback), boost::asio::error::try_again);
+            return;
+        }
+    }
+
+    if (exists(lane_clients_[lane])) {
+        send(lane_clients_[lane], topic, payload, with_latency(std::move(callback), lane), qos, retain, content_type, trace_id);
+        return;
+    }
+
+    // Send right away only if nothing of equal or higher priority is waiting,
+    // so queued messages keep their order.
+    bool waiting = std::any_of(lanes_.begin(), lanes_.begin() + lane + 1, [](const auto& q) { return !q.empty(); });
+    if (!waiting && (config_.max_inflight == 0 || inflight_ < config_.max_inflight)) {
+        ++inflight_;
+        send(client_, topic, payload, handler_memory::bind([this, timed = with_latency(std::move(callback), lane)](boost::system::error_code ec) mutable {
+            --inflight_;
+            std::move(timed)(ec);
+            drain();
+        }), qos, retain, content_type, trace_id);
+        return;
+    }
+
+    if (overload && shed_eligible(lane, qos) && coalesce(lane, topic, payload, callback, retain, content_type, trace_id)) {
+        lane_metrics.coalesced.inc();
+        return;
+    }
+
+    const auto& lane_config = config_.lanes[lane];
+    if (lane_config.max_queued > 0 && lanes_[lane].size() >= lane_config.max_queued) {
+        lane_metrics.dropped.inc();
+        spdlog::debug("MQTT {} lane full, rejecting publish to {}", priority_name(priority), topic);
+        post_completion(std::move(callback), boost::asio::error::no_buffer_space);
+        return;
+    }
+    lanes_[lane].push_back(PendingPublish{topic, payload, content_type, with_latency(std::move(callback), lane), qos, retain, trace_id});
+    ++queued_;
+    pending_bytes_ += publish_bytes(topic, payload, content_type);
+    lane_metrics.queued.add(1);
+    if (qos == 0 && overload && config_.overload.mode == Configuration::OverloadConfig::Mode::Latest) {
+        latest_[lane][topic] = &lanes_[lane].back();
     }
 }
 
+bool MqttClient::coalesce(size_t lane, const std::string& topic, const std::string& payload, PublishCallback& callback,
+                          bool retain, const std::string& content_type, uint64_t trace_id)
+{
+    auto it = latest_[lane].find(topic);
+    if (it == latest_[lane].end()) return false;
+
+    // The queued publish keeps its place in the lane but carries the new
+    // value; the frame that produced the old one is NAKed.
+    PendingPublish& pending = *it->second;
+    auto superseded = std::exchange(pending.callback, with_latency(std::move(callback), lane));
+    pending_bytes_ += publish_bytes(topic, payload, content_type);
+    pending_bytes_ -= publish_bytes(topic, pending.payload, pending.content_type);
+    pending.payload = payload;
+    pending.content_type = content_type;
+    pending.retain = retain;
+    pending.trace_id = trace_id;
+    spdlog::debug("MQTT overloaded, replacing queued publish to {} with a newer value", topic);
+    post_completion(std::move(superseded), boost::asio::error::try_again);
+    return true;
+}
+
+MqttClient::PublishCallback MqttClient::with_latency(PublishCallback callback, size_t lane)
+{
+    const auto& lane_metrics = lane_metrics_for(lane);
+    auto queued_at = std::chrono::steady_clock::now();
+    return handler_memory::bind(
+        [this, &lane_metrics, queued_at, callback = std::move(callback)](boost::system::error_code ec) mutable {
+            auto latency = std::chrono::steady_clock::now() - queued_at;
+            lane_metrics.latency.record(latency);
+            if (!ec) observe_latency(latency);
+            std::move(callback)(ec);
+        });
+}
+
+void MqttClient::post_completion(PublishCallback callback, boost::system::error_code ec)
+{
+    // Bound to the handler's allocator, so the posted operation comes from
+    // the same free lists as the publish.
+    auto allocator = boost::asio::get_associated_allocator(callback);
+    boost::asio::post(ioc_, boost::asio::bind_allocator(allocator,
+        [callback = std::move(callback), ec]() mutable { std::move(callback)(ec); }));
+}
+
+bool MqttClient::shed_eligible(size_t lane, uint8_t qos) const
+{
+    return qos == 0 && overload_level_ > 0 && lane >= PRIORITY_LANES - overload_level_;
+}
+
+void MqttClient::observe_latency(std::chrono::steady_clock::duration latency)
+{
+    if (!config_.overload.enabled()) return;
+    double ms = std::chrono::duration<double, std::milli>(latency).count();
+    latency_ewma_ms_ = latency_ewma_ms_ == 0 ? ms : latency_ewma_ms_ + LATENCY_SMOOTHING * (ms - latency_ewma_ms_);
+    update_overload();
+}
+
+void MqttClient::update_overload()
+{
+    static auto& level_gauge = metrics::gauge("mqtt_overload_level", "Priority lanes whose QoS 0 publishes are being shed");
+    static auto& raised = metrics::counter("mqtt_overload_raised_total", "Times the overload controller shed another lane");
+    static auto& lowered = metrics::counter("mqtt_overload_lowered_total", "Times the overload controller stopped shedding a lane");
+    const auto& config = config_.overload;
+
+    // Nothing queued or in flight means nothing is behind, whatever the
+    // last completions took.
+    if (queued_ == 0 && inflight_ == 0) {
+        latency_ewma_ms_ = 0;
+    }
+    double load = 0;
+    if (config.latency_ms > 0) {
+        load = latency_ewma_ms_ / config.latency_ms;
+    }
+    if (config.queue_depth > 0) {
+        load = std::max(load, static_cast<double>(queued_) / static_cast<double>(config.queue_depth));
+    }
+
+    // The high lane is never shed. Levels go up as soon as the load reaches
+    // them and come down one at a time once it drops below recover_ratio of
+    // the current level, so the controller does not flap around a threshold.
+    constexpr size_t max_level = PRIORITY_LANES - 1;
+    size_t level = overload_level_;
+    if (level < max_level && load >= static_cast<double>(level + 1)) {
+        level = std::min(max_level, static_cast<size_t>(load));
+    } else if (level > 0 && load < static_cast<double>(level) * config.recover_ratio) {
+        --level;
+    }
+    if (level == overload_level_) return;
+
+    if (level > overload_level_) {
+        raised.inc();
+        spdlog::warn("MQTT publishing overloaded ({:.0f} ms latency, {} queued), shedding QoS 0 from {} lane(s)",
+                     latency_ewma_ms_, queued_, level);
+    } else {
+        lowered.inc();
+        if (level == 0) {
+            spdlog::info("MQTT publishing recovered ({:.0f} ms latency, {} queued)", latency_ewma_ms_, queued_);
+        } else {
+            spdlog::info("MQTT overload easing, shedding QoS 0 from {} lane(s)", level);
+        }
+    }
+    overload_level_ = level;
+    level_gauge.set(static_cast<int64_t>(level));
+}
+
+void MqttClient::drain()
+{
+    while (config_.max_inflight == 0 || inflight_ < config_.max_inflight) {
+        auto lane = std::find_if(lanes_.begin(), lanes_.end(), [](const auto& q) { return !q.empty(); });
+        if (lane == lanes_.end()) return;
+        auto index = static_cast<size_t>(lane - lanes_.begin());
+        if (lane->front().qos == 0) {
+            auto it = latest_[index].find(lane->front().topic);
+            if (it != latest_[index].end() && it->second == &lane->front()) latest_[index].erase(it);
+        }
+        auto pending = std::move(lane->front());
+        lane->pop_front();
+        --queued_;
+        pending_bytes_ -= publish_bytes(pending.topic, pending.payload, pending.content_type);
+        lane_metrics_for(index).queued.sub(1);
+        ++inflight_;
+        send(client_, pending.topic, pending.payload,
+            handler_memory::bind([this, callback = std::move(pending.callback)](boost::system::error_code ec) mutable {
+                --inflight_;
+                std::move(callback)(ec);
+                drain();
+            }), pending.qos, pending.retain, pending.content_type, pending.trace_id);
+    }
+}
+
+void MqttClient::send(Connection& connection, const std::string& topic, const std::string& payload, PublishCallback callback,
+                      uint8_t qos, bool retain, const std::string& content_type, uint64_t trace_id)
+{
+    trace::record(trace_id, trace::Stage::PublishIssued);
+    const size_t bytes = publish_bytes(topic, payload, content_type);
+    pending_bytes_ += bytes;
+    auto retain_flag = retain ? boost::mqtt5::retain_e::yes : boost::mqtt5::retain_e::no;
+    boost::mqtt5::publish_props props;
+    if (!content_type.empty()) {
+        props[boost::mqtt5::prop::content_type] = content_type;
+    }
+
+    visit(connection, [&](auto& client) {
+        switch (qos) {
+            case 0:
+                client.template async_publish<boost::mqtt5::qos_e::at_most_once>(
+                    topic, payload,
+                    retain_flag, props,
+                    handler_memory::bind([this, bytes, trace_id, callback = std::move(callback)](boost::system::error_code ec) mutable {
+                        finish_publish(callback, bytes, trace_id, ec);
+                    })
+                );
+                break;
+            case 1:
+                client.template async_publish<boost::mqtt5::qos_e::at_least_once>(
+                    topic, payload,
+                    retain_flag, props,
+                    handler_memory::bind([this, bytes, trace_id, callback = std::move(callback)](
+                            boost::system::error_code ec, boost::mqtt5::reason_code rc, boost::mqtt5::puback_props) mutable {
+                        finish_publish(callback, bytes, trace_id, ec);
+                    })
+                );
+                break;
+            case 2:
+                client.template async_publish<boost::mqtt5::qos_e::exactly_once>(
+                    topic, payload,
+                    retain_flag, props,
+                    handler_memory::bind([this, bytes, trace_id, callback = std::move(callback)](
+                            boost::system::error_code ec, boost::mqtt5::reason_code rc, boost::mqtt5::pubcomp_props) mutable {
+                        finish_publish(callback, bytes, trace_id, ec);
+                    })
+                );
+                break;
+            default:
+                spdlog::error("Invalid QoS value: {}. Must be 0, 1, or 2.", qos);
+                pending_bytes_ -= bytes;
+                callback(boost::asio::error::invalid_argument);
+                break;
+        }
+    });
+}
+
 void MqttClient::stop() {
-    client_.async_disconnect(
-        [this](boost::system::error_code ec) {
-            if (ec) {
-                spdlog::error("Error during MQTT client disconnect: {}", ec.message());
-            } else {
-                spdlog::info("MQTT client disconnected successfully.");
+    for (auto& lane_client : lane_clients_) {
+        if (!exists(lane_client)) continue;
+        visit(lane_client, [](auto& client) { client.async_disconnect([](boost::system::error_code) {}); });
+    }
+    visit(client_, [this](auto& client) {
+        client.async_disconnect(
+            [this](boost::system::error_code ec) {
+                if (ec) {
+                    spdlog::error("Error during MQTT client disconnect: {}", ec.message());
+                } else {
+                    spdlog::info("MQTT client disconnected successfully.");
+                }
+                handle_close();
             }
-            handle_close();
-        }
-    );
+        );
+    });
+}
+
+void MqttClient::finish_publish(PublishCallback& callback, size_t bytes, uint64_t trace_id, boost::system::error_code ec)
+{
+    handle_error(ec);
+    pending_bytes_ -= bytes;
+    trace::record(trace_id, trace::Stage::PublishAcked);
+    std::move(callback)(ec);
 }
 
 void MqttClient::handle_error(boost::system::error_code const& ec)
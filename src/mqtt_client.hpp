@@ -2,37 +2,144 @@
 #define TCP_MQTT_BRIDGE_MQTT_CLIENT_HPP
 
 #include "config.hpp"
+#include "packet_parser.hpp"
 
 #include <boost/asio.hpp>
+#include <boost/asio/any_completion_handler.hpp>
+#include <boost/asio/ssl.hpp>
 #include <boost/mqtt5.hpp>
+#include <array>
+#include <chrono>
+#include <deque>
+#include <memory>
 #include <string>
+#include <unordered_map>
+#include <variant>
+#include <vector>
 
+// Publishes go out through one of PRIORITY_LANES lanes. At most max_inflight
+// publishes are outstanding on the shared connection; the rest wait in their
+// lane and the highest non-empty lane is drained first as slots free up. A
+// lane that is full fails new publishes with no_buffer_space. A lane with a
+// dedicated connection bypasses the shared queue entirely.
+//
+// With mqtt.overload configured, an overload controller watches smoothed
+// completion latency and queue depth. While overloaded it fails QoS 0
+// publishes from the lowest lanes with try_again (so the frame is NAKed and
+// the device backs off), or in Latest mode replaces a queued QoS 0 publish to
+// the same topic with the newer value.
+//
+// With mqtt.tls enabled every broker connection runs over TLS and resumes
+// the previous session when it reconnects.
 class MqttClient {
 public:
     explicit MqttClient(boost::asio::io_context& ioc, const Configuration::MqttConfig& config);
     ~MqttClient();
 
     void connect();
-    using PublishCallback = std::function<void(boost::system::error_code)>;
-    void publish(const std::string& topic, const std::string& payload, PublishCallback callback, uint8_t qos = 1, bool retain = false);
+    using PublishCallback = boost::asio::any_completion_handler<void(boost::system::error_code)>;
+
+    // Completes with the broker's acknowledgement, or with try_again or
+    // no_buffer_space when the publish is shed or its lane is full, never
+    // inside the call itself. Takes
+    // any completion token; a handler is stored as a PublishCallback in
+    // memory from its associated allocator, so handlers bound with
+    // handler_memory::bind() publish without heap allocations.
+    template <typename CompletionToken>
+    auto publish(const std::string& topic, const std::string& payload, CompletionToken&& token, uint8_t qos = 1, bool retain = false,
+                 const std::string& content_type = {}, Priority priority = Priority::Normal, uint64_t trace_id = 0) {
+        return boost::asio::async_initiate<CompletionToken, void(boost::system::error_code)>(
+            [this](auto handler, const std::string& topic, const std::string& payload, uint8_t qos, bool retain,
+                   const std::string& content_type, Priority priority, uint64_t trace_id) {
+                startPublish(topic, payload, PublishCallback(std::move(handler)), qos, retain, content_type, priority, trace_id);
+            }, token, topic, payload, qos, retain, content_type, priority, trace_id);
+    }
+
+    using MessageHandler = std::function<void(const std::string& topic, const std::string& payload)>;
+    // Must be set before connect(); receives every message from subscriptions.
+    void setMessageHandler(MessageHandler handler) { message_handler_ = std::move(handler); }
+    void subscribe(const std::vector<std::string>& topics, uint8_t qos = 1);
 
     void stop();
 
     const Configuration::MqttConfig& getConfig() const { return config_; }
 
+    // Approximate bytes held by queued and in-flight publishes: topic,
+    // payload and content type copies plus the bookkeeping per publish.
+    size_t pendingBytes() const { return pending_bytes_; }
+
 private:
-    void setup_client();
+    using tcp_client_t = boost::mqtt5::mqtt_client<
+            boost::asio::ip::tcp::socket,
+            std::monostate,
+            boost::mqtt5::logger>;
+    using tls_client_t = boost::mqtt5::mqtt_client<
+            boost::asio::ssl::stream<boost::asio::ip::tcp::socket>,
+            boost::asio::ssl::context,
+            boost::mqtt5::logger>;
+    // One broker connection, plaintext or TLS; empty for lanes without one.
+    using Connection = std::variant<std::unique_ptr<tcp_client_t>, std::unique_ptr<tls_client_t>>;
+
+    template <typename F>
+    static void visit(Connection& connection, F&& f) {
+        std::visit([&f](auto& client) { f(*client); }, connection);
+    }
+    static bool exists(const Connection& connection) {
+        return std::visit([](const auto& client) { return client != nullptr; }, connection);
+    }
+
+    struct PendingPublish {
+        std::string topic;
+        std::string payload;
+        std::string content_type;
+        PublishCallback callback;
+        uint8_t qos;
+        bool retain;
+        uint64_t trace_id;
+    };
+
+    static size_t publish_bytes(const std::string& topic, const std::string& payload, const std::string& content_type) {
+        return sizeof(PendingPublish) + topic.size() + payload.size() + content_type.size();
+    }
+
+    void startPublish(const std::string& topic, const std::string& payload, PublishCallback callback, uint8_t qos, bool retain,
+                      const std::string& content_type, Priority priority, uint64_t trace_id);
+    Connection make_connection(boost::asio::io_context& ioc);
+    void send(Connection& connection, const std::string& topic, const std::string& payload, PublishCallback callback,
+              uint8_t qos, bool retain, const std::string& content_type, uint64_t trace_id);
+    void drain();
+    // Records a completed publish and re-evaluates the overload level.
+    void observe_latency(std::chrono::steady_clock::duration latency);
+    void update_overload();
+    bool shed_eligible(size_t lane, uint8_t qos) const;
+    bool coalesce(size_t lane, const std::string& topic, const std::string& payload, PublishCallback& callback,
+                  bool retain, const std::string& content_type, uint64_t trace_id);
+    // Wraps callback to record the lane latency from now until it completes.
+    PublishCallback with_latency(PublishCallback callback, size_t lane);
+    // Completes a publish from the io_context rather than inside the call
+    // that started it.
+    void post_completion(PublishCallback callback, boost::system::error_code ec);
+    // Settles a publish the broker (or the client) has answered.
+    void finish_publish(PublishCallback& callback, size_t bytes, uint64_t trace_id, boost::system::error_code ec);
     void handle_close();
     void handle_error(boost::system::error_code const& ec);
+    void receive_loop();
 
+    boost::asio::io_context& ioc_;
     const Configuration::MqttConfig& config_;
 
-    using client_t =  boost::mqtt5::mqtt_client<
-            boost::asio::ip::tcp::socket,
-            std::monostate,
-            boost::mqtt5::logger>;
-
-    client_t client_;
+    Connection client_;
+    std::array<Connection, PRIORITY_LANES> lane_clients_;  // empty: lane uses client_
+    std::array<std::deque<PendingPublish>, PRIORITY_LANES> lanes_;
+    // Newest queued QoS 0 publish per topic, for overload Latest mode.
+    // Deque elements stay put when the ends change, so the pointers hold.
+    std::array<std::unordered_map<std::string, PendingPublish*>, PRIORITY_LANES> latest_;
+    size_t queued_{0};
+    size_t inflight_{0};
+    size_t pending_bytes_{0};
+    double latency_ewma_ms_{0};
+    size_t overload_level_{0};      // number of lanes shed, from the lowest up
+    MessageHandler message_handler_;
 };
 
 #endif // TCP_MQTT_BRIDGE_MQTT_CLIENT_HPP
@@ -0,0 +1,338 @@
+#include "packet_db_cache.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace packet_db_cache {
+
+namespace {
+
+constexpr char MAGIC[8] = {'P', 'K', 'T', 'D', 'B', 'C', 'A', 'C'};
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t packet_count;
+    uint64_t key;
+    uint64_t payload_size;
+};
+
+class Writer {
+public:
+    template <typename T>
+    void put(T v) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        const auto* p = reinterpret_cast<const char*>(&v);
+        out_.append(p, sizeof(T));
+    }
+    void put(const std::string& s) {
+        put<uint32_t>(static_cast<uint32_t>(s.size()));
+        out_.append(s);
+    }
+    void put(const FieldValue& value) {
+        put<uint8_t>(static_cast<uint8_t>(value.value().index()));
+        std::visit([this](const auto& v) {
+            using T = std::decay_t<decltype(v)>;
+            if constexpr (std::is_same_v<T, std::vector<uint8_t>>) {
+                put<uint32_t>(static_cast<uint32_t>(v.size()));
+                out_.append(reinterpret_cast<const char*>(v.data()), v.size());
+            } else if constexpr (std::is_same_v<T, NumericArray>) {
+                // Array fields cannot have a fixed value, so none are stored.
+                throw std::runtime_error("array values are not cached");
+            } else {
+                put<T>(v);
+            }
+        }, value.value());
+    }
+    std::string& data() { return out_; }
+
+private:
+    std::string out_;
+};
+
+class Reader {
+public:
+    explicit Reader(std::span<const uint8_t> data) : data_(data) {}
+
+    template <typename T>
+    T get() {
+        static_assert(std::is_trivially_copyable_v<T>);
+        need(sizeof(T));
+        T v;
+        std::memcpy(&v, data_.data() + pos_, sizeof(T));
+        pos_ += sizeof(T);
+        return v;
+    }
+    std::string getString() {
+        auto len = get<uint32_t>();
+        need(len);
+        std::string s(reinterpret_cast<const char*>(data_.data() + pos_), len);
+        pos_ += len;
+        return s;
+    }
+    FieldValue getValue() {
+        switch (get<uint8_t>()) {
+        case 0: return FieldValue(get<uint8_t>());
+        case 1: return FieldValue(get<uint16_t>());
+        case 2: return FieldValue(get<uint32_t>());
+        case 3: return FieldValue(get<uint64_t>());
+        case 4: return FieldValue(get<int8_t>());
+        case 5: return FieldValue(get<int16_t>());
+        case 6: return FieldValue(get<int32_t>());
+        case 7: return FieldValue(get<int64_t>());
+        case 8: return FieldValue(get<float>());
+        case 9: return FieldValue(get<double>());
+        case 10: {
+            auto len = get<uint32_t>();
+            need(len);
+            std::vector<uint8_t> v(data_.data() + pos_, data_.data() + pos_ + len);
+            pos_ += len;
+            return FieldValue(std::move(v));
+        }
+        }
+        throw std::runtime_error("bad value tag");
+    }
+    bool done() const { return pos_ == data_.size(); }
+
+private:
+    void need(size_t n) const {
+        if (data_.size() - pos_ < n) throw std::runtime_error("truncated cache");
+    }
+
+    std::span<const uint8_t> data_;
+    size_t pos_ = 0;
+};
+
+void write_packet(Writer& w, const PacketDesc& pkt) {
+    w.put(pkt.name);
+    w.put<uint64_t>(pkt.id_field_index);
+    w.put(pkt.id_value);
+
+    w.put(pkt.mqtt.topic);
+    w.put(pkt.mqtt.payload);
+    w.put<uint8_t>(pkt.mqtt.qos);
+    w.put<uint8_t>(pkt.mqtt.retain);
+    w.put<uint8_t>(static_cast<uint8_t>(pkt.mqtt.format));
+    w.put<uint8_t>(pkt.mqtt.batch.has_value());
+    if (pkt.mqtt.batch) {
+        w.put<uint8_t>(static_cast<uint8_t>(pkt.mqtt.batch->mode));
+        w.put<uint64_t>(pkt.mqtt.batch->max_batch);
+        w.put<uint32_t>(pkt.mqtt.batch->linger_ms);
+    }
+    w.put(pkt.device_id_field);
+    w.put<uint8_t>(pkt.downlink.has_value());
+    if (pkt.downlink) {
+        w.put(pkt.downlink->topic);
+        w.put<uint8_t>(pkt.downlink->qos);
+    }
+    w.put<uint8_t>(pkt.rate_limit.has_value());
+    if (pkt.rate_limit) {
+        w.put<double>(pkt.rate_limit->per_sec);
+        w.put<double>(pkt.rate_limit->burst);
+    }
+    w.put<uint8_t>(static_cast<uint8_t>(pkt.priority));
+    w.put<uint8_t>(pkt.output.mqtt);
+    w.put<uint8_t>(pkt.output.columnar);
+
+    w.put<uint32_t>(static_cast<uint32_t>(pkt.fields.size()));
+    for (const auto& f : pkt.fields) {
+        w.put(f.name);
+        w.put<uint8_t>(static_cast<uint8_t>(f.type));
+        w.put<uint64_t>(f.offset);
+        w.put<uint8_t>(f.bitfield.has_value());
+        if (f.bitfield) {
+            w.put<uint8_t>(f.bitfield->bit_offset);
+            w.put<uint8_t>(f.bitfield->bit_count);
+        }
+        w.put<uint8_t>(f.length.has_value());
+        if (f.length) w.put<uint64_t>(*f.length);
+        w.put<uint8_t>(f.value.has_value());
+        if (f.value) w.put(*f.value);
+        w.put<uint8_t>(f.checksum.has_value());
+        if (f.checksum) {
+            w.put<uint8_t>(static_cast<uint8_t>(f.checksum->algorithm));
+            w.put<uint64_t>(f.checksum->start);
+            w.put<uint64_t>(f.checksum->end);
+            w.put<uint8_t>(f.checksum->big_endian);
+        }
+        w.put<uint8_t>(f.count.has_value());
+        if (f.count) w.put<uint64_t>(*f.count);
+        w.put<uint8_t>(f.big_endian);
+        w.put<uint8_t>(f.encoding.has_value());
+        if (f.encoding) w.put<uint8_t>(static_cast<uint8_t>(*f.encoding));
+    }
+
+    // Derived fields are stored as source and recompiled on load.
+    w.put<uint32_t>(static_cast<uint32_t>(pkt.derived.size()));
+    for (const auto& d : pkt.derived) {
+        w.put(d.name);
+        w.put(d.expression);
+        w.put<uint8_t>(d.type.has_value());
+        if (d.type) w.put<uint8_t>(static_cast<uint8_t>(*d.type));
+    }
+}
+
+PacketDesc read_packet(Reader& r) {
+    PacketDesc pkt;
+    pkt.name = r.getString();
+    pkt.id_field_index = r.get<uint64_t>();
+    pkt.id_value = r.getValue();
+
+    pkt.mqtt.topic = r.getString();
+    pkt.mqtt.payload = r.getString();
+    pkt.mqtt.qos = r.get<uint8_t>();
+    pkt.mqtt.retain = r.get<uint8_t>() != 0;
+    pkt.mqtt.format = static_cast<PayloadFormat>(r.get<uint8_t>());
+    if (r.get<uint8_t>()) {
+        BatchConfig batch;
+        batch.mode = static_cast<BatchConfig::Mode>(r.get<uint8_t>());
+        batch.max_batch = r.get<uint64_t>();
+        batch.linger_ms = r.get<uint32_t>();
+        pkt.mqtt.batch = batch;
+    }
+    pkt.device_id_field = r.getString();
+    if (r.get<uint8_t>()) {
+        DownlinkConfig dl;
+        dl.topic = r.getString();
+        dl.qos = r.get<uint8_t>();
+        pkt.downlink = dl;
+    }
+    if (r.get<uint8_t>()) {
+        PacketRateLimit limit;
+        limit.per_sec = r.get<double>();
+        limit.burst = r.get<double>();
+        pkt.rate_limit = limit;
+    }
+    pkt.priority = static_cast<Priority>(r.get<uint8_t>());
+    pkt.output.mqtt = r.get<uint8_t>() != 0;
+    pkt.output.columnar = r.get<uint8_t>() != 0;
+
+    auto field_count = r.get<uint32_t>();
+    pkt.fields.reserve(field_count);
+    for (uint32_t i = 0; i < field_count; ++i) {
+        FieldDesc f;
+        f.name = r.getString();
+        f.type = static_cast<FieldType>(r.get<uint8_t>());
+        f.offset = r.get<uint64_t>();
+        if (r.get<uint8_t>()) {
+            BitfieldInfo bf;
+            bf.bit_offset = r.get<uint8_t>();
+            bf.bit_count = r.get<uint8_t>();
+            f.bitfield = bf;
+        }
+        if (r.get<uint8_t>()) f.length = r.get<uint64_t>();
+        if (r.get<uint8_t>()) f.value = r.getValue();
+        if (r.get<uint8_t>()) {
+            ChecksumDesc cs;
+            cs.algorithm = static_cast<checksum::Algorithm>(r.get<uint8_t>());
+            cs.start = r.get<uint64_t>();
+            cs.end = r.get<uint64_t>();
+            cs.big_endian = r.get<uint8_t>() != 0;
+            f.checksum = cs;
+        }
+        if (r.get<uint8_t>()) f.count = r.get<uint64_t>();
+        f.big_endian = r.get<uint8_t>() != 0;
+        if (r.get<uint8_t>()) f.encoding = static_cast<byte_encoding::Encoding>(r.get<uint8_t>());
+        pkt.fields.push_back(std::move(f));
+    }
+    if (pkt.id_field_index >= pkt.fields.size()) throw std::runtime_error("bad id field index");
+    for (const auto& f : pkt.fields) {
+        if (f.checksum && (f.checksum->algorithm > checksum::Algorithm::Sum8 || f.checksum->start >= f.checksum->end ||
+                           f.checksum->end > packet_total_size(pkt)))
+            throw std::runtime_error("bad checksum range");
+        if (f.encoding && *f.encoding > byte_encoding::Encoding::Raw) throw std::runtime_error("bad encoding");
+    }
+
+    auto derived_count = r.get<uint32_t>();
+    pkt.derived.reserve(derived_count);
+    for (uint32_t i = 0; i < derived_count; ++i) {
+        DerivedField d;
+        d.name = r.getString();
+        d.expression = r.getString();
+        if (r.get<uint8_t>()) d.type = static_cast<FieldType>(r.get<uint8_t>());
+        pkt.derived.push_back(std::move(d));
+    }
+    compile_derived_fields(pkt);
+    return pkt;
+}
+
+}
+
+std::optional<PacketDb> load(const std::filesystem::path& path, uint64_t key) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return std::nullopt;
+
+    struct stat st {};
+    if (::fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(Header)) {
+        ::close(fd);
+        return std::nullopt;
+    }
+    size_t size = static_cast<size_t>(st.st_size);
+    void* map = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) return std::nullopt;
+
+    std::optional<PacketDb> db;
+    try {
+        Header header;
+        std::memcpy(&header, map, sizeof(header));
+        if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION) {
+            spdlog::info("Packet definition cache {} has an incompatible format, rebuilding", path.string());
+        } else if (header.key != key) {
+            spdlog::info("Packet definition cache {} is stale, rebuilding", path.string());
+        } else if (header.payload_size != size - sizeof(Header)) {
+            spdlog::warn("Packet definition cache {} is truncated, rebuilding", path.string());
+        } else {
+            Reader reader({static_cast<const uint8_t*>(map) + sizeof(Header), header.payload_size});
+            PacketDb result;
+            result.reserve(header.packet_count);
+            for (uint32_t i = 0; i < header.packet_count; ++i) {
+                result.push_back(read_packet(reader));
+            }
+            if (!reader.done()) throw std::runtime_error("trailing data");
+            db = std::move(result);
+        }
+    } catch (const std::exception& e) {
+        spdlog::warn("Packet definition cache {} is corrupt ({}), rebuilding", path.string(), e.what());
+        db.reset();
+    }
+    ::munmap(map, size);
+    return db;
+}
+
+void store(const std::filesystem::path& path, uint64_t key, const PacketDb& db) {
+    Writer writer;
+    for (const auto& pkt : db) {
+        write_packet(writer, pkt);
+    }
+
+    Header header{};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.packet_count = static_cast<uint32_t>(db.size());
+    header.key = key;
+    header.payload_size = writer.data().size();
+
+    auto tmp_path = path;
+    tmp_path += ".tmp";
+    {
+        std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+        if (!out) throw std::runtime_error("cannot write " + tmp_path.string());
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(writer.data().data(), static_cast<std::streamsize>(writer.data().size()));
+        if (!out) throw std::runtime_error("cannot write " + tmp_path.string());
+    }
+    std::filesystem::rename(tmp_path, path);
+}
+
+}
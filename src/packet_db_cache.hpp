@@ -0,0 +1,26 @@
+#ifndef TCP_MQTT_BRIDGE_PACKET_DB_CACHE_HPP
+#define TCP_MQTT_BRIDGE_PACKET_DB_CACHE_HPP
+
+#include "packet_parser.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+
+// Compiled packet database cache. The file is a fixed little-endian layout
+// that is read straight out of an mmap; it is only used when both the format
+// version and the key (a hash over the definition files) match.
+namespace packet_db_cache {
+
+// Bump whenever the serialized layout of PacketDesc changes.
+constexpr uint32_t VERSION = 9;
+
+std::optional<PacketDb> load(const std::filesystem::path& path, uint64_t key);
+
+// Writes to a temporary file and renames it into place, so readers never see
+// a partially written cache.
+void store(const std::filesystem::path& path, uint64_t key, const PacketDb& db);
+
+}
+
+#endif // TCP_MQTT_BRIDGE_PACKET_DB_CACHE_HPP
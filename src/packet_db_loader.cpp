@@ -0,0 +1,210 @@
+#include "packet_db_loader.hpp"
+#include "packet_db_cache.hpp"
+#include "packet_parser_yaml.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <fstream>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace {
+
+std::filesystem::path resolve_defs_path(const Configuration::PacketDefsConfig& defs, const std::string& path) {
+    return path[0] == '/' ? std::filesystem::path{path} : std::filesystem::path{defs.base_dir} / path;
+}
+
+constexpr uint64_t FNV_OFFSET = 0xCBF29CE484222325ull;
+
+uint64_t fnv1a(uint64_t hash, const void* data, size_t size) {
+    const auto* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 0x100000001B3ull;
+    }
+    return hash;
+}
+
+bool matches_pattern(const std::filesystem::path& file_path, const std::string& pattern) {
+    return std::filesystem::path(pattern).filename().string().empty() ||
+           file_path.filename().string().ends_with(pattern.substr(1));
+}
+
+// Runs fn(i) for i in [0, count) on all cores. The first exception in index
+// order is rethrown once every worker has finished.
+template <typename Fn>
+void parallel_for(size_t count, Fn&& fn) {
+    size_t workers = std::min<size_t>(count, std::max(1u, std::thread::hardware_concurrency()));
+    std::vector<std::exception_ptr> errors(count);
+    std::atomic<size_t> next{0};
+    auto work = [&] {
+        for (size_t i = next++; i < count; i = next++) {
+            try {
+                fn(i);
+            } catch (...) {
+                errors[i] = std::current_exception();
+            }
+        }
+    };
+    {
+        std::vector<std::jthread> threads;
+        for (size_t t = 1; t < workers; ++t) threads.emplace_back(work);
+        work();
+    }
+    for (auto& error : errors) {
+        if (error) std::rethrow_exception(error);
+    }
+}
+
+struct DefinitionFile {
+    std::filesystem::path path;
+    std::string content;
+    PacketDb packets;
+};
+
+// Two packets are ambiguous when their identifier fields sit at the same
+// offset with the same type and value: scan_packets would always pick the
+// first one.
+std::string id_key(const PacketDesc& pkt) {
+    const auto& id_field = pkt.fields[pkt.id_field_index];
+    return std::to_string(id_field.offset) + ":" + std::to_string(static_cast<int>(id_field.type)) + ":" +
+           pkt.id_value.to_string();
+}
+
+void check_unique(const std::vector<DefinitionFile>& files) {
+    std::unordered_map<std::string, const std::filesystem::path*> names;
+    std::unordered_map<std::string, std::pair<const PacketDesc*, const std::filesystem::path*>> ids;
+    for (const auto& file : files) {
+        for (const auto& pkt : file.packets) {
+            auto [name_it, name_inserted] = names.emplace(pkt.name, &file.path);
+            if (!name_inserted) {
+                throw std::runtime_error("Duplicate packet definition '" + pkt.name + "' in " +
+                                         name_it->second->string() + " and " + file.path.string());
+            }
+            auto [id_it, id_inserted] = ids.emplace(id_key(pkt), std::make_pair(&pkt, &file.path));
+            if (!id_inserted) {
+                throw std::runtime_error("Packets '" + id_it->second.first->name + "' (" + id_it->second.second->string() +
+                                         ") and '" + pkt.name + "' (" + file.path.string() +
+                                         ") have the same identifier " + pkt.id_value.to_string());
+            }
+        }
+    }
+}
+
+}
+
+std::vector<std::filesystem::path> find_packet_def_files(const Configuration::PacketDefsConfig& defs) {
+    std::vector<std::filesystem::path> files;
+    std::unordered_set<std::string> seen;
+    for (const auto& path : defs.paths) {
+        std::filesystem::path full_path = resolve_defs_path(defs, path);
+
+        if (!std::filesystem::exists(full_path)) {
+            spdlog::warn("Packet definitions path does not exist: {}", full_path.string());
+            continue;
+        }
+
+        size_t first = files.size();
+        for (const auto& entry : std::filesystem::recursive_directory_iterator(full_path)) {
+            if (!entry.is_regular_file()) continue;
+            const auto& file_path = entry.path();
+            bool matched = std::any_of(defs.patterns.begin(), defs.patterns.end(),
+                [&file_path](const auto& pattern) { return matches_pattern(file_path, pattern); });
+            if (matched && seen.insert(std::filesystem::weakly_canonical(file_path).string()).second) {
+                files.push_back(file_path);
+            }
+        }
+        // Directory iteration order is unspecified; sort for a stable load order.
+        std::sort(files.begin() + static_cast<std::ptrdiff_t>(first), files.end());
+    }
+    return files;
+}
+
+PacketDb load_packet_db(const Configuration::PacketDefsConfig& defs) {
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<DefinitionFile> files;
+    for (auto& path : find_packet_def_files(defs)) {
+        files.push_back(DefinitionFile{std::move(path), {}, {}});
+    }
+
+    parallel_for(files.size(), [&files](size_t i) {
+        std::ifstream packet_file(files[i].path, std::ios::binary);
+        if (!packet_file) {
+            throw std::runtime_error("Could not open packet definitions file: " + files[i].path.string());
+        }
+        files[i].content.assign(std::istreambuf_iterator<char>(packet_file), std::istreambuf_iterator<char>());
+    });
+
+    std::optional<std::filesystem::path> cache_path;
+    uint64_t cache_key = FNV_OFFSET;
+    if (!defs.cache.empty()) {
+        cache_path = resolve_defs_path(defs, defs.cache);
+        cache_key = fnv1a(cache_key, &packet_db_cache::VERSION, sizeof(packet_db_cache::VERSION));
+        for (const auto& file : files) {
+            auto name = file.path.string();
+            cache_key = fnv1a(cache_key, name.data(), name.size() + 1);
+            cache_key = fnv1a(cache_key, file.content.data(), file.content.size());
+        }
+        if (auto cached = packet_db_cache::load(*cache_path, cache_key)) {
+            auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start);
+            spdlog::info("Loaded {} packet definitions from cache {} in {:.1f} ms",
+                         cached->size(), cache_path->string(), elapsed.count());
+            if (cached->empty()) throw std::runtime_error("No packet definitions were loaded");
+            return std::move(*cached);
+        }
+    }
+
+    parallel_for(files.size(), [&files](size_t i) {
+        try {
+            files[i].packets = packetdb_from_yaml(files[i].content);
+        } catch (const std::exception& e) {
+            throw std::runtime_error("Error processing packet definitions in " + files[i].path.string() + ": " + e.what());
+        }
+    });
+
+    check_unique(files);
+
+    PacketDb packet_db;
+    for (auto& file : files) {
+        spdlog::info("Loaded {} packet definitions from {}", file.packets.size(), file.path.string());
+        std::move(file.packets.begin(), file.packets.end(), std::back_inserter(packet_db));
+    }
+
+    if (packet_db.empty()) {
+        throw std::runtime_error("No packet definitions were loaded");
+    }
+
+    auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start);
+    spdlog::info("Parsed {} files in {:.1f} ms", files.size(), elapsed.count());
+
+    if (cache_path) {
+        try {
+            packet_db_cache::store(*cache_path, cache_key, packet_db);
+            spdlog::info("Wrote packet definition cache {}", cache_path->string());
+        } catch (const std::exception& e) {
+            spdlog::warn("Could not write packet definition cache {}: {}", cache_path->string(), e.what());
+        }
+    }
+    return packet_db;
+}
+
+uint64_t packet_defs_fingerprint(const Configuration::PacketDefsConfig& defs) {
+    uint64_t hash = FNV_OFFSET;
+    for (const auto& file_path : find_packet_def_files(defs)) {
+        std::error_code ec;
+        auto name = file_path.string();
+        auto size = std::filesystem::file_size(file_path, ec);
+        auto mtime = std::filesystem::last_write_time(file_path, ec).time_since_epoch().count();
+        hash = fnv1a(hash, name.data(), name.size());
+        hash = fnv1a(hash, &size, sizeof(size));
+        hash = fnv1a(hash, &mtime, sizeof(mtime));
+    }
+    return hash;
+}
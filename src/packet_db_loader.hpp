@@ -0,0 +1,21 @@
+#ifndef TCP_MQTT_BRIDGE_PACKET_DB_LOADER_HPP
+#define TCP_MQTT_BRIDGE_PACKET_DB_LOADER_HPP
+
+#include "config.hpp"
+#include "packet_parser.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+// Packet definition files found under the configured paths, in load order.
+std::vector<std::filesystem::path> find_packet_def_files(const Configuration::PacketDefsConfig& defs);
+
+// Loads every packet definition file. Throws std::runtime_error when a file
+// cannot be parsed or no definitions were found at all.
+PacketDb load_packet_db(const Configuration::PacketDefsConfig& defs);
+
+// Cheap change detector over the definition files (names, sizes and mtimes).
+uint64_t packet_defs_fingerprint(const Configuration::PacketDefsConfig& defs);
+
+#endif // TCP_MQTT_BRIDGE_PACKET_DB_LOADER_HPP
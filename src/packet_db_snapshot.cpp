@@ -0,0 +1,77 @@
+#include "packet_db_snapshot.hpp"
+#include "memory_stats.hpp"
+
+#include <cctype>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_set>
+
+namespace {
+
+bool is_name_char(char c) {
+    return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+}
+
+// Identifiers inside the {{ }} and {% %} tags of a template. Any name-like
+// token counts, so keywords and filters are included too; an extra entry
+// only costs a text value nobody reads.
+std::unordered_set<std::string_view> template_names(std::string_view source) {
+    std::unordered_set<std::string_view> names;
+    size_t pos = 0;
+    while ((pos = source.find('{', pos)) != std::string_view::npos) {
+        if (pos + 1 >= source.size() || (source[pos + 1] != '{' && source[pos + 1] != '%')) {
+            ++pos;
+            continue;
+        }
+        std::string_view close = source[pos + 1] == '{' ? "}}" : "%}";
+        size_t end = source.find(close, pos + 2);
+        if (end == std::string_view::npos) end = source.size();
+        for (size_t i = pos + 2; i < end;) {
+            if (!is_name_char(source[i])) {
+                ++i;
+                continue;
+            }
+            size_t start = i;
+            while (i < end && is_name_char(source[i])) ++i;
+            names.insert(source.substr(start, i - start));
+        }
+        pos = end;
+    }
+    return names;
+}
+
+}
+
+PacketDbSnapshot::PacketDbSnapshot(PacketDb db)
+    : db_(std::move(db))
+{
+    inja::Environment env;
+    compiled_.reserve(db_.size());
+    for (const auto& packet : db_) {
+        CompiledTemplates compiled;
+        try {
+            compiled.topic = env.parse(packet.mqtt.topic);
+            compiled.payload = env.parse(packet.mqtt.payload);
+        } catch (const std::exception& e) {
+            throw std::runtime_error("Packet " + packet.name + ": invalid MQTT template: " + e.what());
+        }
+        // Structured payloads are serialized from the typed values, so only
+        // the topic may need text.
+        bool all = packet.mqtt.format == PayloadFormat::Template;
+        auto names = template_names(packet.mqtt.topic);
+        compiled.text.reserve(packet.fields.size() + packet.derived.size());
+        for (const auto& field : packet.fields) compiled.text.push_back(all || names.contains(field.name));
+        for (const auto& derived : packet.derived) compiled.text.push_back(all || names.contains(derived.name));
+        compiled_.push_back(std::move(compiled));
+    }
+}
+
+size_t PacketDbSnapshot::memoryUsage() const
+{
+    size_t bytes = sizeof(*this) + memstats::packet_db_bytes(db_) + compiled_.capacity() * sizeof(CompiledTemplates);
+    for (const auto& templates : compiled_) {
+        bytes += memstats::string_bytes(templates.topic.content) + memstats::string_bytes(templates.payload.content) +
+                 templates.text.capacity();
+    }
+    return bytes;
+}
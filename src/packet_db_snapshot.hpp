@@ -0,0 +1,67 @@
+#ifndef TCP_MQTT_BRIDGE_PACKET_DB_SNAPSHOT_HPP
+#define TCP_MQTT_BRIDGE_PACKET_DB_SNAPSHOT_HPP
+
+#include "packet_parser.hpp"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "inja/inja.hpp"
+
+// Immutable packet database together with everything derived from it at
+// load time (parsed templates). Readers hold a shared_ptr for as long as
+// they work on a frame, so a reload never pulls definitions out from under
+// an in-flight packet.
+class PacketDbSnapshot {
+public:
+    explicit PacketDbSnapshot(PacketDb db);
+
+    PacketDbSnapshot(const PacketDbSnapshot&) = delete;
+    PacketDbSnapshot& operator=(const PacketDbSnapshot&) = delete;
+
+    const PacketDb& db() const { return db_; }
+
+    const inja::Template& topicTemplate(const PacketDesc& packet) const { return compiled_[indexOf(packet)].topic; }
+    const inja::Template& payloadTemplate(const PacketDesc& packet) const { return compiled_[indexOf(packet)].payload; }
+    // Whether rendering needs the text form of field `slot` (fields first,
+    // then derived fields): always for template payloads, otherwise only
+    // when the topic template names it.
+    bool needsText(const PacketDesc& packet, size_t slot) const { return compiled_[indexOf(packet)].text[slot] != 0; }
+
+    // Approximate heap bytes of the definitions and compiled templates. The
+    // template syntax trees are counted by the size of their source.
+    size_t memoryUsage() const;
+
+private:
+    struct CompiledTemplates {
+        inja::Template topic;
+        inja::Template payload;
+        std::vector<uint8_t> text;  // per slot, see needsText()
+    };
+
+    size_t indexOf(const PacketDesc& packet) const { return static_cast<size_t>(&packet - db_.data()); }
+
+    PacketDb db_;
+    std::vector<CompiledTemplates> compiled_;
+};
+
+using PacketDbSnapshotPtr = std::shared_ptr<const PacketDbSnapshot>;
+
+// Holds the current snapshot. load() and store() may be called from any
+// thread; a stored snapshot is only freed once the last reader drops it.
+class PacketDbStore {
+public:
+    explicit PacketDbStore(PacketDbSnapshotPtr initial) : current_(std::move(initial)) {}
+
+    PacketDbStore(const PacketDbStore&) = delete;
+    PacketDbStore& operator=(const PacketDbStore&) = delete;
+
+    PacketDbSnapshotPtr load() const { return current_.load(std::memory_order_acquire); }
+    void store(PacketDbSnapshotPtr snapshot) { current_.store(std::move(snapshot), std::memory_order_release); }
+
+private:
+    std::atomic<PacketDbSnapshotPtr> current_;
+};
+
+#endif // TCP_MQTT_BRIDGE_PACKET_DB_SNAPSHOT_HPP
@@ -0,0 +1,165 @@
+#include "packet_encoder.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+void put_le(uint8_t* dst, uint64_t v, size_t size) {
+    for (size_t i = 0; i < size; ++i) dst[i] = static_cast<uint8_t>(v >> (i * 8));
+}
+
+template <typename T>
+T checked_integer(const nlohmann::json& v, const std::string& name) {
+    if (!v.is_number_integer()) throw std::runtime_error("Field " + name + " must be an integer");
+    if constexpr (std::is_unsigned_v<T>) {
+        if (v.is_number_unsigned() || v.get<int64_t>() >= 0) {
+            auto u = v.get<uint64_t>();
+            if (u <= std::numeric_limits<T>::max()) return static_cast<T>(u);
+        }
+    } else {
+        auto i = v.get<int64_t>();
+        if (!(v.is_number_unsigned() && v.get<uint64_t>() > static_cast<uint64_t>(std::numeric_limits<int64_t>::max())) &&
+            i >= std::numeric_limits<T>::min() && i <= std::numeric_limits<T>::max()) {
+            return static_cast<T>(i);
+        }
+    }
+    throw std::runtime_error("Field " + name + " is out of range");
+}
+
+std::vector<uint8_t> to_bytes(const nlohmann::json& v, const FieldDesc& field) {
+    std::vector<uint8_t> bytes;
+    if (v.is_binary()) {
+        bytes = v.get_binary();
+    } else if (v.is_array()) {
+        for (const auto& b : v) bytes.push_back(checked_integer<uint8_t>(b, field.name));
+    } else if (v.is_string()) {
+        const auto& s = v.get_ref<const std::string&>();
+        switch (field.encoding.value_or(byte_encoding::Encoding::Hex)) {
+        case byte_encoding::Encoding::Base64: {
+            auto decoded = byte_encoding::from_base64(s);
+            if (!decoded) throw std::runtime_error("Field " + field.name + " is not valid base64");
+            bytes = std::move(*decoded);
+            break;
+        }
+        case byte_encoding::Encoding::String:
+        case byte_encoding::Encoding::Raw:
+            // Shorter text is padded with NULs.
+            bytes.assign(s.begin(), s.end());
+            break;
+        case byte_encoding::Encoding::Hex: {
+            auto decoded = byte_encoding::from_hex(s);
+            if (!decoded) throw std::runtime_error("Field " + field.name + " must be an even-length hex string");
+            bytes = std::move(*decoded);
+            break;
+        }
+        }
+    } else {
+        throw std::runtime_error("Field " + field.name + " must be a string, byte array or binary");
+    }
+    if (bytes.size() > field.length.value_or(0)) {
+        throw std::runtime_error("Field " + field.name + " is longer than " + std::to_string(field.length.value_or(0)) + " bytes");
+    }
+    return bytes;
+}
+
+// Writes one little-endian number; returns its size.
+size_t write_scalar(uint8_t* dst, FieldType type, const nlohmann::json& v, const std::string& name) {
+    switch (type) {
+    case FieldType::UINT8:  put_le(dst, checked_integer<uint8_t>(v, name), 1); return 1;
+    case FieldType::UINT16: put_le(dst, checked_integer<uint16_t>(v, name), 2); return 2;
+    case FieldType::UINT32: put_le(dst, checked_integer<uint32_t>(v, name), 4); return 4;
+    case FieldType::UINT64: put_le(dst, checked_integer<uint64_t>(v, name), 8); return 8;
+    case FieldType::INT8:   put_le(dst, static_cast<uint8_t>(checked_integer<int8_t>(v, name)), 1); return 1;
+    case FieldType::INT16:  put_le(dst, static_cast<uint16_t>(checked_integer<int16_t>(v, name)), 2); return 2;
+    case FieldType::INT32:  put_le(dst, static_cast<uint32_t>(checked_integer<int32_t>(v, name)), 4); return 4;
+    case FieldType::INT64:  put_le(dst, static_cast<uint64_t>(checked_integer<int64_t>(v, name)), 8); return 8;
+    case FieldType::FLOAT32: {
+        if (!v.is_number()) throw std::runtime_error("Field " + name + " must be a number");
+        float f = v.get<float>();
+        std::memcpy(dst, &f, 4);
+        return 4;
+    }
+    case FieldType::FLOAT64: {
+        if (!v.is_number()) throw std::runtime_error("Field " + name + " must be a number");
+        double d = v.get<double>();
+        std::memcpy(dst, &d, 8);
+        return 8;
+    }
+    case FieldType::BYTEARRAY: break;
+    }
+    throw std::runtime_error("Field " + name + " is not a number");
+}
+
+void write_field(uint8_t* dst, const FieldDesc& field, const nlohmann::json& v) {
+    if (field.type == FieldType::BYTEARRAY) {
+        auto bytes = to_bytes(v, field);
+        std::memcpy(dst, bytes.data(), bytes.size());
+        return;
+    }
+    if (!field.count) {
+        size_t size = write_scalar(dst, field.type, v, field.name);
+        if (field.big_endian) std::reverse(dst, dst + size);
+        return;
+    }
+    if (!v.is_array() || v.size() != *field.count) {
+        throw std::runtime_error("Field " + field.name + " must be an array of " + std::to_string(*field.count) + " numbers");
+    }
+    size_t width = field_size(field) / *field.count;
+    for (size_t i = 0; i < v.size(); ++i) {
+        write_scalar(dst + i * width, field.type, v[i], field.name);
+    }
+    if (field.big_endian) typed_array::byteswap(dst, v.size(), width);
+}
+
+void write_fixed(uint8_t* dst, const FieldValue& value) {
+    std::visit([dst](const auto& v) {
+        using T = std::decay_t<decltype(v)>;
+        if constexpr (std::is_same_v<T, std::vector<uint8_t>>) {
+            std::memcpy(dst, v.data(), v.size());
+        } else if constexpr (std::is_same_v<T, NumericArray>) {
+            v.encode(dst, false);
+        } else if constexpr (std::is_floating_point_v<T>) {
+            std::memcpy(dst, &v, sizeof(T));
+        } else {
+            put_le(dst, static_cast<uint64_t>(static_cast<std::make_unsigned_t<T>>(v)), sizeof(T));
+        }
+    }, value.value());
+}
+
+}
+
+std::vector<uint8_t> encode_packet(const PacketDesc& packet, const nlohmann::json& values) {
+    if (!values.is_object()) throw std::runtime_error("Packet " + packet.name + " values must be an object");
+
+    std::vector<uint8_t> out(packet_total_size(packet), 0);
+    for (const auto& field : packet.fields) {
+        uint8_t* dst = out.data() + field.offset;
+        if (field.value) {
+            write_fixed(dst, *field.value);
+            if (field.big_endian) std::reverse(dst, dst + field_size(field));
+            continue;
+        }
+        if (field.checksum) continue;
+        auto it = values.find(field.name);
+        if (it == values.end()) {
+            throw std::runtime_error("Packet " + packet.name + ": missing field " + field.name);
+        }
+        write_field(dst, field, *it);
+    }
+    // Checksums last, once the bytes they cover are in place.
+    for (const auto& field : packet.fields) {
+        if (!field.checksum || field.value) continue;
+        const auto& cs = *field.checksum;
+        size_t width = checksum::width(cs.algorithm);
+        uint32_t sum = checksum::compute(cs.algorithm, std::span<const uint8_t>(out).subspan(cs.start, cs.end - cs.start));
+        for (size_t i = 0; i < width; ++i) {
+            size_t shift = cs.big_endian ? (width - 1 - i) * 8 : i * 8;
+            out[field.offset + i] = static_cast<uint8_t>(sum >> shift);
+        }
+    }
+    return out;
+}
@@ -0,0 +1,16 @@
+#ifndef TCP_MQTT_BRIDGE_PACKET_ENCODER_HPP
+#define TCP_MQTT_BRIDGE_PACKET_ENCODER_HPP
+
+#include "packet_parser.hpp"
+
+#include <nlohmann/json.hpp>
+#include <cstdint>
+#include <vector>
+
+// Builds the binary form of a packet from field values keyed by field name.
+// Fields with a fixed `value` in the definition (the identifier) are always
+// written from the definition and checksum fields are computed. Throws
+// std::runtime_error when a field is missing or does not fit its type.
+std::vector<uint8_t> encode_packet(const PacketDesc& packet, const nlohmann::json& values);
+
+#endif // TCP_MQTT_BRIDGE_PACKET_ENCODER_HPP
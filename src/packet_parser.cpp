@@ -1,4 +1,5 @@
 #include "packet_parser.hpp"
+#include <algorithm>
 #include <cassert>
 #include <cstring>
 
@@ -9,13 +10,18 @@ std::string FieldValue::to_string() const {
     return std::visit([](const auto& v) -> std::string {
         using T = std::decay_t<decltype(v)>;
         if constexpr (std::is_same_v<T, std::vector<uint8_t>>) {
+            std::string hex;
+            byte_encoding::hex(v, hex, true);
             std::string result = "bytes[";
+            result.reserve(v.size() * 3 + 7);
             for (size_t i = 0; i < v.size(); ++i) {
-                if (i > 0) result += " ";
-                result += fmt::format("{:02X}", v[i]);
+                if (i > 0) result += ' ';
+                result.append(hex, 2 * i, 2);
             }
             result += "]";
             return result;
+        } else if constexpr (std::is_same_v<T, NumericArray>) {
+            return v.to_string();
         } else if constexpr (std::is_floating_point_v<T>) {
             return fmt::format("{:.6g}", v);
         } else if constexpr (std::is_integral_v<T>) {
@@ -31,8 +37,46 @@ std::string FieldValue::to_string() const {
 
 namespace {
 
+FieldValue extract_array(FieldType t, const uint8_t* ptr, const FieldDesc& desc) {
+    size_t count = *desc.count;
+    switch (t) {
+    case FieldType::UINT8:   return NumericArray::decode<uint8_t>(ptr, count, desc.big_endian);
+    case FieldType::UINT16:  return NumericArray::decode<uint16_t>(ptr, count, desc.big_endian);
+    case FieldType::UINT32:  return NumericArray::decode<uint32_t>(ptr, count, desc.big_endian);
+    case FieldType::UINT64:  return NumericArray::decode<uint64_t>(ptr, count, desc.big_endian);
+    case FieldType::INT8:    return NumericArray::decode<int8_t>(ptr, count, desc.big_endian);
+    case FieldType::INT16:   return NumericArray::decode<int16_t>(ptr, count, desc.big_endian);
+    case FieldType::INT32:   return NumericArray::decode<int32_t>(ptr, count, desc.big_endian);
+    case FieldType::INT64:   return NumericArray::decode<int64_t>(ptr, count, desc.big_endian);
+    case FieldType::FLOAT32: return NumericArray::decode<float>(ptr, count, desc.big_endian);
+    case FieldType::FLOAT64: return NumericArray::decode<double>(ptr, count, desc.big_endian);
+    case FieldType::BYTEARRAY: break;
+    }
+    throw std::runtime_error("Invalid array element type in extract_value");
+}
+
+size_t scalar_size(FieldType t) {
+    switch (t) {
+    case FieldType::UINT8: case FieldType::INT8: return 1;
+    case FieldType::UINT16: case FieldType::INT16: return 2;
+    case FieldType::UINT32: case FieldType::INT32: case FieldType::FLOAT32: return 4;
+    case FieldType::UINT64: case FieldType::INT64: case FieldType::FLOAT64: return 8;
+    case FieldType::BYTEARRAY: return 0;
+    }
+    return 0;
+}
+
 FieldValue extract_value(FieldType t, std::span<const uint8_t> data, const FieldDesc& desc) {
     const uint8_t* ptr = data.data() + desc.offset;
+    if (desc.count) return extract_array(t, ptr, desc);
+    // Big-endian scalars are reversed into a scratch copy and then read like
+    // little-endian ones.
+    uint8_t swapped[8];
+    if (desc.big_endian && t != FieldType::BYTEARRAY) {
+        size_t size = scalar_size(t);
+        std::reverse_copy(ptr, ptr + size, swapped);
+        ptr = swapped;
+    }
     switch (t) {
     case FieldType::UINT8:
         return FieldValue(ptr[0]);
@@ -76,14 +120,26 @@ FieldValue extract_value(FieldType t, std::span<const uint8_t> data, const Field
 }
 
 size_t type_size(FieldType t, const FieldDesc& desc) {
-    switch (t) {
-    case FieldType::UINT8: case FieldType::INT8: return 1;
-    case FieldType::UINT16: case FieldType::INT16: return 2;
-    case FieldType::UINT32: case FieldType::INT32: case FieldType::FLOAT32: return 4;
-    case FieldType::UINT64: case FieldType::INT64: case FieldType::FLOAT64: return 8;
-    case FieldType::BYTEARRAY: return desc.length.value_or(0);
+    if (t == FieldType::BYTEARRAY) return desc.length.value_or(0);
+    return scalar_size(t) * desc.count.value_or(1);
+}
+
+// Compares the checksum stored in the field with one computed over its range.
+bool checksum_matches(const FieldDesc& field, std::span<const uint8_t> view) {
+    const auto& desc = *field.checksum;
+    size_t width = checksum::width(desc.algorithm);
+    uint32_t stored = 0;
+    for (size_t i = 0; i < width; ++i) {
+        size_t shift = desc.big_endian ? (width - 1 - i) * 8 : i * 8;
+        stored |= uint32_t(view[field.offset + i]) << shift;
     }
-    return 0;
+    return stored == checksum::compute(desc.algorithm, view.subspan(desc.start, desc.end - desc.start));
+}
+
+}
+
+size_t field_size(const FieldDesc& desc) {
+    return type_size(desc.type, desc);
 }
 
 size_t packet_total_size(const PacketDesc& pkt) {
@@ -95,6 +151,73 @@ size_t packet_total_size(const PacketDesc& pkt) {
     return max_end;
 }
 
+const char* priority_name(Priority priority) {
+    switch (priority) {
+    case Priority::High: return "high";
+    case Priority::Normal: return "normal";
+    case Priority::Low: return "low";
+    }
+    return "normal";
+}
+
+void compile_derived_fields(PacketDesc& pkt) {
+    for (size_t j = 0; j < pkt.derived.size(); ++j) {
+        auto& derived = pkt.derived[j];
+        auto resolve = [&pkt, j](std::string_view name) -> std::optional<uint32_t> {
+            for (size_t i = 0; i < pkt.fields.size(); ++i) {
+                if (pkt.fields[i].name == name && pkt.fields[i].type != FieldType::BYTEARRAY && !pkt.fields[i].count)
+                    return static_cast<uint32_t>(i);
+            }
+            for (size_t k = 0; k < j; ++k) {
+                if (pkt.derived[k].name == name) return static_cast<uint32_t>(pkt.fields.size() + k);
+            }
+            return std::nullopt;
+        };
+        for (size_t i = 0; i < pkt.fields.size(); ++i) {
+            if (pkt.fields[i].name == derived.name)
+                throw std::runtime_error("Packet " + pkt.name + ": derived field " + derived.name + " shadows a field");
+        }
+        if (derived.type == FieldType::BYTEARRAY)
+            throw std::runtime_error("Packet " + pkt.name + ": derived field " + derived.name + " cannot be a bytearray");
+        try {
+            derived.program = expr::Program::compile(derived.expression, resolve);
+        } catch (const expr::ExpressionError& e) {
+            throw std::runtime_error("Packet " + pkt.name + ": derived field " + derived.name + ": " + e.what());
+        }
+    }
+}
+
+expr::Value to_expr_value(const FieldValue& value) {
+    return std::visit([](const auto& v) -> expr::Value {
+        using T = std::decay_t<decltype(v)>;
+        if constexpr (std::is_floating_point_v<T>) {
+            return expr::Value::real(v);
+        } else if constexpr (std::is_integral_v<T>) {
+            return expr::Value::integer(static_cast<int64_t>(v));
+        } else {
+            return expr::Value::integer(0);
+        }
+    }, value.value());
+}
+
+FieldValue from_expr_value(const expr::Value& value, std::optional<FieldType> type) {
+    if (!type) {
+        return value.is_float ? FieldValue(value.f) : FieldValue(value.i);
+    }
+    switch (*type) {
+    case FieldType::UINT8: return FieldValue(static_cast<uint8_t>(value.as_int()));
+    case FieldType::UINT16: return FieldValue(static_cast<uint16_t>(value.as_int()));
+    case FieldType::UINT32: return FieldValue(static_cast<uint32_t>(value.as_int()));
+    case FieldType::UINT64: return FieldValue(static_cast<uint64_t>(value.as_int()));
+    case FieldType::INT8: return FieldValue(static_cast<int8_t>(value.as_int()));
+    case FieldType::INT16: return FieldValue(static_cast<int16_t>(value.as_int()));
+    case FieldType::INT32: return FieldValue(static_cast<int32_t>(value.as_int()));
+    case FieldType::INT64: return FieldValue(value.as_int());
+    case FieldType::FLOAT32: return FieldValue(static_cast<float>(value.as_double()));
+    case FieldType::FLOAT64: return FieldValue(value.as_double());
+    case FieldType::BYTEARRAY: break;
+    }
+    throw std::runtime_error("Derived values cannot be bytearrays");
 }
 
 std::string FieldDesc::to_string() const {
@@ -114,6 +237,12 @@ std::string FieldDesc::to_string() const {
         case FieldType::BYTEARRAY:result += "BYTEARRAY"; break;
         default:                  result += "UNKNOWN"; break;
     }
+    if (count) {
+        result += "[" + std::to_string(*count) + "]";
+    }
+    if (big_endian) {
+        result += " (big endian)";
+    }
     result += ", offset: " + std::to_string(offset);
     if (bitfield) {
         result += ", bitfield: {offset: " + std::to_string(bitfield->bit_offset)
@@ -122,14 +251,22 @@ std::string FieldDesc::to_string() const {
     if (length) {
         result += ", length: " + std::to_string(*length);
     }
+    if (encoding) {
+        result += ", encoding: " + std::string(byte_encoding::name(*encoding));
+    }
     if (value) {
         result += ", value: " + fmt::format("[{}]", value->to_string());
     }
+    if (checksum) {
+        result += fmt::format(", checksum: {{{} [{}, {}){}}}", checksum::name(checksum->algorithm),
+                              checksum->start, checksum->end, checksum->big_endian ? ", big endian" : "");
+    }
     result += "}";
     return result;
 }
 
-std::pair<size_t, size_t> scan_packets(const PacketDb& db, std::span<const uint8_t> data, const FieldVisitor& visitor) {
+std::pair<size_t, size_t> scan_packets(const PacketDb& db, std::span<const uint8_t> data, const FieldVisitor& visitor,
+                                       const PacketVisitor& on_packet, const ChecksumVisitor& on_bad_checksum) {
     size_t packets_found = 0;
     size_t offset = 0;
     while (offset < data.size()) {
@@ -144,6 +281,18 @@ std::pair<size_t, size_t> scan_packets(const PacketDb& db, std::span<const uint8
             FieldValue id_val = extract_value(id_field.type, view, id_field);
             if (!(id_val == packet.id_value)) continue;
 
+            // A corrupt packet is consumed whole but none of its fields are
+            // visited, so nothing downstream ever sees its values.
+            auto bad = std::find_if(packet.fields.begin(), packet.fields.end(), [view](const FieldDesc& field) {
+                return field.checksum && !checksum_matches(field, view);
+            });
+            if (bad != packet.fields.end()) {
+                if (on_bad_checksum) on_bad_checksum(packet, *bad);
+                offset += required_size;
+                found = true;
+                break;
+            }
+
             for (const auto& field : packet.fields) {
                 size_t len = type_size(field.type, field);
                 if (view.size() < field.offset + len) continue;
@@ -154,6 +303,7 @@ std::pair<size_t, size_t> scan_packets(const PacketDb& db, std::span<const uint8
                     field_value
                 }, packet);
             }
+            if (on_packet) on_packet(packet, view);
 
             offset += required_size;
             ++packets_found;
@@ -10,6 +10,11 @@
 #include <functional>
 #include <utility>
 
+#include "byte_encoding.hpp"
+#include "checksum.hpp"
+#include "expression.hpp"
+#include "typed_array.hpp"
+
 enum class FieldType {
     UINT8, UINT16, UINT32, UINT64,
     INT8, INT16, INT32, INT64,
@@ -23,7 +28,8 @@ public:
         uint8_t, uint16_t, uint32_t, uint64_t,
         int8_t, int16_t, int32_t, int64_t,
         float, double,
-        std::vector<uint8_t>
+        std::vector<uint8_t>,
+        NumericArray
     >;
     FieldValue() = default;
     template <typename T, typename = std::enable_if_t<!std::is_same_v<std::decay_t<T>, FieldValue>>>
@@ -46,6 +52,16 @@ struct BitfieldInfo {
     uint8_t bit_count;
 };
 
+// The field holds a checksum of packet bytes [start, end). Packets whose
+// checksum does not match are reported to scan_packets' checksum visitor
+// instead of being visited.
+struct ChecksumDesc {
+    checksum::Algorithm algorithm;
+    size_t start = 0;
+    size_t end = 0;
+    bool big_endian = false;
+};
+
 struct FieldDesc {
     std::string name;
     FieldType type;
@@ -53,15 +69,87 @@ struct FieldDesc {
     std::optional<BitfieldInfo> bitfield;
     std::optional<size_t> length;
     std::optional<FieldValue> value;
+    std::optional<ChecksumDesc> checksum;
+    std::optional<size_t> count;    // element count of an array field (`float32[64]`)
+    bool big_endian = false;        // byte order of numeric fields and array elements
+    std::optional<byte_encoding::Encoding> encoding;    // text form of a bytearray field
 
     std::string to_string() const;
 };
 
+struct BatchConfig {
+    enum class Mode {
+        JsonArray,  // "[p1,p2,...]"
+        Lines       // "p1\np2\n..."
+    };
+    Mode mode = Mode::JsonArray;
+    size_t max_batch = 32;
+    uint32_t linger_ms = 10;
+};
+
+enum class PayloadFormat {
+    Template,   // payload rendered from the inja template
+    Json,       // decoded fields serialized directly
+    Cbor,
+    MsgPack
+};
+
+// Publish lane; higher lanes are drained first when the broker falls behind.
+enum class Priority : uint8_t {
+    High,
+    Normal,
+    Low
+};
+constexpr size_t PRIORITY_LANES = 3;
+
+const char* priority_name(Priority priority);
+
+struct PacketDesc;
+
+// Compiles every derived expression of the packet. Variables name scalar
+// numeric fields or earlier derived fields; slot i is field i, slot
+// fields.size() + j is derived field j. Throws std::runtime_error on invalid
+// expressions.
+void compile_derived_fields(PacketDesc& pkt);
+
+expr::Value to_expr_value(const FieldValue& value);
+// Converts to the requested type, or to int64/float64 if none is given.
+FieldValue from_expr_value(const expr::Value& value, std::optional<FieldType> type);
+
 struct MqttTemplate {
     std::string topic;
     std::string payload;
     uint8_t qos = 0;
     bool retain = false;
+    PayloadFormat format = PayloadFormat::Template;
+    std::optional<BatchConfig> batch;
+};
+
+struct DownlinkConfig {
+    std::string topic;      // subscription filter; its '+' level is the device id
+    uint8_t qos = 1;
+};
+
+// Value computed from the packet's fields (and earlier derived fields) after
+// extraction, e.g. `raw * 0.01 - 40`. Without a type the result is an int64
+// or float64 depending on the expression.
+struct DerivedField {
+    std::string name;
+    std::string expression;
+    std::optional<FieldType> type;
+    expr::Program program;      // compiled by compile_derived_fields()
+};
+
+// Per-session limit on how often a packet type is accepted.
+struct PacketRateLimit {
+    double per_sec = 0;
+    double burst = 1;
+};
+
+// Where a decoded packet goes. Packets without an `output:` key publish.
+struct PacketOutputs {
+    bool mqtt = true;
+    bool columnar = false;      // the columnar file sink, if one is configured
 };
 
 struct PacketDesc {
@@ -70,6 +158,12 @@ struct PacketDesc {
     size_t id_field_index;
     FieldValue id_value;
     MqttTemplate mqtt;
+    std::string device_id_field;            // field identifying the sending device, empty if none
+    std::optional<DownlinkConfig> downlink;
+    std::optional<PacketRateLimit> rate_limit;
+    Priority priority = Priority::Normal;
+    std::vector<DerivedField> derived;
+    PacketOutputs output;
 };
 
 using PacketDb = std::vector<PacketDesc>;
@@ -81,7 +175,18 @@ struct FieldView {
 };
 
 using FieldVisitor = std::function<void(const FieldView&, const PacketDesc&)>;
-
-std::pair<size_t, size_t> scan_packets(const PacketDb& db, std::span<const uint8_t> data, const FieldVisitor& visitor);
+// Called after the last field of each matched packet has been visited, with
+// the packet's bytes.
+using PacketVisitor = std::function<void(const PacketDesc&, std::span<const uint8_t>)>;
+// Called with the first checksum field that did not match; the packet is
+// skipped without visiting its fields.
+using ChecksumVisitor = std::function<void(const PacketDesc&, const FieldDesc&)>;
+
+size_t field_size(const FieldDesc& desc);
+size_t packet_total_size(const PacketDesc& pkt);
+
+std::pair<size_t, size_t> scan_packets(const PacketDb& db, std::span<const uint8_t> data, const FieldVisitor& visitor,
+                                       const PacketVisitor& on_packet = {},
+                                       const ChecksumVisitor& on_bad_checksum = {});
 
 #endif // PACKET_PARSER_HPP
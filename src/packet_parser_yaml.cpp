@@ -2,6 +2,7 @@
 #include <yaml-cpp/yaml.h>
 #include <stdexcept>
 #include <cctype>
+#include <algorithm>
 
 namespace {
 
@@ -20,6 +21,22 @@ FieldType parse_field_type(const std::string& str) {
     throw std::runtime_error("Unknown field type: " + str);
 }
 
+// "float32" or "float32[64]"; the count is returned separately.
+FieldType parse_field_type(const std::string& str, std::optional<size_t>& count) {
+    auto open = str.find('[');
+    if (open == std::string::npos) return parse_field_type(str);
+    if (str.back() != ']' || open + 2 > str.size() - 1)
+        throw std::runtime_error("Invalid array type: " + str);
+    FieldType type = parse_field_type(str.substr(0, open));
+    if (type == FieldType::BYTEARRAY) throw std::runtime_error("bytearray cannot be an array type, use length");
+    std::string digits = str.substr(open + 1, str.size() - open - 2);
+    if (!std::all_of(digits.begin(), digits.end(), [](unsigned char c) { return std::isdigit(c); }) ||
+        std::stoull(digits) == 0)
+        throw std::runtime_error("Invalid array length in type: " + str);
+    count = std::stoull(digits);
+    return type;
+}
+
 uint64_t parse_integer(const YAML::Node& node) {
     if (node.IsScalar()) {
         std::string s = node.as<std::string>();
@@ -65,6 +82,101 @@ FieldValue parse_value(const YAML::Node& node, FieldType type) {
     throw std::runtime_error("Invalid type in parse_value");
 }
 
+PayloadFormat parse_payload_format(const std::string& str, const std::string& packet_name) {
+    if (str == "template") return PayloadFormat::Template;
+    if (str == "json") return PayloadFormat::Json;
+    if (str == "cbor") return PayloadFormat::Cbor;
+    if (str == "msgpack") return PayloadFormat::MsgPack;
+    throw std::runtime_error("Packet " + packet_name + ": unknown payload format: " + str);
+}
+
+Priority parse_priority(const std::string& str, const std::string& packet_name) {
+    if (str == "high") return Priority::High;
+    if (str == "normal") return Priority::Normal;
+    if (str == "low") return Priority::Low;
+    throw std::runtime_error("Packet " + packet_name + ": unknown priority: " + str);
+}
+
+BatchConfig parse_batch(const YAML::Node& node, const std::string& packet_name) {
+    BatchConfig batch;
+    if (node["max_batch"]) batch.max_batch = node["max_batch"].as<size_t>();
+    if (node["linger_ms"]) batch.linger_ms = node["linger_ms"].as<uint32_t>();
+    if (node["mode"]) {
+        std::string mode = node["mode"].as<std::string>();
+        if (mode == "json_array") batch.mode = BatchConfig::Mode::JsonArray;
+        else if (mode == "lines") batch.mode = BatchConfig::Mode::Lines;
+        else throw std::runtime_error("Packet " + packet_name + ": unknown batch mode: " + mode);
+    }
+    if (batch.max_batch == 0)
+        throw std::runtime_error("Packet " + packet_name + ": batch max_batch must be greater than 0");
+    return batch;
+}
+
+// `output: columnar` or `output: [mqtt, columnar]`.
+PacketOutputs parse_outputs(const YAML::Node& node, const std::string& packet_name) {
+    PacketOutputs outputs{false, false};
+    auto add = [&](const std::string& name) {
+        if (name == "mqtt") outputs.mqtt = true;
+        else if (name == "columnar") outputs.columnar = true;
+        else throw std::runtime_error("Packet " + packet_name + ": unknown output: " + name);
+    };
+    if (node.IsSequence()) {
+        for (const YAML::Node& item : node) add(item.as<std::string>());
+    } else {
+        add(node.as<std::string>());
+    }
+    if (!outputs.mqtt && !outputs.columnar)
+        throw std::runtime_error("Packet " + packet_name + ": output must name at least one output");
+    return outputs;
+}
+
+// `checksum: crc32` or `checksum: {algorithm, start, end, byte_order}`. The
+// range defaults to everything before the checksum field.
+ChecksumDesc parse_checksum(const YAML::Node& node, const FieldDesc& field, const std::string& packet_name) {
+    const YAML::Node& algorithm_node = node.IsMap() ? node["algorithm"] : node;
+    if (!algorithm_node) throw std::runtime_error("Packet " + packet_name + ": checksum of " + field.name + " needs an algorithm");
+    std::string algorithm = algorithm_node.as<std::string>();
+    auto parsed = checksum::parse(algorithm);
+    if (!parsed) throw std::runtime_error("Packet " + packet_name + ": unknown checksum algorithm: " + algorithm);
+
+    ChecksumDesc desc;
+    desc.algorithm = *parsed;
+    desc.end = field.offset;
+    if (node.IsMap()) {
+        if (node["start"]) desc.start = node["start"].as<size_t>();
+        if (node["end"]) desc.end = node["end"].as<size_t>();
+        if (node["byte_order"]) {
+            std::string order = node["byte_order"].as<std::string>();
+            if (order == "big") desc.big_endian = true;
+            else if (order != "little")
+                throw std::runtime_error("Packet " + packet_name + ": unknown byte_order: " + order);
+        }
+    }
+    return desc;
+}
+
+// Checksum fields must be unsigned integers as wide as the checksum, and
+// cover a range that lies inside the packet and does not include them.
+void check_checksum_fields(const PacketDesc& pkt) {
+    size_t total = packet_total_size(pkt);
+    for (const auto& field : pkt.fields) {
+        if (!field.checksum) continue;
+        const auto& cs = *field.checksum;
+        std::string what = "Packet " + pkt.name + ": checksum field " + field.name;
+        size_t width = checksum::width(cs.algorithm);
+        bool unsigned_type = field.type == FieldType::UINT8 || field.type == FieldType::UINT16 ||
+                             field.type == FieldType::UINT32 || field.type == FieldType::UINT64;
+        if (!unsigned_type || field_size(field) != width || field.bitfield)
+            throw std::runtime_error(what + " must be a uint" + std::to_string(width * 8) + " for " +
+                                     checksum::name(cs.algorithm));
+        if (cs.start >= cs.end || cs.end > total)
+            throw std::runtime_error(what + " covers an invalid range [" + std::to_string(cs.start) + ", " +
+                                     std::to_string(cs.end) + ")");
+        if (cs.start < field.offset + width && field.offset < cs.end)
+            throw std::runtime_error(what + " covers itself");
+    }
+}
+
 }
 
 PacketDb packetdb_from_yaml(const std::string& yaml_text) {
@@ -82,6 +194,28 @@ PacketDb packetdb_from_yaml(const std::string& yaml_text) {
             if (mqtt["payload"]) pkt.mqtt.payload = mqtt["payload"].as<std::string>();
             if (mqtt["qos"]) pkt.mqtt.qos = mqtt["qos"].as<uint8_t>();
             if (mqtt["retain"]) pkt.mqtt.retain = mqtt["retain"].as<bool>();
+            if (mqtt["format"]) pkt.mqtt.format = parse_payload_format(mqtt["format"].as<std::string>(), pkt.name);
+            if (mqtt["batch"]) pkt.mqtt.batch = parse_batch(mqtt["batch"], pkt.name);
+        }
+
+        if (packet_node["output"]) pkt.output = parse_outputs(packet_node["output"], pkt.name);
+        if (packet_node["priority"]) pkt.priority = parse_priority(packet_node["priority"].as<std::string>(), pkt.name);
+        if (packet_node["device_id"]) pkt.device_id_field = packet_node["device_id"].as<std::string>();
+        if (const YAML::Node& downlink = packet_node["downlink"]) {
+            DownlinkConfig dl;
+            dl.topic = downlink["topic"].as<std::string>();
+            if (dl.topic.find('+') == std::string::npos)
+                throw std::runtime_error("Packet " + pkt.name + ": downlink topic needs a '+' level for the device id");
+            if (downlink["qos"]) dl.qos = static_cast<uint8_t>(downlink["qos"].as<unsigned>());
+            pkt.downlink = dl;
+        }
+        if (const YAML::Node& rate_limit = packet_node["rate_limit"]) {
+            PacketRateLimit limit;
+            limit.per_sec = rate_limit["per_sec"].as<double>();
+            limit.burst = rate_limit["burst"].as<double>(std::max(limit.per_sec, 1.0));
+            if (limit.per_sec <= 0)
+                throw std::runtime_error("Packet " + pkt.name + ": rate_limit.per_sec must be positive");
+            pkt.rate_limit = limit;
         }
 
         const YAML::Node& fields = packet_node["fields"];
@@ -91,8 +225,16 @@ PacketDb packetdb_from_yaml(const std::string& yaml_text) {
         for (const YAML::Node& field : fields) {
             FieldDesc fdesc;
             fdesc.name = field["name"].as<std::string>();
-            fdesc.type = parse_field_type(field["type"].as<std::string>());
+            fdesc.type = parse_field_type(field["type"].as<std::string>(), fdesc.count);
             fdesc.offset = field["offset"].as<size_t>();
+            if (field["byte_order"]) {
+                std::string order = field["byte_order"].as<std::string>();
+                if (order == "big") fdesc.big_endian = true;
+                else if (order != "little")
+                    throw std::runtime_error("Packet " + pkt.name + ": unknown byte_order: " + order);
+                if (fdesc.type == FieldType::BYTEARRAY)
+                    throw std::runtime_error("Packet " + pkt.name + ": byte_order does not apply to bytearray field " + fdesc.name);
+            }
             if (field["bitfield"]) {
                 const auto& bf = field["bitfield"];
                 BitfieldInfo binfo;
@@ -104,10 +246,24 @@ PacketDb packetdb_from_yaml(const std::string& yaml_text) {
                 fdesc.length = field["length"].as<size_t>();
             else if (fdesc.type == FieldType::BYTEARRAY && !field["length"])
                 throw std::runtime_error("BYTEARRAY must have 'length' field");
+            if (field["encoding"]) {
+                std::string encoding = field["encoding"].as<std::string>();
+                fdesc.encoding = byte_encoding::parse(encoding);
+                if (!fdesc.encoding)
+                    throw std::runtime_error("Packet " + pkt.name + ": unknown encoding: " + encoding);
+                if (fdesc.type != FieldType::BYTEARRAY)
+                    throw std::runtime_error("Packet " + pkt.name + ": encoding only applies to bytearray fields, not " + fdesc.name);
+            }
 
+            if (fdesc.count && (field["value"] || field["bitfield"] || field["checksum"]))
+                throw std::runtime_error("Packet " + pkt.name + ": array field " + fdesc.name +
+                                         " cannot have a value, bitfield or checksum");
             if (field["value"]) {
                 fdesc.value = parse_value(field["value"], fdesc.type);
             }
+            if (field["checksum"]) {
+                fdesc.checksum = parse_checksum(field["checksum"], fdesc, pkt.name);
+            }
 
             if (!found_id && fdesc.value.has_value()) {
                 pkt.id_field_index = field_idx;
@@ -119,6 +275,21 @@ PacketDb packetdb_from_yaml(const std::string& yaml_text) {
         }
         if (!found_id)
             throw std::runtime_error("Packet " + pkt.name + " does not have an identifier field (with 'value')");
+        check_checksum_fields(pkt);
+        if (const YAML::Node& derived = packet_node["derived"]) {
+            if (!derived.IsSequence()) throw std::runtime_error("Packet " + pkt.name + ": derived must be a sequence");
+            for (const YAML::Node& node : derived) {
+                DerivedField d;
+                d.name = node["name"].as<std::string>();
+                d.expression = node["expr"].as<std::string>();
+                if (node["type"]) d.type = parse_field_type(node["type"].as<std::string>());
+                pkt.derived.push_back(std::move(d));
+            }
+            compile_derived_fields(pkt);
+        }
+        if (!pkt.device_id_field.empty() &&
+            std::none_of(pkt.fields.begin(), pkt.fields.end(), [&pkt](const FieldDesc& f) { return f.name == pkt.device_id_field && !f.count; }))
+            throw std::runtime_error("Packet " + pkt.name + ": device_id refers to unknown or array field " + pkt.device_id_field);
         db.push_back(std::move(pkt));
     }
     return db;
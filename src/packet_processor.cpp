@@ -1,44 +1,265 @@
 #include "packet_processor.hpp"
+#include "device_router.hpp"
+#include "metrics.hpp"
+#include "memory_stats.hpp"
+#include "trace.hpp"
 
 #include <spdlog/spdlog.h>
 
-PacketProcessor::PacketProcessor(const PacketDb& packet_db, MqttClient& mqtt_client)
-    : packet_db_(packet_db)
-    , mqtt_client_(mqtt_client)
+#include <chrono>
+
+namespace {
+
+// Array fields become plain number arrays, reserved up front so a long
+// waveform is not reallocated while it is filled.
+PacketProcessor::json_t array_value(const NumericArray& array) {
+    return std::visit([](const auto& values) {
+        using T = typename std::decay_t<decltype(values)>::value_type;
+        PacketProcessor::json_t out = PacketProcessor::json_t::array();
+        auto& elements = out.get_ref<PacketProcessor::json_t::array_t&>();
+        elements.reserve(values.size());
+        for (T v : values) {
+            if constexpr (std::is_same_v<T, uint8_t> || std::is_same_v<T, uint16_t>) {
+                elements.emplace_back(static_cast<uint32_t>(v));
+            } else if constexpr (std::is_same_v<T, int8_t> || std::is_same_v<T, int16_t>) {
+                elements.emplace_back(static_cast<int32_t>(v));
+            } else {
+                elements.emplace_back(v);
+            }
+        }
+        return out;
+    }, array.storage());
+}
+
+// Templates see a bytearray with an encoding as its text form; `string`
+// is escaped because it usually lands inside a JSON string literal.
+std::string text_value(const FieldView& field) {
+    const auto* bytes = field.value.get_if<std::vector<uint8_t>>();
+    if (!bytes || !field.desc.encoding) return field.value.to_string();
+    std::string text;
+    switch (*field.desc.encoding) {
+    case byte_encoding::Encoding::Hex:    byte_encoding::hex(*bytes, text); break;
+    case byte_encoding::Encoding::Base64: byte_encoding::base64(*bytes, text); break;
+    case byte_encoding::Encoding::String: byte_encoding::json_escape(byte_encoding::trim_nuls(*bytes), text); break;
+    case byte_encoding::Encoding::Raw:    text.assign(bytes->begin(), bytes->end()); break;
+    }
+    return text;
+}
+
+PacketProcessor::json_t bytes_value(const std::vector<uint8_t>& bytes, PayloadFormat format,
+                                    std::optional<byte_encoding::Encoding> encoding) {
+    std::string text;
+    switch (encoding.value_or(format == PayloadFormat::Json ? byte_encoding::Encoding::Hex
+                                                            : byte_encoding::Encoding::Raw)) {
+    case byte_encoding::Encoding::Hex:
+        byte_encoding::hex(bytes, text);
+        return text;
+    case byte_encoding::Encoding::Base64:
+        byte_encoding::base64(bytes, text);
+        return text;
+    case byte_encoding::Encoding::String: {
+        auto trimmed = byte_encoding::trim_nuls(bytes);
+        return std::string(trimmed.begin(), trimmed.end());
+    }
+    case byte_encoding::Encoding::Raw:
+        break;
+    }
+    if (format == PayloadFormat::Json) return PacketProcessor::json_t(bytes);
+    return PacketProcessor::json_t::binary(bytes);
+}
+
+PacketProcessor::json_t typed_value(const FieldValue& value, PayloadFormat format,
+                                    std::optional<byte_encoding::Encoding> encoding = std::nullopt) {
+    return std::visit([format, encoding](const auto& v) -> PacketProcessor::json_t {
+        using T = std::decay_t<decltype(v)>;
+        if constexpr (std::is_same_v<T, std::vector<uint8_t>>) {
+            return bytes_value(v, format, encoding);
+        } else if constexpr (std::is_same_v<T, NumericArray>) {
+            return array_value(v);
+        } else if constexpr (std::is_same_v<T, uint8_t> || std::is_same_v<T, uint16_t>) {
+            return static_cast<uint32_t>(v);
+        } else if constexpr (std::is_same_v<T, int8_t> || std::is_same_v<T, int16_t>) {
+            return static_cast<int32_t>(v);
+        } else {
+            return v;
+        }
+    }, value.value());
+}
+
+std::string serialize(const PacketProcessor::json_t& fields, PayloadFormat format) {
+    std::string out;
+    switch (format) {
+    case PayloadFormat::Cbor:
+        PacketProcessor::json_t::to_cbor(fields, out);
+        break;
+    case PayloadFormat::MsgPack:
+        PacketProcessor::json_t::to_msgpack(fields, out);
+        break;
+    default:
+        // `string` and `raw` fields need not be valid UTF-8.
+        out = fields.dump(-1, ' ', false, PacketProcessor::json_t::error_handler_t::replace);
+        break;
+    }
+    return out;
+}
+
+}
+
+const char* content_type(PayloadFormat format) {
+    switch (format) {
+    case PayloadFormat::Json:    return "application/json";
+    case PayloadFormat::Cbor:    return "application/cbor";
+    case PayloadFormat::MsgPack: return "application/msgpack";
+    case PayloadFormat::Template: break;
+    }
+    return "";
+}
+
+PacketProcessor::PacketProcessor(const PacketDbStore& packet_db, Sink* sink)
+    : sink_(sink)
+    , packet_db_(packet_db)
+{
+}
+
+size_t PacketProcessor::memoryUsage() const
 {
+    return memstats::json_bytes(json_db) + memstats::json_bytes(json_fields) + slots_.capacity() * sizeof(expr::Value) +
+           stored_.capacity() * sizeof(decltype(stored_)::value_type);
 }
 
-std::optional<PacketProcessor::MqttMessage> PacketProcessor::processPacket(std::span<const uint8_t> packet)
+void PacketProcessor::evaluateDerived(const PacketDbSnapshot& snapshot, const PacketDesc& packet)
 {
+    for (size_t j = 0; j < packet.derived.size(); ++j) {
+        const auto& derived = packet.derived[j];
+        FieldValue value = from_expr_value(derived.program.eval(slots_), derived.type);
+        // Later expressions see the value after conversion to the declared type.
+        slots_[packet.fields.size() + j] = to_expr_value(value);
+        if (snapshot.needsText(packet, packet.fields.size() + j)) {
+            auto text = value.to_string();
+            spdlog::debug("Derived: {} = {}", derived.name, text);
+            json_db[derived.name] = std::move(text);
+        }
+        if (packet.mqtt.format != PayloadFormat::Template) {
+            json_fields[derived.name] = typed_value(value, packet.mqtt.format);
+        }
+    }
+}
+
+void PacketProcessor::SinkRows::writeTo(Sink& sink) const
+{
+    for (const auto& [packet, bytes] : packets) sink.write(snapshot, *packet, bytes, timestamp_ns);
+}
+
+std::optional<std::vector<PacketProcessor::MqttMessage>> PacketProcessor::processFrame(std::span<const uint8_t> frame,
+                                                                                       const PacketFilter& admit, uint64_t trace_id,
+                                                                                       SinkRows* deferred)
+{
+    std::vector<MqttMessage> messages;
+    std::string device_id;
+    bool failed = false;
+    bool matched = false;
+
+    // Pin the current definitions for the whole frame; a concurrent reload
+    // only takes effect for the next one.
+    auto snapshot = packet_db_.load();
+
+    // Each packet in the frame gets its own field scope: fields are
+    // collected until scan_packets reports the packet complete, rendered,
+    // then cleared before the next packet starts.
     json_db.clear();
-    const PacketDesc* current_packet = nullptr;
-
-    auto result = scan_packets(packet_db_, packet, 
-        [this, &current_packet](const FieldView& field, const PacketDesc& packet) {
-            if (!current_packet) current_packet = &packet;
-            auto name = field.desc.name;
-            auto value = field.value.to_string();
-            json_db[name] = value;
-            spdlog::debug("Field: {} = {}", name, value);
+    json_fields.clear();
+    stored_.clear();
+    scan_packets(snapshot->db(), frame,
+        [this, &device_id, &snapshot](const FieldView& field, const PacketDesc& packet) {
+            // Sink-only packets skip the field scopes; the sink takes the raw bytes.
+            if (!packet.output.mqtt) return;
+            if (field.desc.name == packet.device_id_field) {
+                device_id = device_key(field.value);
+            }
+            const auto& name = field.desc.name;
+            size_t slot = static_cast<size_t>(&field.desc - packet.fields.data());
+            if (snapshot->needsText(packet, slot)) {
+                auto value = text_value(field);
+                spdlog::debug("Field: {} = {}", name, value);
+                json_db[name] = std::move(value);
+            }
+            if (packet.mqtt.format != PayloadFormat::Template) {
+                json_fields[name] = typed_value(field.value, packet.mqtt.format, field.desc.encoding);
+            }
+            if (!packet.derived.empty()) {
+                if (slots_.size() < packet.fields.size() + packet.derived.size()) {
+                    slots_.resize(packet.fields.size() + packet.derived.size());
+                }
+                slots_[slot] = to_expr_value(field.value);
+            }
+        },
+        [this, &messages, &device_id, &failed, &matched, &snapshot, &admit, trace_id](const PacketDesc& packet,
+                                                                                      std::span<const uint8_t> bytes) {
+            trace::record(trace_id, trace::Stage::PacketMatched);
+            matched = true;
+            if (!failed && admit && !admit(packet)) {
+                spdlog::debug("Packet {} rejected by rate limit", packet.name);
+                failed = true;
+            }
+            if (!failed && packet.output.columnar && sink_) {
+                stored_.emplace_back(&packet, bytes);
+            }
+            // Once one packet fails the frame is NAKed, so later ones are not rendered.
+            if (!failed && packet.output.mqtt) {
+                try {
+                    evaluateDerived(*snapshot, packet);
+                    std::string rendered_topic = env_.render(snapshot->topicTemplate(packet), json_db);
+                    std::string payload = packet.mqtt.format == PayloadFormat::Template
+                        ? env_.render(snapshot->payloadTemplate(packet), json_db)
+                        : serialize(json_fields, packet.mqtt.format);
+                    messages.push_back(MqttMessage{
+                        std::move(rendered_topic),
+                        std::move(payload),
+                        packet.mqtt.qos,
+                        packet.mqtt.retain,
+                        packet.mqtt.format,
+                        packet.mqtt.batch,
+                        std::move(device_id),
+                        packet.priority,
+                        trace_id
+                    });
+                    trace::record(trace_id, trace::Stage::Rendered);
+                } catch (const std::exception& e) {
+                    spdlog::error("Error rendering MQTT templates for {}: {}", packet.name, e.what());
+                    failed = true;
+                }
+            }
+            json_db.clear();
+            json_fields.clear();
+            device_id.clear();
+        },
+        [&failed](const PacketDesc& packet, const FieldDesc& field) {
+            static auto& corrupt = metrics::counter("packet_checksum_failed_total", "Packets whose checksum did not match");
+            corrupt.inc();
+            spdlog::warn("Packet {}: {} checksum mismatch in {}", packet.name,
+                         checksum::name(field.checksum->algorithm), field.name);
+            failed = true;
         });
-    
-    if (!current_packet) {
-        spdlog::error("No packet matched the input data");
+
+    if (failed) {
+        // All or nothing: the device resends the whole frame after a NAK.
         return std::nullopt;
     }
-
-    try {
-        inja::Environment env;
-        std::string rendered_topic = env.render(current_packet->mqtt.topic, json_db);
-        std::string rendered_payload = env.render(current_packet->mqtt.payload, json_db);
-        return MqttMessage{
-            rendered_topic,
-            rendered_payload,
-            current_packet->mqtt.qos,
-            current_packet->mqtt.retain
-        };
-    } catch (const std::exception& e) {
-        spdlog::error("Error rendering MQTT templates: {}", e.what());
+    if (!matched) {
+        spdlog::error("No packet matched the input data");
         return std::nullopt;
     }
+    if (!stored_.empty()) {
+        auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch());
+        if (deferred) {
+            // The frame buffer does not outlive the call, so the rows are copied.
+            deferred->snapshot = snapshot;
+            deferred->timestamp_ns = now.count();
+            for (const auto& [packet, bytes] : stored_) deferred->packets.emplace_back(packet, std::vector<uint8_t>(bytes.begin(), bytes.end()));
+        } else {
+            for (const auto& [packet, bytes] : stored_) sink_->write(snapshot, *packet, bytes, now.count());
+        }
+        stored_.clear();
+    }
+    return messages;
 }
@@ -2,13 +2,20 @@
 #define TCP_MQTT_BRIDGE_PACKET_PROCESSOR_HPP
 
 #include "packet_parser.hpp"
-#include "mqtt_client.hpp"
+#include "packet_db_snapshot.hpp"
+#include "sink.hpp"
 
+#include <functional>
 #include <memory>
+#include <optional>
 #include <span>
+#include <vector>
 
 #include "inja/inja.hpp"
 
+// MQTT 5 content type announced for a payload format; empty for templates.
+const char* content_type(PayloadFormat format);
+
 class PacketProcessor {
 public:
     using json_t = nlohmann::json;
@@ -17,16 +24,54 @@ public:
         std::string payload;
         uint8_t qos;
         bool retain;
+        PayloadFormat format;
+        std::optional<BatchConfig> batch;
+        std::string device_id;      // empty unless the packet has a device_id field
+        Priority priority = Priority::Normal;
+        uint64_t trace_id = 0;      // non-zero when the frame is sampled for tracing
     };
 
-    PacketProcessor(const PacketDb& packet_db, MqttClient& mqtt_client);
+    // Decides whether a decoded packet may be published; used for rate limits.
+    using PacketFilter = std::function<bool(const PacketDesc&)>;
+
+    // Sink writes of an accepted frame, held back for a caller that still
+    // has checks of its own to make. The packets are copies, and snapshot
+    // keeps their definitions alive.
+    struct SinkRows {
+        PacketDbSnapshotPtr snapshot;
+        std::vector<std::pair<const PacketDesc*, std::vector<uint8_t>>> packets;
+        int64_t timestamp_ns = 0;
+
+        void writeTo(Sink& sink) const;
+    };
 
-    std::optional<MqttMessage> processPacket(std::span<const uint8_t> packet);
+    // Packets with `output: columnar` go to sink; without one they are
+    // accepted and discarded.
+    explicit PacketProcessor(const PacketDbStore& packet_db, Sink* sink = nullptr);
+
+    // One message per published packet found in the frame, in frame order;
+    // empty when every packet went to the sink only. nullopt when nothing
+    // matched, any packet failed to render or admit rejected one, in which
+    // case nothing is written to the sink either. With deferred, an accepted
+    // frame's sink writes go there instead of to the sink.
+    std::optional<std::vector<MqttMessage>> processFrame(std::span<const uint8_t> frame, const PacketFilter& admit = {},
+                                                         uint64_t trace_id = 0, SinkRows* deferred = nullptr);
+
+    // Approximate heap bytes held by the field scopes and expression slots.
+    size_t memoryUsage() const;
 
 private:
+    // Evaluates the packet's derived fields into json_db/json_fields.
+    void evaluateDerived(const PacketDbSnapshot& snapshot, const PacketDesc& packet);
+
     json_t json_db;
-    const PacketDb& packet_db_;
-    MqttClient& mqtt_client_;
+    json_t json_fields;
+    std::vector<expr::Value> slots_;    // field and derived values of the current packet
+    // Packets for the sink, written once the whole frame has been accepted.
+    std::vector<std::pair<const PacketDesc*, std::span<const uint8_t>>> stored_;
+    Sink* sink_;
+    inja::Environment env_;
+    const PacketDbStore& packet_db_;
 };
 
 #endif // TCP_MQTT_BRIDGE_PACKET_PROCESSOR_HPP
@@ -0,0 +1,128 @@
+#include "pipeline.hpp"
+
+#include <spdlog/spdlog.h>
+#include <fmt/format.h>
+
+namespace {
+
+// Results handled per publish stage turn before yielding to socket I/O.
+constexpr size_t DRAIN_BATCH = 256;
+
+}
+
+Pipeline::Worker::Worker(const PacketDbStore& packet_db, Sink* sink, size_t capacity, size_t index)
+    : jobs(capacity)
+    , processor(packet_db, sink)
+    , queued(metrics::gauge(fmt::format("pipeline_worker_{}_queued", index), "Frames waiting for this render worker"))
+{
+}
+
+Pipeline::Pipeline(boost::asio::io_context& ioc, const PacketDbStore& packet_db, size_t workers, size_t queue_capacity,
+                   Sink* sink)
+    : ioc_(ioc)
+    , results_(workers * queue_capacity)
+    , results_queued_(metrics::gauge("pipeline_publish_queued", "Rendered frames waiting for the publish stage"))
+{
+    for (size_t i = 0; i < workers; ++i) {
+        workers_.push_back(std::make_unique<Worker>(packet_db, sink, queue_capacity, i));
+    }
+    for (auto& worker : workers_) {
+        worker->thread = std::thread([this, &worker = *worker] { work(worker); });
+    }
+}
+
+Pipeline::~Pipeline() {
+    stop();
+}
+
+size_t Pipeline::assignWorker() {
+    return next_worker_++ % workers_.size();
+}
+
+bool Pipeline::submit(size_t worker, std::shared_ptr<Client> client, std::vector<uint8_t> frame, uint64_t trace_id) {
+    static auto& rejected = metrics::counter("pipeline_frames_rejected_total", "Frames refused because a render worker queue was full (NAKed, or retried on raw streams)");
+    Worker& target = *workers_[worker];
+    Job job{std::move(client), std::move(frame), trace_id};
+    if (!target.jobs.push(job)) {
+        rejected.inc();
+        return false;
+    }
+    target.queued.add(1);
+    target.signal.fetch_add(1, std::memory_order_release);
+    target.signal.notify_one();
+    return true;
+}
+
+void Pipeline::work(Worker& worker) {
+    while (!stopping_.load(std::memory_order_acquire)) {
+        // Read before draining: a push after the last pop changes the value,
+        // so the wait below returns immediately instead of missing it.
+        uint32_t seen = worker.signal.load(std::memory_order_acquire);
+        while (auto job = worker.jobs.pop()) {
+            worker.queued.sub(1);
+            Result result{std::move(job->client), {}};
+            result.processed.trace_id = job->trace_id;
+            auto& limited = result.processed.limited;
+            try {
+                result.processed.messages = worker.processor.processFrame(job->frame, [&limited](const PacketDesc& packet) {
+                    if (packet.rate_limit) limited.push_back(LimitedPacket{packet.name, *packet.rate_limit});
+                    return true;
+                }, job->trace_id, &result.processed.sink_rows);
+            } catch (const std::exception& e) {
+                spdlog::error("Render worker failed on a frame: {}", e.what());
+                result.processed.messages.reset();
+                result.processed.sink_rows.packets.clear();
+            }
+            complete(result);
+            if (stopping_.load(std::memory_order_acquire)) return;
+        }
+        worker.signal.wait(seen, std::memory_order_acquire);
+    }
+}
+
+void Pipeline::complete(Result& result) {
+    // The publish stage only falls behind when the broker does; back off
+    // until it catches up, which in turn fills the worker queue and NAKs.
+    while (!results_.push(result)) {
+        if (stopping_.load(std::memory_order_acquire)) return;
+        std::this_thread::yield();
+    }
+    results_queued_.add(1);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!drain_scheduled_.exchange(true, std::memory_order_acq_rel)) {
+        boost::asio::post(ioc_, [this] { drain(); });
+    }
+}
+
+void Pipeline::drain() {
+    size_t handled = 0;
+    while (handled < DRAIN_BATCH) {
+        auto result = results_.pop();
+        if (!result) break;
+        results_queued_.sub(1);
+        result->client->onProcessed(std::move(result->processed));
+        ++handled;
+    }
+    if (handled == DRAIN_BATCH) {
+        boost::asio::post(ioc_, [this] { drain(); });
+        return;
+    }
+    drain_scheduled_.store(false, std::memory_order_release);
+    // A worker that pushed after the last pop saw the flag still set and
+    // did not post, so look once more.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!results_.empty() && !drain_scheduled_.exchange(true, std::memory_order_acq_rel)) {
+        boost::asio::post(ioc_, [this] { drain(); });
+    }
+}
+
+void Pipeline::stop() {
+    if (stopping_.exchange(true)) return;
+    for (auto& worker : workers_) {
+        worker->signal.fetch_add(1, std::memory_order_release);
+        worker->signal.notify_one();
+    }
+    for (auto& worker : workers_) {
+        if (worker->thread.joinable()) worker->thread.join();
+    }
+}
@@ -0,0 +1,99 @@
+#ifndef TCP_MQTT_BRIDGE_PIPELINE_HPP
+#define TCP_MQTT_BRIDGE_PIPELINE_HPP
+
+#include "packet_processor.hpp"
+#include "packet_db_snapshot.hpp"
+#include "ring_buffer.hpp"
+#include "metrics.hpp"
+
+#include <boost/asio.hpp>
+#include <atomic>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Staged frame processing. The I/O thread only reads and frames; each
+// framed packet goes through a per-worker SPSC ring to a worker thread that
+// parses and renders it with its own PacketProcessor. Rendered frames come
+// back through one MPSC ring to the publish stage, which runs on the MQTT
+// client's executor and hands them to their client for publishing and the
+// ACK. A client always uses the same worker, so its frames stay in order.
+class Pipeline {
+public:
+    // A rate-limited packet type found in a frame. Limits are per session,
+    // so they are checked by the publish stage rather than on the worker.
+    struct LimitedPacket {
+        std::string name;
+        PacketRateLimit limit;
+    };
+
+    struct Processed {
+        std::optional<std::vector<PacketProcessor::MqttMessage>> messages;     // nullopt to NAK
+        std::vector<LimitedPacket> limited;
+        // Written by the client once the limits admit the frame.
+        PacketProcessor::SinkRows sink_rows;
+        uint64_t trace_id = 0;
+    };
+
+    class Client {
+    public:
+        virtual ~Client() = default;
+
+        // Called on the publish stage for every frame submitted by the client.
+        virtual void onProcessed(Processed processed) = 0;
+    };
+
+    Pipeline(boost::asio::io_context& ioc, const PacketDbStore& packet_db, size_t workers, size_t queue_capacity,
+             Sink* sink = nullptr);
+    ~Pipeline();
+
+    Pipeline(const Pipeline&) = delete;
+    Pipeline& operator=(const Pipeline&) = delete;
+
+    // Picks the worker for a new client, round robin. I/O thread only.
+    size_t assignWorker();
+
+    // Queues a frame on the worker; false when its queue is full.
+    bool submit(size_t worker, std::shared_ptr<Client> client, std::vector<uint8_t> frame, uint64_t trace_id);
+
+    // Joins the workers. Frames still queued are dropped.
+    void stop();
+
+private:
+    struct Job {
+        std::shared_ptr<Client> client;
+        std::vector<uint8_t> frame;
+        uint64_t trace_id = 0;
+    };
+
+    struct Result {
+        std::shared_ptr<Client> client;
+        Processed processed;
+    };
+
+    struct Worker {
+        Worker(const PacketDbStore& packet_db, Sink* sink, size_t capacity, size_t index);
+
+        SpscRing<Job> jobs;
+        std::atomic<uint32_t> signal{0};    // bumped on every push; the worker sleeps on it
+        PacketProcessor processor;
+        metrics::Gauge& queued;
+        std::thread thread;
+    };
+
+    void work(Worker& worker);
+    void complete(Result& result);
+    void drain();
+
+    boost::asio::io_context& ioc_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+    MpscRing<Result> results_;
+    metrics::Gauge& results_queued_;
+    std::atomic<bool> drain_scheduled_{false};
+    std::atomic<bool> stopping_{false};
+    size_t next_worker_ = 0;
+};
+
+#endif // TCP_MQTT_BRIDGE_PIPELINE_HPP
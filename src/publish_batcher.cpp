@@ -0,0 +1,199 @@
+#include "publish_batcher.hpp"
+#include "handler_memory.hpp"
+
+#include <spdlog/spdlog.h>
+#include <utility>
+
+PublishBatcher::PublishBatcher(boost::asio::io_context& ioc, MqttClient& mqtt_client)
+    : ioc_(ioc)
+    , mqtt_client_(mqtt_client)
+{
+}
+
+void PublishBatcher::submit(const PacketProcessor::MqttMessage& message, MqttClient::PublishCallback callback)
+{
+    if (message.batch) {
+        add(message, std::move(callback));
+        return;
+    }
+    mqtt_client_.publish(
+        message.topic,
+        message.payload,
+        std::move(callback),
+        message.qos,
+        message.retain,
+        content_type(message.format),
+        message.priority,
+        message.trace_id
+    );
+}
+
+void PublishBatcher::submitFrame(const std::vector<PacketProcessor::MqttMessage>& messages, MqttClient::PublishCallback on_complete)
+{
+    if (messages.size() == 1) {
+        submit(messages.front(), std::move(on_complete));
+        return;
+    }
+
+    struct FrameState {
+        size_t remaining;
+        boost::system::error_code first_error;
+        MqttClient::PublishCallback on_complete;
+    };
+    auto state = std::allocate_shared<FrameState>(handler_memory::Allocator<FrameState>(),
+                                                  FrameState{messages.size(), {}, std::move(on_complete)});
+    for (const auto& message : messages) {
+        submit(message, handler_memory::bind([state](boost::system::error_code ec) {
+            if (ec && !state->first_error) state->first_error = ec;
+            if (--state->remaining == 0) std::move(state->on_complete)(state->first_error);
+        }));
+    }
+}
+
+void PublishBatcher::add(const PacketProcessor::MqttMessage& message, MqttClient::PublishCallback callback)
+{
+    const BatchConfig& config = *message.batch;
+    auto& slot = batches_[message.topic];
+    if (!slot) {
+        slot = std::make_unique<Batch>(ioc_);
+    }
+    Batch& batch = *slot;
+
+    // Payloads for one topic can only share a publish if they agree on how
+    // it is sent; a packet type with different settings starts a new batch.
+    if (!batch.payloads.empty() &&
+        (batch.config.mode != config.mode || batch.format != message.format || batch.qos != message.qos || batch.retain != message.retain ||
+         batch.priority != message.priority)) {
+        flush(message.topic, batch);
+    }
+
+    if (batch.payloads.empty()) {
+        batch.config = config;
+        batch.format = message.format;
+        batch.qos = message.qos;
+        batch.retain = message.retain;
+        batch.priority = message.priority;
+        batch.generation = ++generation_;
+        batch.timer.expires_after(std::chrono::milliseconds(config.linger_ms));
+        batch.timer.async_wait(
+            [this, topic = message.topic, generation = batch.generation](boost::system::error_code ec) {
+                if (ec) return;
+                auto it = batches_.find(topic);
+                if (it == batches_.end() || it->second->generation != generation) return;
+                flush(topic, *it->second);
+                batches_.erase(it);
+            });
+    }
+
+    if (batch.trace_id == 0) batch.trace_id = message.trace_id;
+    batch.payloads.push_back(message.payload);
+    batch.callbacks.push_back(std::move(callback));
+
+    if (batch.payloads.size() >= batch.config.max_batch) {
+        flush(message.topic, batch);
+        batches_.erase(message.topic);
+    }
+}
+
+void PublishBatcher::flushAll()
+{
+    for (auto& [topic, batch] : batches_) {
+        flush(topic, *batch);
+    }
+    batches_.clear();
+}
+
+void PublishBatcher::flush(const std::string& topic, Batch& batch)
+{
+    if (batch.payloads.empty()) return;
+
+    batch.generation = 0;
+    batch.timer.cancel();
+
+    std::string payload = combine(batch);
+    auto callbacks = std::move(batch.callbacks);
+    batch.callbacks.clear();
+    spdlog::debug("Flushing batch of {} payloads ({} bytes) to {}", batch.payloads.size(), payload.size(), topic);
+    batch.payloads.clear();
+
+    mqtt_client_.publish(
+        topic,
+        payload,
+        handler_memory::bind([callbacks = std::move(callbacks)](boost::system::error_code ec) mutable {
+            for (auto& callback : callbacks) {
+                std::move(callback)(ec);
+            }
+        }),
+        batch.qos,
+        batch.retain,
+        content_type(batch.format),
+        batch.priority,
+        std::exchange(batch.trace_id, 0)
+    );
+}
+
+std::string PublishBatcher::combine(const Batch& batch)
+{
+    if (batch.format == PayloadFormat::Cbor || batch.format == PayloadFormat::MsgPack) {
+        return combineBinary(batch);
+    }
+
+    auto trimmed = [](const std::string& payload) {
+        auto end = payload.find_last_not_of(" \t\r\n");
+        return std::string_view(payload).substr(0, end == std::string::npos ? 0 : end + 1);
+    };
+
+    size_t total = 2;
+    for (const auto& payload : batch.payloads) total += payload.size() + 1;
+
+    std::string result;
+    result.reserve(total);
+    switch (batch.config.mode) {
+    case BatchConfig::Mode::JsonArray:
+        result += '[';
+        for (size_t i = 0; i < batch.payloads.size(); ++i) {
+            if (i > 0) result += ',';
+            result += trimmed(batch.payloads[i]);
+        }
+        result += ']';
+        break;
+    case BatchConfig::Mode::Lines:
+        for (const auto& payload : batch.payloads) {
+            result += trimmed(payload);
+            result += '\n';
+        }
+        break;
+    }
+    return result;
+}
+
+std::string PublishBatcher::combineBinary(const Batch& batch)
+{
+    std::string result;
+    size_t total = 9;
+    for (const auto& payload : batch.payloads) total += payload.size();
+    result.reserve(total);
+
+    // Each item is already a complete CBOR/MessagePack value, so an array is
+    // just the array header followed by the items back to back.
+    if (batch.config.mode == BatchConfig::Mode::JsonArray) {
+        const uint32_t n = static_cast<uint32_t>(batch.payloads.size());
+        auto put_be = [&result](uint32_t v, int bytes) {
+            for (int i = bytes - 1; i >= 0; --i) result += static_cast<char>((v >> (i * 8)) & 0xFF);
+        };
+        if (batch.format == PayloadFormat::Cbor) {
+            if (n < 24)            { result += static_cast<char>(0x80 | n); }
+            else if (n <= 0xFF)    { result += static_cast<char>(0x98); put_be(n, 1); }
+            else if (n <= 0xFFFF)  { result += static_cast<char>(0x99); put_be(n, 2); }
+            else                   { result += static_cast<char>(0x9A); put_be(n, 4); }
+        } else {
+            if (n < 16)            { result += static_cast<char>(0x90 | n); }
+            else if (n <= 0xFFFF)  { result += static_cast<char>(0xDC); put_be(n, 2); }
+            else                   { result += static_cast<char>(0xDD); put_be(n, 4); }
+        }
+    }
+    for (const auto& payload : batch.payloads) {
+        result += payload;
+    }
+    return result;
+}
@@ -0,0 +1,63 @@
+#ifndef TCP_MQTT_BRIDGE_PUBLISH_BATCHER_HPP
+#define TCP_MQTT_BRIDGE_PUBLISH_BATCHER_HPP
+
+#include "packet_processor.hpp"
+#include "mqtt_client.hpp"
+
+#include <boost/asio.hpp>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Collects rendered payloads for the same topic and sends them as a single
+// publish once max_batch payloads are queued or linger_ms has elapsed.
+// Every callback passed to add() is invoked with the result of the publish
+// that carried its payload. CBOR and MessagePack payloads are combined into
+// an array (json_array) or a plain item sequence (lines).
+class PublishBatcher {
+public:
+    PublishBatcher(boost::asio::io_context& ioc, MqttClient& mqtt_client);
+
+    PublishBatcher(const PublishBatcher&) = delete;
+    PublishBatcher& operator=(const PublishBatcher&) = delete;
+
+    // Batches the message if its packet asks for it, publishes it right away otherwise.
+    void submit(const PacketProcessor::MqttMessage& message, MqttClient::PublishCallback callback);
+    void add(const PacketProcessor::MqttMessage& message, MqttClient::PublishCallback callback);
+    // Submits every message decoded from one frame. on_complete runs once,
+    // after the last of them has been published, with the first error seen.
+    void submitFrame(const std::vector<PacketProcessor::MqttMessage>& messages, MqttClient::PublishCallback on_complete);
+    void flushAll();
+
+private:
+    struct Batch {
+        explicit Batch(boost::asio::io_context& ioc) : timer(ioc) {}
+
+        BatchConfig config;
+        PayloadFormat format = PayloadFormat::Template;
+        uint8_t qos = 0;
+        bool retain = false;
+        Priority priority = Priority::Normal;
+        uint64_t trace_id = 0;      // first sampled payload; the publish is traced under it
+        std::vector<std::string> payloads;
+        std::vector<MqttClient::PublishCallback> callbacks;
+        boost::asio::steady_timer timer;
+        uint64_t generation = 0;    // of the armed linger timer, 0 once flushed
+    };
+
+    void flush(const std::string& topic, Batch& batch);
+    static std::string combine(const Batch& batch);
+    static std::string combineBinary(const Batch& batch);
+
+    boost::asio::io_context& ioc_;
+    MqttClient& mqtt_client_;
+    // Only topics with payloads waiting; a flushed batch is erased, so
+    // per-device topics do not pile up.
+    std::unordered_map<std::string, std::unique_ptr<Batch>> batches_;
+    // Unique across batches, so a linger timer never fires for a later
+    // batch on the same topic.
+    uint64_t generation_ = 0;
+};
+
+#endif // TCP_MQTT_BRIDGE_PUBLISH_BATCHER_HPP
@@ -0,0 +1,45 @@
+#ifndef TCP_MQTT_BRIDGE_RATE_LIMITER_HPP
+#define TCP_MQTT_BRIDGE_RATE_LIMITER_HPP
+
+#include <algorithm>
+#include <chrono>
+
+// Classic token bucket: refills at `rate` tokens per second up to `burst`.
+// A rate of 0 means unlimited.
+class TokenBucket {
+public:
+    using clock = std::chrono::steady_clock;
+
+    TokenBucket() = default;
+    TokenBucket(double rate, double burst)
+        : rate_(rate), burst_(std::max(burst, 1.0)), tokens_(burst_), last_(clock::now()) {}
+
+    bool unlimited() const { return rate_ <= 0; }
+
+    // Time until `n` tokens are available; zero if they are available now.
+    clock::duration waitFor(double n, clock::time_point now) {
+        if (unlimited()) return clock::duration::zero();
+        refill(now);
+        n = std::min(n, burst_);
+        if (tokens_ >= n) return clock::duration::zero();
+        return std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>((n - tokens_) / rate_));
+    }
+
+    void consume(double n) {
+        if (!unlimited()) tokens_ -= std::min(n, burst_);
+    }
+
+private:
+    void refill(clock::time_point now) {
+        double elapsed = std::chrono::duration<double>(now - last_).count();
+        tokens_ = std::min(burst_, tokens_ + elapsed * rate_);
+        last_ = now;
+    }
+
+    double rate_ = 0;
+    double burst_ = 1;
+    double tokens_ = 1;
+    clock::time_point last_ = clock::now();
+};
+
+#endif // TCP_MQTT_BRIDGE_RATE_LIMITER_HPP
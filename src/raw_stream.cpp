@@ -0,0 +1,162 @@
+#include "raw_stream.hpp"
+#include "metrics.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <cstring>
+#include <optional>
+#include <type_traits>
+
+namespace framing {
+
+namespace {
+
+// The id value as the packet carries it, or nothing if it is wider than the
+// eight bytes an index key holds.
+std::optional<std::vector<uint8_t>> wire_bytes(const FieldDesc& field, const FieldValue& value) {
+    return std::visit([&field](const auto& v) -> std::optional<std::vector<uint8_t>> {
+        using T = std::decay_t<decltype(v)>;
+        if constexpr (std::is_arithmetic_v<T>) {
+            std::vector<uint8_t> bytes(sizeof(T));
+            std::memcpy(bytes.data(), &v, sizeof(T));
+            if (field.big_endian) std::reverse(bytes.begin(), bytes.end());
+            return bytes;
+        } else if constexpr (std::is_same_v<T, std::vector<uint8_t>>) {
+            if (v.size() > sizeof(uint64_t)) return std::nullopt;
+            return v;
+        } else {
+            return std::nullopt;
+        }
+    }, value.value());
+}
+
+uint64_t read_key(const uint8_t* p, size_t width) {
+    uint64_t key = 0;
+    for (size_t i = 0; i < width; ++i) key |= uint64_t(p[i]) << (8 * i);
+    return key;
+}
+
+}
+
+RawStream::RawStream(const PacketDbStore& packet_db, RawLimits limits)
+    : packet_db_(packet_db)
+    , limits_(limits)
+    , ring_(std::make_unique<MirroredRing>(limits.ring_bytes))
+{
+}
+
+void RawStream::buildIndex(PacketDbSnapshotPtr snapshot) {
+    snapshot_ = std::move(snapshot);
+    groups_.clear();
+    const auto& db = snapshot_->db();
+    for (size_t i = 0; i < db.size(); ++i) {
+        const auto& packet = db[i];
+        const auto& id_field = packet.fields[packet.id_field_index];
+        auto bytes = wire_bytes(id_field, packet.id_value);
+        size_t size = packet_total_size(packet);
+        if (!bytes || bytes->empty()) {
+            spdlog::warn("Packet {} cannot be found in raw streams: its id is wider than 8 bytes", packet.name);
+            continue;
+        }
+        if (size > ring_->capacity()) {
+            spdlog::warn("Packet {} ({} bytes) cannot be found in raw streams: larger than the {} byte ring",
+                         packet.name, size, ring_->capacity());
+            continue;
+        }
+        auto group = std::find_if(groups_.begin(), groups_.end(), [&](const IdGroup& g) {
+            return g.offset == id_field.offset && g.width == bytes->size();
+        });
+        if (group == groups_.end()) {
+            group = groups_.insert(groups_.end(), IdGroup{id_field.offset, bytes->size(), {}});
+        }
+        // try_emplace keeps the earlier definition of a duplicate id.
+        group->ids.try_emplace(read_key(bytes->data(), bytes->size()), Candidate{i, size});
+    }
+}
+
+void RawStream::findNext() {
+    static auto& resync = metrics::counter("raw_resync_bytes_total", "Bytes of raw streams skipped while looking for a packet id");
+    static auto& dropped = metrics::counter("raw_resync_dropped_total", "Raw stream buffers dropped after too long a resync");
+
+    next_size_ = 0;
+    if (auto snapshot = packet_db_.load(); snapshot != snapshot_) buildIndex(std::move(snapshot));
+
+    for (;;) {
+        auto data = ring_->data();
+        if (data.empty()) return;
+
+        std::optional<Candidate> match;
+        bool undecided = false;     // a group's id lies beyond the buffered bytes
+        for (const auto& group : groups_) {
+            if (data.size() < group.offset + group.width) {
+                undecided = true;
+                continue;
+            }
+            auto it = group.ids.find(read_key(data.data() + group.offset, group.width));
+            if (it != group.ids.end() && (!match || it->second.index < match->index)) match = it->second;
+        }
+        if (match) {
+            skipped_ = 0;
+            // A partial packet stays buffered until the rest arrives.
+            if (match->size <= data.size()) next_size_ = match->size;
+            return;
+        }
+        if (undecided) return;
+
+        ring_->consume(1);
+        resync.inc();
+        if (++skipped_ > limits_.max_resync_bytes) {
+            dropped.inc();
+            spdlog::warn("No packet id found in {} bytes of raw stream, dropping {} buffered bytes",
+                         skipped_, ring_->size());
+            ring_->clear();
+            skipped_ = 0;
+            return;
+        }
+    }
+}
+
+void RawStream::append(std::span<const uint8_t> data) {
+    static auto& overflow = metrics::counter("raw_overflow_bytes_total", "Raw stream bytes dropped because the session ring was full");
+    if (data.size() > ring_->space()) {
+        // The stream continues mid-packet; the resync finds the next one.
+        overflow.inc(data.size());
+        spdlog::debug("Raw stream ring full, dropping {} bytes", data.size());
+        return;
+    }
+    ring_->write(data);
+    high_water_ = std::max(high_water_, ring_->size());
+    if (next_size_ == 0) findNext();
+}
+
+void RawStream::pop() {
+    ring_->consume(next_size_);
+    findNext();
+}
+
+void RawStream::decode(std::span<const uint8_t> data) {
+    while (!data.empty()) {
+        auto chunk = data.first(std::min(data.size(), ring_->space()));
+        data = data.subspan(chunk.size());
+        append(chunk);
+        for (auto packet = front(); !packet.empty(); packet = front()) {
+            if (onPacket_) onPacket_(packet);
+            pop();
+        }
+        // Cannot happen while packets are limited to the ring size, but an
+        // empty chunk would loop forever.
+        if (chunk.empty()) {
+            reset();
+            return;
+        }
+    }
+}
+
+void RawStream::reset() {
+    ring_->clear();
+    next_size_ = 0;
+    skipped_ = 0;
+}
+
+}
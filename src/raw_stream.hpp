@@ -0,0 +1,80 @@
+#ifndef TCP_MQTT_BRIDGE_RAW_STREAM_HPP
+#define TCP_MQTT_BRIDGE_RAW_STREAM_HPP
+
+#include "mirrored_ring.hpp"
+#include "packet_db_snapshot.hpp"
+#include "slip.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+namespace framing {
+
+struct RawLimits {
+    size_t ring_bytes = 64 * 1024;      // buffered per session; reads that do not fit are dropped
+    size_t max_resync_bytes = 4096;     // unmatched bytes skipped before the buffer is dropped
+};
+
+// Unframed streams of back-to-back fixed-size packets. Bytes go into a
+// mirrored ring and packet boundaries come from the definitions: the id
+// field at the head of the buffer selects the packet, whose size says where
+// the next one starts. A packet split across reads stays in the ring until
+// the rest arrives. Bytes that match no packet id are skipped one at a time;
+// after max_resync_bytes of them the buffer is dropped and matching starts
+// again with the next read.
+//
+// Packets are handed out as spans into the ring, so they are parsed where
+// they were received.
+class RawStream {
+public:
+    RawStream(const PacketDbStore& packet_db, RawLimits limits);
+
+    // Push interface, like the framed decoders: every complete packet goes
+    // to the handler as soon as it is buffered.
+    void setPacketHandler(slip::PacketHandler handler) { onPacket_ = std::move(handler); }
+    void decode(std::span<const uint8_t> data);
+    void reset();
+    size_t bufferCapacity() const { return ring_->capacity(); }
+    size_t highWater() const { return high_water_; }
+
+    // Pull interface for sessions, which parse a packet when the scheduler
+    // gives them a turn. append() drops the read if it does not fit.
+    void append(std::span<const uint8_t> data);
+    // The next complete packet, or an empty span; valid until append() or pop().
+    std::span<const uint8_t> front() const { return ring_->data().first(next_size_); }
+    void pop();
+
+private:
+    // Packets whose id field has the same offset and width share a group;
+    // ids are keyed by their wire bytes read as a little-endian integer.
+    struct Candidate {
+        size_t index;           // position in the definitions; the first match wins, as in scan_packets
+        size_t size;
+    };
+    struct IdGroup {
+        size_t offset;
+        size_t width;
+        std::unordered_map<uint64_t, Candidate> ids;
+    };
+
+    void buildIndex(PacketDbSnapshotPtr snapshot);
+    void findNext();
+
+    const PacketDbStore& packet_db_;
+    RawLimits limits_;
+    std::unique_ptr<MirroredRing> ring_;
+    PacketDbSnapshotPtr snapshot_;      // definitions the index was built from
+    std::vector<IdGroup> groups_;
+    size_t next_size_ = 0;              // size of the complete packet at the head, 0 if none
+    size_t skipped_ = 0;                // unmatched bytes since the last packet
+    size_t high_water_ = 0;
+    slip::PacketHandler onPacket_;
+};
+
+}
+
+#endif // TCP_MQTT_BRIDGE_RAW_STREAM_HPP
@@ -0,0 +1,130 @@
+#ifndef TCP_MQTT_BRIDGE_RING_BUFFER_HPP
+#define TCP_MQTT_BRIDGE_RING_BUFFER_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <utility>
+
+// Bounded lock-free queues for handing frames between threads. Capacities
+// are rounded up to a power of two. Slots are reused, so T must be default
+// constructible and movable.
+
+inline constexpr size_t CACHE_LINE = 64;
+
+// One producer thread, one consumer thread.
+template <typename T>
+class SpscRing {
+public:
+    explicit SpscRing(size_t capacity)
+        : mask_(std::bit_ceil(std::max<size_t>(capacity, 2)) - 1)
+        , slots_(std::make_unique<T[]>(mask_ + 1))
+    {
+    }
+
+    // Fails when the ring is full; value is left untouched in that case.
+    bool push(T& value) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_cache_ > mask_) {
+            head_cache_ = head_.load(std::memory_order_acquire);
+            if (tail - head_cache_ > mask_) return false;
+        }
+        slots_[tail & mask_] = std::move(value);
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    std::optional<T> pop() {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_cache_) {
+            tail_cache_ = tail_.load(std::memory_order_acquire);
+            if (head == tail_cache_) return std::nullopt;
+        }
+        std::optional<T> value(std::move(slots_[head & mask_]));
+        slots_[head & mask_] = T{};
+        head_.store(head + 1, std::memory_order_release);
+        return value;
+    }
+
+    size_t capacity() const { return mask_ + 1; }
+
+private:
+    const size_t mask_;
+    std::unique_ptr<T[]> slots_;
+    // Each side caches the other's index so the shared line is only read
+    // when the ring looks full (producer) or empty (consumer).
+    alignas(CACHE_LINE) std::atomic<size_t> tail_{0};
+    size_t head_cache_ = 0;
+    alignas(CACHE_LINE) std::atomic<size_t> head_{0};
+    size_t tail_cache_ = 0;
+};
+
+// Any number of producer threads, one consumer thread. Each slot carries a
+// sequence number telling producers and the consumer whose turn it is, so a
+// slow producer never exposes a half-written slot. Items from one producer
+// are popped in the order it pushed them.
+template <typename T>
+class MpscRing {
+public:
+    explicit MpscRing(size_t capacity)
+        : mask_(std::bit_ceil(std::max<size_t>(capacity, 2)) - 1)
+        , cells_(std::make_unique<Cell[]>(mask_ + 1))
+    {
+        for (size_t i = 0; i <= mask_; ++i) {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    bool push(T& value) {
+        size_t pos = tail_.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = cells_[pos & mask_];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos);
+            if (diff == 0) {
+                if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.value = std::move(value);
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Consumer side only.
+    bool empty() const {
+        return cells_[head_ & mask_].sequence.load(std::memory_order_acquire) != head_ + 1;
+    }
+
+    std::optional<T> pop() {
+        Cell& cell = cells_[head_ & mask_];
+        if (cell.sequence.load(std::memory_order_acquire) != head_ + 1) return std::nullopt;
+        std::optional<T> value(std::move(cell.value));
+        cell.value = T{};
+        cell.sequence.store(head_ + mask_ + 1, std::memory_order_release);
+        ++head_;
+        return value;
+    }
+
+    size_t capacity() const { return mask_ + 1; }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    const size_t mask_;
+    std::unique_ptr<Cell[]> cells_;
+    alignas(CACHE_LINE) std::atomic<size_t> tail_{0};
+    alignas(CACHE_LINE) size_t head_ = 0;
+};
+
+#endif // TCP_MQTT_BRIDGE_RING_BUFFER_HPP
@@ -1,60 +1,338 @@
 #include "server_manager.hpp"
 #include "connection_manager.hpp"
+#include "packet_db_loader.hpp"
+#include "metrics.hpp"
+#include "handler_memory.hpp"
+#include "trace.hpp"
+#include "tls.hpp"
 #include <spdlog/spdlog.h>
+#include <csignal>
 
-ServerManager::ServerManager(const Configuration& config, const PacketDb& packet_db)
-    : config_(config)
-    , server_(io_ctx_, 
-             boost::asio::ip::make_address(config.tcp.bind_address), 
-             config.tcp.port)
+ServerManager::ServerManager(const Configuration& config, PacketDbStore& packet_db)
+    : columnar_(config.columnar.directory.empty() ? nullptr : std::make_unique<columnar::ColumnarSink>(config.columnar))
     , mqtt_client_(std::make_unique<MqttClient>(io_ctx_, config.mqtt))
+    , batcher_(std::make_unique<PublishBatcher>(io_ctx_, *mqtt_client_))
+    , downlink_(std::make_unique<DownlinkDispatcher>(*mqtt_client_, packet_db, router_))
+    , udp_processor_(std::make_unique<PacketProcessor>(packet_db, columnar_.get()))
+    , scheduler_(std::make_unique<FairScheduler>(io_ctx_, config.scheduler.quantum_bytes, config.scheduler.budget_bytes))
+    , config_(config)
     , packet_db_(packet_db)
+    , reload_signals_(io_ctx_, SIGHUP)
+    , watch_timer_(io_ctx_)
+    , metrics_timer_(io_ctx_)
+    , trace_signals_(io_ctx_)
+    , trace_timer_(io_ctx_)
+    , memory_timer_(io_ctx_)
+    , soak_timer_(io_ctx_)
 {
-    setupEventHandlers();
+    if (config_.pipeline.workers > 0) {
+        pipeline_ = std::make_unique<Pipeline>(io_ctx_, packet_db_, config_.pipeline.workers, config_.pipeline.queue_capacity,
+                                               columnar_.get());
+    }
+    if (!config_.capture.path.empty()) {
+        capture_ = std::make_shared<capture::Writer>(config_.capture.path);
+    }
+    for (const auto& listener : config_.allListeners()) {
+        auto server = std::make_unique<TcpServer>(io_ctx_,
+            boost::asio::ip::make_address(listener.bind_address),
+            listener.port);
+        server->setEvents(makeEventHandlers(listener));
+        if (listener.tls.enabled) {
+            server->setTls(std::make_shared<boost::asio::ssl::context>(tls::make_server_context(listener.tls)));
+        }
+        if (capture_) {
+            server->setCapture(capture_, static_cast<uint8_t>(framing::parse_kind(listener.framing)));
+        }
+        servers_.push_back(std::move(server));
+    }
+    for (const auto& listener : config_.udp) {
+        auto server = std::make_unique<UdpServer>(io_ctx_,
+            boost::asio::ip::make_address(listener.bind_address),
+            listener.port, listener.batch, listener.max_datagram);
+        server->setHandler([this, &server = *server, ack = listener.ack](const auto& from, std::span<const uint8_t> data) {
+            handleDatagram(server, ack, from, data);
+        });
+        server->start();
+        udp_servers_.push_back(std::move(server));
+    }
+    waitForReloadSignal();
+    if (config_.packet_defs.watch_interval_ms > 0) {
+        defs_fingerprint_ = packet_defs_fingerprint(config_.packet_defs);
+        scheduleDefsWatch();
+    }
+    if (config_.metrics.log_interval_s > 0) {
+        scheduleMetricsLog();
+    }
+    if (config_.trace.sample_every > 0) {
+        trace::configure(config_.trace.sample_every, config_.trace.buffer_events);
+        trace_signals_.add(SIGUSR1);
+        waitForTraceSignal();
+        if (config_.trace.dump_interval_s > 0) {
+            scheduleTraceDump();
+        }
+    }
+    if (config_.metrics.port > 0) {
+        metrics_server_ = std::make_unique<MetricsServer>(io_ctx_,
+            boost::asio::ip::make_address(config_.metrics.bind_address), config_.metrics.port);
+        metrics_server_->addRoute("/memory", [this] {
+            auto report = collectMemory();
+            report.publish();
+            return report.render();
+        });
+    }
+    if (config_.memory.soak_duration_s > 0) {
+        startSoak();
+    }
+    if (config_.memory.sample_interval_s > 0 || soak_) {
+        scheduleMemorySample();
+    }
+    mqtt_client_->setMessageHandler([this](const std::string& topic, const std::string& payload) {
+        downlink_->handleMessage(topic, payload);
+    });
     mqtt_client_->connect();
+    downlink_->subscribe();
 }
 
-void ServerManager::setupEventHandlers() {
+TcpEvents ServerManager::makeEventHandlers(const Configuration::TcpConfig& listener) {
     TcpEvents events;
-    events.onConnect = [this](auto& socket, auto context) {
-        auto manager = std::make_shared<ConnectionManager>(socket, packet_db_, *mqtt_client_);
+    framing::RawLimits raw{listener.raw_ring_bytes, listener.raw_max_resync_bytes};
+    events.onConnect = [this, framing = framing::parse_kind(listener.framing), limits = listener.rate_limit, raw](auto& stream, auto context) {
+        auto manager = std::make_shared<ConnectionManager>(stream, packet_db_, *mqtt_client_, *batcher_, router_, *scheduler_,
+                                                           pipeline_.get(), limits, framing, raw, columnar_.get());
         context->set("connection_manager", manager);
+        connections_.emplace(manager.get(), manager);
         spdlog::info("New client connected from {}", manager->address());
     };
 
-    events.onDisconnect = [](auto& socket, auto context) {
+    events.onDisconnect = [this](auto& stream, auto context) {
         if (auto* manager = context->template get_if<std::shared_ptr<ConnectionManager>>("connection_manager")) {
+            (*manager)->close();
+            connections_.erase(manager->get());
             spdlog::info("Client disconnected from {}", (*manager)->address());
         }
     };
 
-    events.onDataReceived = [](auto& socket, auto context, std::span<const uint8_t> data) {
+    events.onDataReceived = [](auto& stream, auto context, std::span<const uint8_t> data) {
         if (auto* manager = context->template get_if<std::shared_ptr<ConnectionManager>>("connection_manager")) {
             (*manager)->handleData(data);
         }
     };
-    
-    server_.setEvents(std::move(events));
+
+    return events;
+}
+
+void ServerManager::handleDatagram(UdpServer& server, bool ack, const UdpServer::endpoint_type& from,
+                                   std::span<const uint8_t> data) {
+    uint64_t trace_id = trace::sample();
+    trace::record(trace_id, trace::Stage::FrameComplete);
+    auto messages = udp_processor_->processFrame(data, {}, trace_id);
+    if (!messages || messages->empty()) {
+        if (ack) server.sendTo(from, {messages ? slip::ACK : slip::NAK});
+        trace::record(trace_id, trace::Stage::AckWritten);
+        return;
+    }
+    batcher_->submitFrame(*messages, handler_memory::bind([&server, ack, from, trace_id](boost::system::error_code ec) {
+        if (ack) server.sendTo(from, {ec ? slip::NAK : slip::ACK});
+        trace::record(trace_id, trace::Stage::AckWritten);
+    }));
+}
+
+void ServerManager::waitForReloadSignal() {
+    reload_signals_.async_wait([this](boost::system::error_code ec, int) {
+        if (ec) return;
+        spdlog::info("SIGHUP received, reloading packet definitions");
+        reloadPacketDb();
+        waitForReloadSignal();
+    });
+}
+
+void ServerManager::scheduleDefsWatch() {
+    watch_timer_.expires_after(std::chrono::milliseconds(config_.packet_defs.watch_interval_ms));
+    watch_timer_.async_wait([this](boost::system::error_code ec) {
+        if (ec) return;
+        // Walking and stat'ing the files can stall on slow or network
+        // filesystems, so it runs on the reload thread like the reload itself.
+        boost::asio::post(reload_pool_, [this] {
+            std::optional<uint64_t> fingerprint;
+            try {
+                fingerprint = packet_defs_fingerprint(config_.packet_defs);
+            } catch (const std::exception& e) {
+                spdlog::warn("Cannot check packet definition files: {}", e.what());
+            }
+            boost::asio::post(io_ctx_, [this, fingerprint] {
+                if (stopped_) return;
+                if (fingerprint && *fingerprint != defs_fingerprint_) {
+                    defs_fingerprint_ = *fingerprint;
+                    spdlog::info("Packet definition files changed, reloading");
+                    reloadPacketDb();
+                }
+                scheduleDefsWatch();
+            });
+        });
+    });
+}
+
+void ServerManager::scheduleMetricsLog() {
+    metrics_timer_.expires_after(std::chrono::seconds(config_.metrics.log_interval_s));
+    metrics_timer_.async_wait([this](boost::system::error_code ec) {
+        if (ec) return;
+        spdlog::info("Metrics: {}", metrics::Registry::instance().renderSummary());
+        scheduleMetricsLog();
+    });
+}
+
+void ServerManager::waitForTraceSignal() {
+    trace_signals_.async_wait([this](boost::system::error_code ec, int) {
+        if (ec) return;
+        trace::dump(config_.trace.output);
+        waitForTraceSignal();
+    });
+}
+
+void ServerManager::scheduleTraceDump() {
+    trace_timer_.expires_after(std::chrono::seconds(config_.trace.dump_interval_s));
+    trace_timer_.async_wait([this](boost::system::error_code ec) {
+        if (ec) return;
+        trace::dump(config_.trace.output);
+        scheduleTraceDump();
+    });
+}
+
+memstats::Report ServerManager::collectMemory() {
+    memstats::Report report;
+    for (const auto& [key, weak] : connections_) {
+        if (auto manager = weak.lock()) report.addConnection(manager->address(), manager->memoryUsage());
+    }
+    report.keepTop(config_.memory.top_n);
+    report.mqtt_pending = mqtt_client_->pendingBytes();
+    report.packet_db = packet_db_.load()->memoryUsage();
+    report.rss = memstats::rss_bytes();
+    return report;
+}
+
+void ServerManager::scheduleMemorySample() {
+    // A soak test needs samples even when the config asks for none.
+    uint32_t interval_s = config_.memory.sample_interval_s > 0 ? config_.memory.sample_interval_s : 10;
+    memory_timer_.expires_after(std::chrono::seconds(interval_s));
+    memory_timer_.async_wait([this](boost::system::error_code ec) {
+        if (ec) return;
+        auto report = collectMemory();
+        report.publish();
+        if (soak_) soak_->sample(report);
+        scheduleMemorySample();
+    });
+}
+
+void ServerManager::startSoak() {
+    const auto& memory = config_.memory;
+    soak_.emplace(std::chrono::seconds(memory.soak_warmup_s), memory.soak_max_growth);
+    spdlog::info("Soak test: running for {}s, ignoring the first {}s, allowing {:.0f}% memory growth",
+                 memory.soak_duration_s, memory.soak_warmup_s, memory.soak_max_growth * 100.0);
+    soak_timer_.expires_after(std::chrono::seconds(memory.soak_duration_s));
+    soak_timer_.async_wait([this](boost::system::error_code ec) {
+        if (ec) return;
+        soak_->sample(collectMemory());
+        if (soak_->flat()) {
+            spdlog::info("Soak test passed: {}", soak_->summary());
+        } else {
+            soak_failed_ = true;
+            spdlog::error("Soak test failed, memory kept growing: {}", soak_->summary());
+        }
+        stop();
+    });
+}
+
+void ServerManager::reloadPacketDb() {
+    if (reloading_) {
+        spdlog::warn("Packet definition reload already in progress");
+        return;
+    }
+    reloading_ = true;
+
+    // Parsing and template compilation run off the I/O thread; only the
+    // pointer swap happens back on it.
+    boost::asio::post(reload_pool_, [this] {
+        PacketDbSnapshotPtr snapshot;
+        try {
+            snapshot = std::make_shared<const PacketDbSnapshot>(load_packet_db(config_.packet_defs));
+        } catch (const std::exception& e) {
+            spdlog::error("Packet definition reload failed, keeping current definitions: {}", e.what());
+        }
+        boost::asio::post(io_ctx_, [this, snapshot = std::move(snapshot)]() mutable {
+            reloading_ = false;
+            if (!snapshot) return;
+            spdlog::info("Reloaded {} packet definitions", snapshot->db().size());
+            checkOutputs(snapshot->db());
+            packet_db_.store(std::move(snapshot));
+            downlink_->subscribe();
+        });
+    });
+}
+
+void ServerManager::checkOutputs(const PacketDb& db) const {
+    if (columnar_) return;
+    for (const auto& packet : db) {
+        if (packet.output.columnar) {
+            spdlog::warn("Packet {} has a columnar output but columnar.directory is not set; {}", packet.name,
+                         packet.output.mqtt ? "it is only published" : "it is ACKed and discarded");
+        }
+    }
 }
 
 void ServerManager::run() {
-    spdlog::info("TCP server listening on {}:{}", 
-                 config_.tcp.bind_address, config_.tcp.port);
+    for (const auto& listener : config_.allListeners()) {
+        spdlog::info("TCP server listening on {}:{} ({} framing{})",
+                     listener.bind_address, listener.port, listener.framing, listener.tls.enabled ? ", TLS" : "");
+    }
+    for (const auto& listener : config_.udp) {
+        spdlog::info("UDP server listening on {}:{}", listener.bind_address, listener.port);
+    }
+    if (pipeline_) {
+        spdlog::info("Rendering on {} worker threads", config_.pipeline.workers);
+    }
+    checkOutputs(packet_db_.load()->db());
+    if (config_.metrics.port > 0) {
+        spdlog::info("Metrics endpoint on http://{}:{}/metrics (memory report on /memory)",
+                     config_.metrics.bind_address, config_.metrics.port);
+    }
     spdlog::info("MQTT broker connection to {}:{}", config_.mqtt.host, config_.mqtt.port);
     io_ctx_.run();
 }
 
 ServerManager::~ServerManager() {
     stop();
+    reload_pool_.join();
 }
 
 void ServerManager::stop() {
     if (!stopped_) {
         stopped_ = true;
+        boost::system::error_code ec;
+        reload_signals_.cancel(ec);
+        watch_timer_.cancel();
+        metrics_timer_.cancel();
+        trace_signals_.cancel(ec);
+        trace_timer_.cancel();
+        memory_timer_.cancel();
+        soak_timer_.cancel();
+        if (metrics_server_) {
+            metrics_server_->stop();
+        }
+        for (auto& server : udp_servers_) {
+            server->stop();
+        }
+        if (pipeline_) {
+            pipeline_->stop();
+        }
+        if (batcher_) {
+            batcher_->flushAll();
+        }
+        if (capture_) {
+            capture_->flush();
+        }
         if (mqtt_client_) {
             mqtt_client_->stop();
         }
-        boost::system::error_code ec;
         io_ctx_.stop();
     }
 }
@@ -3,15 +3,33 @@
 
 #include "config.hpp"
 #include "tcp_server.hpp"
+#include "udp_server.hpp"
+#include "packet_processor.hpp"
 #include "packet_parser.hpp"
 #include "packet_parser_yaml.hpp"
-#include "slip.hpp"
+#include "packet_db_snapshot.hpp"
+#include "framing.hpp"
 #include "mqtt_client.hpp"
+#include "publish_batcher.hpp"
+#include "device_router.hpp"
+#include "downlink.hpp"
+#include "fair_scheduler.hpp"
+#include "pipeline.hpp"
+#include "metrics_server.hpp"
+#include "capture.hpp"
+#include "columnar_sink.hpp"
+#include "memory_stats.hpp"
 #include <boost/asio.hpp>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+class ConnectionManager;
 
 class ServerManager {
 public:
-    explicit ServerManager(const Configuration& config, const PacketDb& packet_db);
+    explicit ServerManager(const Configuration& config, PacketDbStore& packet_db);
     ~ServerManager();
 
     ServerManager(const ServerManager&) = delete;
@@ -20,15 +38,64 @@ public:
     void run();
     void stop();
 
+    // Rebuilds the packet database in the background and swaps it in.
+    void reloadPacketDb();
+
+    // Memory held by live connections, queued publishes and the packet
+    // database. Must be called on the I/O thread.
+    memstats::Report collectMemory();
+
+    // True once a soak test (memory.soak.duration_s) has ended with memory
+    // still growing.
+    bool soakFailed() const { return soak_failed_; }
+
 private:
-    void setupEventHandlers();
+    TcpEvents makeEventHandlers(const Configuration::TcpConfig& listener);
+    void handleDatagram(UdpServer& server, bool ack, const UdpServer::endpoint_type& from, std::span<const uint8_t> data);
+    void waitForReloadSignal();
+    void scheduleDefsWatch();
+    void scheduleMetricsLog();
+    void waitForTraceSignal();
+    void scheduleTraceDump();
+    void scheduleMemorySample();
+    void startSoak();
+    // Warns about packets asking for an output that is not configured.
+    void checkOutputs(const PacketDb& db) const;
 
+    // Declared before the io_context: connections still referenced by pending
+    // handlers unregister themselves when those handlers are destroyed.
+    DeviceRouter router_;
+    // Open connections for collectMemory(), removed on disconnect. Weak, as
+    // a session's last handlers may still hold it briefly after that.
+    std::unordered_map<const ConnectionManager*, std::weak_ptr<ConnectionManager>> connections_;
+    std::shared_ptr<capture::Writer> capture_;
+    // Before the processors that write to it, so it outlives them.
+    std::unique_ptr<columnar::ColumnarSink> columnar_;
     boost::asio::io_context io_ctx_;
-    TcpServer server_;
+    std::vector<std::unique_ptr<TcpServer>> servers_;
     std::unique_ptr<MqttClient> mqtt_client_;
+    std::unique_ptr<PublishBatcher> batcher_;
+    std::unique_ptr<DownlinkDispatcher> downlink_;
+    std::unique_ptr<PacketProcessor> udp_processor_;
+    std::vector<std::unique_ptr<UdpServer>> udp_servers_;
+    std::unique_ptr<FairScheduler> scheduler_;
+    std::unique_ptr<Pipeline> pipeline_;
+    std::unique_ptr<MetricsServer> metrics_server_;
     const Configuration& config_;
-    const PacketDb& packet_db_;
+    PacketDbStore& packet_db_;
+    boost::asio::thread_pool reload_pool_{1};
+    boost::asio::signal_set reload_signals_;
+    boost::asio::steady_timer watch_timer_;
+    boost::asio::steady_timer metrics_timer_;
+    boost::asio::signal_set trace_signals_;
+    boost::asio::steady_timer trace_timer_;
+    boost::asio::steady_timer memory_timer_;
+    boost::asio::steady_timer soak_timer_;
+    std::optional<memstats::SoakCheck> soak_;
+    uint64_t defs_fingerprint_{0};
+    bool reloading_{false};
     bool stopped_{false};
+    bool soak_failed_{false};
 };
 
 #endif // TCP_MQTT_BRIDGE_SERVER_MANAGER_HPP
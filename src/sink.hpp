@@ -0,0 +1,27 @@
+#ifndef TCP_MQTT_BRIDGE_SINK_HPP
+#define TCP_MQTT_BRIDGE_SINK_HPP
+
+#include "packet_parser.hpp"
+#include "packet_db_snapshot.hpp"
+
+#include <cstdint>
+#include <span>
+
+// Output for decoded packets other than the broker. Each packet picks its
+// outputs with `output:`; MqttClient publishes the rendered ones, a Sink
+// takes the packet itself. A write is not acknowledged, so a frame whose
+// packets only go to sinks is ACKed as soon as it is decoded.
+//
+// write() is called on whichever thread processes the frame (the I/O thread
+// or a pipeline worker), so implementations synchronise internally.
+class Sink {
+public:
+    virtual ~Sink() = default;
+
+    // packet belongs to snapshot; bytes are the whole packet, checksums
+    // verified. timestamp_ns is the wall clock time the frame was decoded.
+    virtual void write(const PacketDbSnapshotPtr& snapshot, const PacketDesc& packet,
+                       std::span<const uint8_t> bytes, int64_t timestamp_ns) = 0;
+};
+
+#endif // TCP_MQTT_BRIDGE_SINK_HPP
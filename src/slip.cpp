@@ -24,6 +24,47 @@ std::vector<uint8_t> encode(const std::span<const uint8_t>& data) {
     return encoded;
 }
 
+size_t decode_all(std::span<const uint8_t> data, const PacketHandler& on_packet) {
+    size_t invalid = 0;
+    std::vector<uint8_t> unescaped;
+    const uint8_t* pos = data.data();
+    const uint8_t* const end = data.data() + data.size();
+    while (pos < end) {
+        auto* frame_end = static_cast<const uint8_t*>(std::memchr(pos, END, static_cast<size_t>(end - pos)));
+        if (!frame_end) break;
+        std::span<const uint8_t> frame(pos, frame_end);
+        pos = frame_end + 1;
+        if (frame.empty()) continue;
+
+        if (!std::memchr(frame.data(), ESC, frame.size())) {
+            on_packet(frame);
+            continue;
+        }
+        unescaped.clear();
+        bool valid = true;
+        for (size_t i = 0; i < frame.size(); ++i) {
+            if (frame[i] != ESC) {
+                unescaped.push_back(frame[i]);
+            } else if (i + 1 < frame.size() && frame[i + 1] == ESC_END) {
+                unescaped.push_back(END);
+                ++i;
+            } else if (i + 1 < frame.size() && frame[i + 1] == ESC_ESC) {
+                unescaped.push_back(ESC);
+                ++i;
+            } else {
+                valid = false;
+                break;
+            }
+        }
+        if (valid) {
+            on_packet(unescaped);
+        } else {
+            ++invalid;
+        }
+    }
+    return invalid;
+}
+
 std::vector<uint8_t> Decoder::decode(const std::span<const uint8_t>& data) {
     for (uint8_t byte : data) {
         processByte(byte);
@@ -36,6 +77,7 @@ void Decoder::processByte(uint8_t byte) {
         case State::Normal:
             if (byte == END) {
                 if (!buffer_.empty()) {
+                    high_water_ = std::max(high_water_, buffer_.size());
                     if (onPacket_) {
                         onPacket_(std::span<const uint8_t>(buffer_));
                     }
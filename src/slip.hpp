@@ -1,5 +1,6 @@
 #ifndef SPLIP_HPP
 #define SPLIP_HPP
+#include <algorithm>
 #include <cstdint>
 #include <span>
 #include <vector>
@@ -26,6 +27,12 @@ namespace slip {
 
     using PacketHandler = std::function<void(std::span<const uint8_t>)>;
 
+    // Decodes every END-terminated frame in a complete buffer, e.g. a file.
+    // Frames without escapes are passed without copying; frames with an
+    // invalid escape are skipped. Bytes after the last END are ignored.
+    // Returns the number of skipped frames.
+    size_t decode_all(std::span<const uint8_t> data, const PacketHandler& on_packet);
+
     class Decoder {
     public:
         Decoder() : state_(State::Normal) {}
@@ -49,6 +56,14 @@ namespace slip {
         void clearBuffer() {
             buffer_.clear();
         }
+        // Bytes allocated for frame reassembly.
+        size_t bufferCapacity() const {
+            return buffer_.capacity();
+        }
+        // Largest frame buffered so far, including one still in progress.
+        size_t highWater() const {
+            return std::max(high_water_, buffer_.size());
+        }
         static std::vector<uint8_t> makeResponse(uint8_t type) {
             return encode(std::span<const uint8_t>(&type, 1));
         }
@@ -60,6 +75,7 @@ namespace slip {
 
         State state_;
         std::vector<uint8_t> buffer_;
+        size_t high_water_ = 0;
         PacketHandler onPacket_;
 
         void processByte(uint8_t byte);
@@ -5,9 +5,10 @@
 #include <functional>
 #include <span>
 #include "tcp_context.hpp"
+#include "device_stream.hpp"
 
-using DataHandler = std::function<void(boost::asio::ip::tcp::socket&, std::shared_ptr<TcpContext>, std::span<const uint8_t>)>;
-using ConnectionHandler = std::function<void(boost::asio::ip::tcp::socket&, std::shared_ptr<TcpContext>)>;
+using DataHandler = std::function<void(DeviceStream&, std::shared_ptr<TcpContext>, std::span<const uint8_t>)>;
+using ConnectionHandler = std::function<void(DeviceStream&, std::shared_ptr<TcpContext>)>;
 
 struct TcpEvents {
     DataHandler onDataReceived;
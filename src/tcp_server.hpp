@@ -21,6 +21,17 @@ public:
         events_ = std::move(events);
     }
 
+    // Sessions accepted from now on run TLS with this context.
+    void setTls(std::shared_ptr<boost::asio::ssl::context> tls) {
+        tls_ = std::move(tls);
+    }
+
+    // Captures the raw reads of every session accepted from now on.
+    void setCapture(std::shared_ptr<capture::Writer> writer, uint8_t framing) {
+        capture_ = std::move(writer);
+        capture_framing_ = framing;
+    }
+
     ~TcpServer() {
         for (auto& session : sessions_) {
             session->stop();
@@ -32,7 +43,7 @@ private:
         acceptor_.async_accept(
             [this](boost::system::error_code ec, boost::asio::ip::tcp::socket socket) {
                 if (!ec) {
-                    auto session = std::make_shared<TcpSession>(std::move(socket), events_);
+                    auto session = std::make_shared<TcpSession>(std::move(socket), tls_.get(), events_);
                     auto weak_session = std::weak_ptr<TcpSession>(session);
                     
                     session->setCloseHandler([this, weak_session] {
@@ -42,6 +53,9 @@ private:
                     });
                     
                     sessions_.insert(session);
+                    if (capture_) {
+                        session->setCapture(capture_, capture_framing_);
+                    }
                     session->start();
                 }
                 do_accept();
@@ -51,6 +65,9 @@ private:
     boost::asio::ip::tcp::acceptor acceptor_;
     TcpEvents events_;
     std::set<std::shared_ptr<TcpSession>> sessions_;
+    std::shared_ptr<boost::asio::ssl::context> tls_;
+    std::shared_ptr<capture::Writer> capture_;
+    uint8_t capture_framing_{0};
 };
 
 #endif // RAWTCP_TO_MQTT_BRIDGE_TCP_SERVER_HPP
@@ -2,7 +2,11 @@
 #define RAWTCP_TO_MQTT_BRIDGE_TCP_SESSION_HPP
 
 #include "tcp_events.hpp"
+#include "capture.hpp"
+#include "device_stream.hpp"
+#include "handler_memory.hpp"
 #include <boost/asio.hpp>
+#include <spdlog/spdlog.h>
 #include <memory>
 #include <array>
 
@@ -10,23 +14,45 @@ class TcpSession : public std::enable_shared_from_this<TcpSession> {
 public:
     using CloseHandler = std::function<void()>;
 
-    TcpSession(boost::asio::ip::tcp::socket socket, TcpEvents events)
-        : socket_(std::move(socket))
+    // tls == nullptr accepts plaintext.
+    TcpSession(boost::asio::ip::tcp::socket socket, boost::asio::ssl::context* tls, TcpEvents events)
+        : stream_(std::move(socket), tls)
         , events_(events)
         , context_(std::make_shared<TcpContext>())
     {
-        context_->set("remote_address", socket_.remote_endpoint().address().to_string());
+        context_->set("remote_address", stream_.socket().remote_endpoint().address().to_string());
         if (events_.onConnect)
-            events_.onConnect(socket_, context_);
+            events_.onConnect(stream_, context_);
     }
 
     ~TcpSession() {
+        if (capture_)
+            capture_->close(capture_id_);
         if (events_.onDisconnect)
-            events_.onDisconnect(socket_, context_);
+            events_.onDisconnect(stream_, context_);
+    }
+
+    // Records every read from this session; call before start().
+    void setCapture(std::shared_ptr<capture::Writer> writer, uint8_t framing) {
+        capture_ = std::move(writer);
+        capture_id_ = capture_->open(framing, context_->get<std::string>("remote_address"));
     }
 
     void start() {
-        do_read();
+        if (!stream_.secure()) {
+            do_read();
+            return;
+        }
+        stream_.asyncHandshake([this, self = shared_from_this()](const boost::system::error_code& ec) {
+            if (ec) {
+                if (ec != boost::asio::error::operation_aborted) {
+                    spdlog::warn("TLS handshake with {} failed: {}", context_->get<std::string>("remote_address"), ec.message());
+                    stop();
+                }
+                return;
+            }
+            do_read();
+        });
     }
 
     void setCloseHandler(CloseHandler handler) {
@@ -36,9 +62,7 @@ public:
     void stop() {
         if (!stopped_) {
             stopped_ = true;
-            boost::system::error_code ec;
-            socket_.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
-            socket_.close(ec);
+            stream_.close();
             if (closeHandler_) {
                 closeHandler_();
             }
@@ -47,26 +71,32 @@ public:
 
 private:
     void do_read() {
-        auto self = shared_from_this();
-        socket_.async_read_some(boost::asio::buffer(data_),
-            [this, self](const auto& ec, auto length) {
+        // Each read's handler memory is released before the handler runs and
+        // reused by the next read.
+        stream_.asyncReadSome(boost::asio::buffer(data_), handler_memory::bind(
+            [this, self = shared_from_this()](const boost::system::error_code& ec, size_t length) {
                 if (!ec) {
+                    if (capture_) {
+                        capture_->data(capture_id_, std::span<const uint8_t>(data_.data(), length));
+                    }
                     if (events_.onDataReceived) {
-                        events_.onDataReceived(socket_, context_, std::span<const uint8_t>(data_.data(), length));
+                        events_.onDataReceived(stream_, context_, std::span<const uint8_t>(data_.data(), length));
                     }
                     do_read();
                 } else if (ec != boost::asio::error::operation_aborted) {
                     stop();
                 }
-            });
+            }));
     }
 
-    boost::asio::ip::tcp::socket socket_;
+    DeviceStream stream_;
     std::array<uint8_t, 1024> data_;
     TcpEvents events_;
     std::shared_ptr<TcpContext> context_;
     bool stopped_{false};
     CloseHandler closeHandler_;
+    std::shared_ptr<capture::Writer> capture_;
+    uint32_t capture_id_{0};
 };
 
 #endif // RAWTCP_TO_MQTT_BRIDGE_TCP_SESSION_HPP
@@ -0,0 +1,137 @@
+#include "tls.hpp"
+#include "metrics.hpp"
+
+#include <openssl/bio.h>
+#include <openssl/ssl.h>
+
+#include <stdexcept>
+
+namespace tls {
+
+namespace {
+
+constexpr unsigned char SESSION_ID_CONTEXT[] = "tcp_mqtt_bridge";
+
+// Per client context state, kept in the SSL_CTX so the mqtt5 customization
+// point, which only sees the stream, can reach it.
+struct ClientState {
+    std::string server_name;
+    SSL_SESSION* session = nullptr;
+};
+
+void free_client_state(void*, void* ptr, CRYPTO_EX_DATA*, int, long, void*) {
+    auto* state = static_cast<ClientState*>(ptr);
+    if (!state) return;
+    if (state->session) SSL_SESSION_free(state->session);
+    delete state;
+}
+
+int client_state_index() {
+    static const int index = SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, free_client_state);
+    return index;
+}
+
+ClientState* client_state(SSL_CTX* ctx) {
+    return static_cast<ClientState*>(SSL_CTX_get_ex_data(ctx, client_state_index()));
+}
+
+// Keeps the newest session the broker handed out (TLS 1.3 tickets arrive
+// after the handshake, so this runs whenever one does).
+int remember_session(SSL* ssl, SSL_SESSION* session) {
+    auto* state = client_state(SSL_get_SSL_CTX(ssl));
+    if (!state) return 0;
+    if (state->session) SSL_SESSION_free(state->session);
+    state->session = session;
+    return 1;   // we keep the reference
+}
+
+template <typename F>
+void load(const std::string& what, const std::string& file, F&& f) {
+    try {
+        f();
+    } catch (const boost::system::system_error& e) {
+        throw std::runtime_error("TLS: cannot load " + what + " '" + file + "': " + e.what());
+    }
+}
+
+void apply_common(boost::asio::ssl::context& ctx, const Configuration::TlsConfig& config) {
+    ctx.set_options(boost::asio::ssl::context::default_workarounds |
+                    boost::asio::ssl::context::no_sslv2 |
+                    boost::asio::ssl::context::no_sslv3 |
+                    boost::asio::ssl::context::no_tlsv1 |
+                    boost::asio::ssl::context::no_tlsv1_1);
+    if (!config.cert_file.empty()) {
+        load("certificate", config.cert_file, [&] { ctx.use_certificate_chain_file(config.cert_file); });
+    }
+    if (!config.key_file.empty()) {
+        load("private key", config.key_file, [&] { ctx.use_private_key_file(config.key_file, boost::asio::ssl::context::pem); });
+    }
+}
+
+}
+
+boost::asio::ssl::context make_server_context(const Configuration::TlsConfig& config) {
+    if (config.cert_file.empty() || config.key_file.empty()) {
+        throw std::runtime_error("TLS: a listener needs both cert and key");
+    }
+    boost::asio::ssl::context ctx(boost::asio::ssl::context::tls_server);
+    apply_common(ctx, config);
+    if (!config.ca_file.empty()) {
+        load("CA file", config.ca_file, [&] { ctx.load_verify_file(config.ca_file); });
+    }
+    if (config.verify_peer) {
+        ctx.set_verify_mode(boost::asio::ssl::verify_peer | boost::asio::ssl::verify_fail_if_no_peer_cert);
+    }
+
+    SSL_CTX* native = ctx.native_handle();
+    SSL_CTX_set_session_id_context(native, SESSION_ID_CONTEXT, sizeof(SESSION_ID_CONTEXT) - 1);
+    SSL_CTX_set_session_cache_mode(native, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_sess_set_cache_size(native, static_cast<long>(config.session_cache_size));
+#ifdef SSL_OP_ENABLE_KTLS
+    if (config.ktls) {
+        SSL_CTX_set_options(native, SSL_OP_ENABLE_KTLS);
+    }
+#endif
+    return ctx;
+}
+
+boost::asio::ssl::context make_client_context(const Configuration::TlsConfig& config) {
+    boost::asio::ssl::context ctx(boost::asio::ssl::context::tls_client);
+    apply_common(ctx, config);
+    if (config.ca_file.empty()) {
+        ctx.set_default_verify_paths();
+    } else {
+        load("CA file", config.ca_file, [&] { ctx.load_verify_file(config.ca_file); });
+    }
+    ctx.set_verify_mode(config.verify_peer ? boost::asio::ssl::verify_peer : boost::asio::ssl::verify_none);
+
+    SSL_CTX* native = ctx.native_handle();
+    auto* state = new ClientState{config.server_name, nullptr};
+    SSL_CTX_set_ex_data(native, client_state_index(), state);
+    SSL_CTX_set_session_cache_mode(native, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(native, remember_session);
+    return ctx;
+}
+
+void prepare_client(SSL* ssl, const std::string& host) {
+    auto* state = client_state(SSL_get_SSL_CTX(ssl));
+    const std::string& name = state && !state->server_name.empty() ? state->server_name : host;
+    SSL_set_tlsext_host_name(ssl, name.c_str());
+    SSL_set1_host(ssl, name.c_str());
+    if (state && state->session && SSL_SESSION_is_resumable(state->session)) {
+        SSL_set_session(ssl, state->session);
+    }
+}
+
+bool record_handshake(SSL* ssl) {
+    static auto& handshakes = metrics::counter("tls_handshakes_total", "Completed TLS handshakes with devices");
+    static auto& resumed = metrics::counter("tls_resumed_total", "Device handshakes that resumed an earlier session");
+    static auto& kernel = metrics::counter("tls_ktls_total", "Device connections with kernel TLS in both directions");
+    handshakes.inc();
+    if (SSL_session_reused(ssl)) resumed.inc();
+    bool ktls = BIO_get_ktls_send(SSL_get_wbio(ssl)) && BIO_get_ktls_recv(SSL_get_rbio(ssl));
+    if (ktls) kernel.inc();
+    return ktls;
+}
+
+}
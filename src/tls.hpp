@@ -0,0 +1,35 @@
+#ifndef TCP_MQTT_BRIDGE_TLS_HPP
+#define TCP_MQTT_BRIDGE_TLS_HPP
+
+#include "config.hpp"
+
+#include <boost/asio/ssl.hpp>
+#include <string>
+
+// TLS contexts for both ends of the bridge. Errors loading certificates or
+// keys are reported as std::runtime_error naming the file.
+namespace tls {
+
+// Device listeners: server certificate, optional client verification, a
+// server-side session cache plus session tickets so reconnecting devices
+// resume, and SSL_OP_ENABLE_KTLS so OpenSSL moves record encryption into the
+// kernel once the handshake is done (needs a socket BIO, see DeviceStream).
+boost::asio::ssl::context make_server_context(const Configuration::TlsConfig& config);
+
+// Broker link: trusted CAs (system defaults when no ca file is given),
+// optional client certificate, and a single remembered session so that
+// reconnects resume instead of running a full handshake.
+boost::asio::ssl::context make_client_context(const Configuration::TlsConfig& config);
+
+// Prepares a new client connection made with a make_client_context()
+// context: SNI and host name verification for `host` (unless the config
+// names a server), and the remembered session if there is one.
+void prepare_client(SSL* ssl, const std::string& host);
+
+// Counts a completed server handshake and whether it was resumed or uses
+// kernel TLS. Returns true when both directions run in the kernel.
+bool record_handshake(SSL* ssl);
+
+}
+
+#endif // TCP_MQTT_BRIDGE_TLS_HPP
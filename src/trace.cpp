@@ -0,0 +1,165 @@
+#include "trace.hpp"
+
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace trace {
+
+namespace detail {
+std::atomic<uint32_t> sample_every{0};
+std::atomic<uint64_t> frame_counter{0};
+}
+
+namespace {
+
+// Fields are atomics so a dump can read a ring while its owner keeps writing;
+// an event overwritten mid-read may come out torn, which is harmless here.
+struct Slot {
+    std::atomic<uint64_t> id{0};
+    std::atomic<uint64_t> ts{0};
+    std::atomic<uint8_t> stage{0};
+};
+
+struct Ring {
+    Ring(size_t capacity, uint32_t thread_index)
+        : slots(std::make_unique<Slot[]>(capacity)), capacity(capacity), thread_index(thread_index) {}
+
+    std::unique_ptr<Slot[]> slots;
+    size_t capacity;
+    uint32_t thread_index;
+    std::atomic<uint64_t> head{0};
+};
+
+struct Rings {
+    std::mutex mutex;
+    std::vector<std::shared_ptr<Ring>> all;
+    size_t capacity = 4096;
+};
+
+Rings& rings() {
+    static Rings instance;
+    return instance;
+}
+
+Ring& local_ring() {
+    thread_local std::shared_ptr<Ring> ring = [] {
+        auto& r = rings();
+        std::lock_guard lock(r.mutex);
+        auto created = std::make_shared<Ring>(r.capacity, static_cast<uint32_t>(r.all.size()));
+        r.all.push_back(created);
+        return created;
+    }();
+    return *ring;
+}
+
+struct Event {
+    uint64_t id;
+    uint64_t ts;
+    Stage stage;
+    uint32_t thread_index;
+};
+
+}
+
+const char* stage_name(Stage stage) {
+    switch (stage) {
+    case Stage::SocketRead: return "socket_read";
+    case Stage::FrameComplete: return "frame_complete";
+    case Stage::PacketMatched: return "packet_matched";
+    case Stage::Rendered: return "rendered";
+    case Stage::PublishIssued: return "publish_issued";
+    case Stage::PublishAcked: return "publish_acked";
+    case Stage::AckWritten: return "ack_written";
+    }
+    return "unknown";
+}
+
+void configure(uint32_t sample_every, size_t buffer_events) {
+    {
+        std::lock_guard lock(rings().mutex);
+        rings().capacity = std::max<size_t>(buffer_events, 16);
+    }
+    detail::sample_every.store(sample_every, std::memory_order_relaxed);
+}
+
+void record_at(uint64_t id, Stage stage, uint64_t ts_ns) {
+    if (id == 0) return;
+    Ring& ring = local_ring();
+    uint64_t head = ring.head.load(std::memory_order_relaxed);
+    Slot& slot = ring.slots[head % ring.capacity];
+    slot.id.store(id, std::memory_order_relaxed);
+    slot.ts.store(ts_ns, std::memory_order_relaxed);
+    slot.stage.store(static_cast<uint8_t>(stage), std::memory_order_relaxed);
+    ring.head.store(head + 1, std::memory_order_release);
+}
+
+std::string render_chrome_json() {
+    std::vector<std::shared_ptr<Ring>> snapshot;
+    {
+        std::lock_guard lock(rings().mutex);
+        snapshot = rings().all;
+    }
+
+    std::map<uint64_t, std::vector<Event>> frames;
+    for (const auto& ring : snapshot) {
+        uint64_t head = ring->head.load(std::memory_order_acquire);
+        uint64_t count = std::min<uint64_t>(head, ring->capacity);
+        for (uint64_t i = head - count; i < head; ++i) {
+            const Slot& slot = ring->slots[i % ring->capacity];
+            uint64_t id = slot.id.load(std::memory_order_relaxed);
+            frames[id].push_back(Event{id, slot.ts.load(std::memory_order_relaxed),
+                                       static_cast<Stage>(slot.stage.load(std::memory_order_relaxed)), ring->thread_index});
+        }
+    }
+
+    std::string out = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    bool first = true;
+    auto append = [&out, &first](const std::string& event) {
+        if (!first) out += ',';
+        out += event;
+        first = false;
+    };
+    for (auto& [id, events] : frames) {
+        std::sort(events.begin(), events.end(), [](const Event& a, const Event& b) {
+            return a.ts != b.ts ? a.ts < b.ts : a.stage < b.stage;
+        });
+        append(fmt::format(R"({{"name":"thread_name","ph":"M","pid":1,"tid":{},"args":{{"name":"frame {}"}}}})", id, id));
+        for (size_t i = 1; i < events.size(); ++i) {
+            const Event& from = events[i - 1];
+            const Event& to = events[i];
+            append(fmt::format(
+                R"({{"name":"{}","cat":"packet","ph":"X","pid":1,"tid":{},"ts":{:.3f},"dur":{:.3f},"args":{{"from":"{}","thread":{}}}}})",
+                stage_name(to.stage), id, from.ts / 1000.0, (to.ts - from.ts) / 1000.0, stage_name(from.stage), to.thread_index));
+        }
+    }
+    out += "]}";
+    return out;
+}
+
+void dump(const std::string& path) {
+    std::string json = render_chrome_json();
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream file(tmp, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            spdlog::error("Cannot write trace file {}", tmp);
+            return;
+        }
+        file << json;
+    }
+    if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+        spdlog::error("Cannot replace trace file {}", path);
+        return;
+    }
+    spdlog::info("Wrote packet trace to {} ({} bytes)", path, json.size());
+}
+
+}
@@ -0,0 +1,68 @@
+#ifndef TCP_MQTT_BRIDGE_TRACE_HPP
+#define TCP_MQTT_BRIDGE_TRACE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Sampled per-frame tracing. One in `sample_every` frames gets a non-zero
+// trace id that travels with it through the pipeline; each stage it passes is
+// recorded into a fixed-size ring owned by the recording thread. Unsampled
+// frames carry id 0 and cost a single branch per stage.
+namespace trace {
+
+enum class Stage : uint8_t {
+    SocketRead,     // read that completed the frame
+    FrameComplete,
+    PacketMatched,
+    Rendered,
+    PublishIssued,  // handed to the MQTT client (after any lane queueing)
+    PublishAcked,   // PUBACK/PUBCOMP, or write completion for QoS 0
+    AckWritten      // ACK/NAK handed to the socket
+};
+
+const char* stage_name(Stage stage);
+
+namespace detail {
+extern std::atomic<uint32_t> sample_every;
+extern std::atomic<uint64_t> frame_counter;
+}
+
+// Call once at startup, before any thread records.
+void configure(uint32_t sample_every, size_t buffer_events);
+
+inline bool enabled() {
+    return detail::sample_every.load(std::memory_order_relaxed) != 0;
+}
+
+inline uint64_t now_ns() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// Returns a trace id for the next frame, or 0 when it is not sampled.
+inline uint64_t sample() {
+    uint32_t every = detail::sample_every.load(std::memory_order_relaxed);
+    if (every == 0) return 0;
+    uint64_t n = detail::frame_counter.fetch_add(1, std::memory_order_relaxed);
+    return n % every == 0 ? n + 1 : 0;
+}
+
+void record_at(uint64_t id, Stage stage, uint64_t ts_ns);
+
+inline void record(uint64_t id, Stage stage) {
+    if (id != 0) record_at(id, stage, now_ns());
+}
+
+// Chrome trace event JSON (also loads in Perfetto): one track per sampled
+// frame, with a slice for the time spent reaching each stage.
+std::string render_chrome_json();
+
+// Writes render_chrome_json() to path, replacing it atomically.
+void dump(const std::string& path);
+
+}
+
+#endif // TCP_MQTT_BRIDGE_TRACE_HPP
@@ -0,0 +1,105 @@
+#include "typed_array.hpp"
+
+#include <fmt/format.h>
+#include <fmt/ranges.h>
+
+#include <cmath>
+#include <iterator>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <tmmintrin.h>
+#define TCP_MQTT_BRIDGE_HAVE_SSSE3 1
+#endif
+
+namespace typed_array {
+
+namespace {
+
+void byteswap_scalar(uint8_t* data, size_t count, size_t width) {
+    for (size_t i = 0; i < count; ++i, data += width) {
+        for (size_t lo = 0, hi = width - 1; lo < hi; ++lo, --hi) std::swap(data[lo], data[hi]);
+    }
+}
+
+#ifdef TCP_MQTT_BRIDGE_HAVE_SSSE3
+__attribute__((target("ssse3")))
+void byteswap_ssse3(uint8_t* data, size_t count, size_t width) {
+    __m128i mask;
+    switch (width) {
+    case 2: mask = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14); break;
+    case 4: mask = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12); break;
+    default: mask = _mm_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8); break;
+    }
+    size_t bytes = count * width;
+    size_t i = 0;
+    for (; i + 32 <= bytes; i += 32) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 16));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(data + i), _mm_shuffle_epi8(a, mask));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(data + i + 16), _mm_shuffle_epi8(b, mask));
+    }
+    for (; i + 16 <= bytes; i += 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(data + i), _mm_shuffle_epi8(a, mask));
+    }
+    // 16 is a multiple of every width, so the tail starts on an element.
+    byteswap_scalar(data + i, (bytes - i) / width, width);
+}
+
+bool have_ssse3() {
+    static const bool supported = __builtin_cpu_supports("ssse3");
+    return supported;
+}
+#endif
+
+}
+
+void byteswap(uint8_t* data, size_t count, size_t width) {
+    if (width < 2) return;
+#ifdef TCP_MQTT_BRIDGE_HAVE_SSSE3
+    if (have_ssse3()) {
+        byteswap_ssse3(data, count, width);
+        return;
+    }
+#endif
+    byteswap_scalar(data, count, width);
+}
+
+}
+
+size_t NumericArray::size() const {
+    return std::visit([](const auto& v) { return v.size(); }, storage_);
+}
+
+void NumericArray::encode(uint8_t* dst, bool big_endian) const {
+    std::visit([dst, big_endian](const auto& v) {
+        using T = typename std::decay_t<decltype(v)>::value_type;
+        std::memcpy(dst, v.data(), v.size() * sizeof(T));
+        if (sizeof(T) > 1 && big_endian != (std::endian::native == std::endian::big)) {
+            typed_array::byteswap(dst, v.size(), sizeof(T));
+        }
+    }, storage_);
+}
+
+std::string NumericArray::to_string() const {
+    return std::visit([](const auto& v) -> std::string {
+        using T = typename std::decay_t<decltype(v)>::value_type;
+        if constexpr (sizeof(T) == 1) {
+            // Keep int8/uint8 numeric rather than characters.
+            using Wide = std::conditional_t<std::is_signed_v<T>, int, unsigned>;
+            return fmt::format("[{}]", fmt::join(std::vector<Wide>(v.begin(), v.end()), ", "));
+        } else if constexpr (std::is_floating_point_v<T>) {
+            // JSON has no NaN or infinity; write null like nlohmann does.
+            std::string out = "[";
+            for (size_t i = 0; i < v.size(); ++i) {
+                if (i > 0) out += ", ";
+                if (std::isfinite(v[i])) fmt::format_to(std::back_inserter(out), "{}", v[i]);
+                else out += "null";
+            }
+            out += "]";
+            return out;
+        } else {
+            return fmt::format("[{}]", fmt::join(v, ", "));
+        }
+    }, storage_);
+}
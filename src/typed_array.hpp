@@ -0,0 +1,65 @@
+#ifndef TCP_MQTT_BRIDGE_TYPED_ARRAY_HPP
+#define TCP_MQTT_BRIDGE_TYPED_ARRAY_HPP
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <string>
+#include <variant>
+#include <vector>
+
+// Value of an array field such as `float32[64]` or `int16[8]`: the elements
+// decoded into one contiguous vector of their own type.
+class NumericArray {
+public:
+    using Storage = std::variant<
+        std::vector<uint8_t>, std::vector<uint16_t>, std::vector<uint32_t>, std::vector<uint64_t>,
+        std::vector<int8_t>, std::vector<int16_t>, std::vector<int32_t>, std::vector<int64_t>,
+        std::vector<float>, std::vector<double>
+    >;
+
+    NumericArray() = default;
+    template <typename T>
+    explicit NumericArray(std::vector<T> values) : storage_(std::move(values)) {}
+
+    // Copies `count` elements from the wire, swapping bytes when their order
+    // differs from the host's.
+    template <typename T>
+    static NumericArray decode(const uint8_t* src, size_t count, bool big_endian);
+
+    const Storage& storage() const { return storage_; }
+    size_t size() const;
+
+    // Writes the elements in the given byte order.
+    void encode(uint8_t* dst, bool big_endian) const;
+
+    // "[1, 2.5, -3]", numbers in shortest round-trip form.
+    std::string to_string() const;
+
+    bool operator==(const NumericArray& other) const { return storage_ == other.storage_; }
+
+private:
+    Storage storage_;
+};
+
+namespace typed_array {
+
+// Reverses the bytes of each `width`-byte element (2, 4 or 8) in place, with
+// SSSE3 shuffles when the CPU has them.
+void byteswap(uint8_t* data, size_t count, size_t width);
+
+}
+
+template <typename T>
+NumericArray NumericArray::decode(const uint8_t* src, size_t count, bool big_endian) {
+    std::vector<T> values(count);
+    std::memcpy(values.data(), src, count * sizeof(T));
+    if (sizeof(T) > 1 && big_endian != (std::endian::native == std::endian::big)) {
+        typed_array::byteswap(reinterpret_cast<uint8_t*>(values.data()), count, sizeof(T));
+    }
+    return NumericArray(std::move(values));
+}
+
+#endif // TCP_MQTT_BRIDGE_TYPED_ARRAY_HPP
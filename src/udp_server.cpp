@@ -0,0 +1,139 @@
+#include "udp_server.hpp"
+#include "metrics.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <cstring>
+#include <sys/socket.h>
+
+UdpServer::UdpServer(boost::asio::io_context& io_context,
+                     const boost::asio::ip::address& addr,
+                     unsigned short port,
+                     size_t batch,
+                     size_t max_datagram)
+    : socket_(io_context, endpoint_type(addr, port))
+    , batch_(batch)
+    , max_datagram_(max_datagram)
+    , buffers_(batch * max_datagram)
+    , senders_(batch)
+{
+    socket_.non_blocking(true);
+}
+
+UdpServer::~UdpServer() {
+    stop();
+}
+
+void UdpServer::start() {
+    do_receive();
+}
+
+void UdpServer::stop() {
+    if (!stopped_) {
+        stopped_ = true;
+        boost::system::error_code ec;
+        socket_.close(ec);
+    }
+}
+
+void UdpServer::do_receive() {
+    socket_.async_wait(boost::asio::ip::udp::socket::wait_read,
+        [this](boost::system::error_code ec) {
+            if (ec) {
+                if (ec != boost::asio::error::operation_aborted) {
+                    spdlog::error("UDP wait error: {}", ec.message());
+                }
+                return;
+            }
+            drain();
+            do_receive();
+        });
+}
+
+void UdpServer::drain() {
+    static auto& datagrams = metrics::counter("udp_datagrams_total", "Datagrams received");
+    static auto& syscalls = metrics::counter("udp_recv_syscalls_total", "recvmmsg calls that returned data");
+    static auto& truncated = metrics::counter("udp_truncated_total", "Datagrams dropped for exceeding the receive buffer");
+
+    std::vector<mmsghdr> msgs(batch_);
+    std::vector<iovec> iovecs(batch_);
+
+    // Bounded so a flood on one socket cannot starve the rest of the loop.
+    for (int round = 0; round < 16; ++round) {
+        for (size_t i = 0; i < batch_; ++i) {
+            iovecs[i].iov_base = buffers_.data() + i * max_datagram_;
+            iovecs[i].iov_len = max_datagram_;
+            std::memset(&msgs[i].msg_hdr, 0, sizeof(msgs[i].msg_hdr));
+            msgs[i].msg_hdr.msg_iov = &iovecs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            msgs[i].msg_hdr.msg_name = senders_[i].data();
+            msgs[i].msg_hdr.msg_namelen = static_cast<socklen_t>(senders_[i].capacity());
+        }
+
+        int n = ::recvmmsg(socket_.native_handle(), msgs.data(), static_cast<unsigned>(batch_), MSG_DONTWAIT, nullptr);
+        if (n <= 0) {
+            if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+                spdlog::error("recvmmsg failed: {}", std::strerror(errno));
+            }
+            return;
+        }
+        syscalls.inc();
+        datagrams.inc(static_cast<uint64_t>(n));
+
+        for (int i = 0; i < n; ++i) {
+            if (msgs[i].msg_hdr.msg_flags & MSG_TRUNC) {
+                truncated.inc();
+                continue;
+            }
+            senders_[i].resize(msgs[i].msg_hdr.msg_namelen);
+            if (handler_) {
+                handler_(senders_[i], std::span<const uint8_t>(buffers_.data() + i * max_datagram_, msgs[i].msg_len));
+            }
+        }
+        if (static_cast<size_t>(n) < batch_) return;
+    }
+}
+
+void UdpServer::sendTo(const endpoint_type& to, std::vector<uint8_t> data) {
+    if (stopped_) return;
+    pending_sends_.push_back(PendingSend{to, std::move(data)});
+    if (!flush_scheduled_) {
+        flush_scheduled_ = true;
+        boost::asio::post(socket_.get_executor(), [this] { flush_sends(); });
+    }
+}
+
+void UdpServer::flush_sends() {
+    static auto& sent = metrics::counter("udp_replies_sent_total", "ACK/NAK datagrams sent");
+
+    flush_scheduled_ = false;
+    if (stopped_ || pending_sends_.empty()) return;
+
+    std::vector<mmsghdr> msgs(pending_sends_.size());
+    std::vector<iovec> iovecs(pending_sends_.size());
+    for (size_t i = 0; i < pending_sends_.size(); ++i) {
+        auto& send = pending_sends_[i];
+        iovecs[i].iov_base = send.data.data();
+        iovecs[i].iov_len = send.data.size();
+        std::memset(&msgs[i].msg_hdr, 0, sizeof(msgs[i].msg_hdr));
+        msgs[i].msg_hdr.msg_iov = &iovecs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_name = send.to.data();
+        msgs[i].msg_hdr.msg_namelen = static_cast<socklen_t>(send.to.size());
+    }
+
+    size_t done = 0;
+    while (done < msgs.size()) {
+        int n = ::sendmmsg(socket_.native_handle(), msgs.data() + done, static_cast<unsigned>(msgs.size() - done), MSG_DONTWAIT);
+        if (n <= 0) {
+            // Replies are best effort; a full socket buffer drops the rest.
+            if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+                spdlog::warn("sendmmsg failed: {}", std::strerror(errno));
+            }
+            break;
+        }
+        done += static_cast<size_t>(n);
+    }
+    sent.inc(done);
+    pending_sends_.clear();
+}
@@ -0,0 +1,55 @@
+#ifndef RAWTCP_TO_MQTT_BRIDGE_UDP_SERVER_HPP
+#define RAWTCP_TO_MQTT_BRIDGE_UDP_SERVER_HPP
+
+#include <boost/asio.hpp>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <vector>
+
+// Datagram listener. Each readiness notification drains the socket with
+// recvmmsg, up to `batch` datagrams per syscall, and replies queued with
+// sendTo() are flushed together with sendmmsg. Every datagram is one frame.
+class UdpServer {
+public:
+    using endpoint_type = boost::asio::ip::udp::endpoint;
+    using DatagramHandler = std::function<void(const endpoint_type& from, std::span<const uint8_t> data)>;
+
+    UdpServer(boost::asio::io_context& io_context,
+              const boost::asio::ip::address& addr,
+              unsigned short port,
+              size_t batch = 64,
+              size_t max_datagram = 2048);
+    ~UdpServer();
+
+    UdpServer(const UdpServer&) = delete;
+    UdpServer& operator=(const UdpServer&) = delete;
+
+    void setHandler(DatagramHandler handler) { handler_ = std::move(handler); }
+    void start();
+    void stop();
+
+    void sendTo(const endpoint_type& to, std::vector<uint8_t> data);
+
+private:
+    void do_receive();
+    void drain();
+    void flush_sends();
+
+    boost::asio::ip::udp::socket socket_;
+    DatagramHandler handler_;
+    size_t batch_;
+    size_t max_datagram_;
+    std::vector<uint8_t> buffers_;      // batch_ slots of max_datagram_ bytes
+    std::vector<endpoint_type> senders_;
+
+    struct PendingSend {
+        endpoint_type to;
+        std::vector<uint8_t> data;
+    };
+    std::vector<PendingSend> pending_sends_;
+    bool flush_scheduled_{false};
+    bool stopped_{false};
+};
+
+#endif // RAWTCP_TO_MQTT_BRIDGE_UDP_SERVER_HPP
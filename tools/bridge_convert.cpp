@@ -0,0 +1,287 @@
+// Offline bulk conversion of SLIP-framed device logs.
+//
+// The input file is memory-mapped and cut into chunks at SLIP END bytes (END
+// never appears escaped, so every chunk holds whole frames). Worker threads
+// decode and render chunks with the bridge's PacketProcessor; the main thread
+// writes chunk results strictly in file order, so messages for any topic come
+// out in the order they were logged. Output is JSON Lines, or MQTT publishes
+// at a capped rate with --publish.
+
+#include "config.hpp"
+#include "mqtt_client.hpp"
+#include "packet_db_loader.hpp"
+#include "packet_db_snapshot.hpp"
+#include "packet_processor.hpp"
+#include "rate_limiter.hpp"
+#include "slip.hpp"
+
+#include <boost/program_options.hpp>
+#include <nlohmann/json.hpp>
+#include <spdlog/spdlog.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) throw std::runtime_error("cannot open " + path + ": " + std::strerror(errno));
+        struct stat st {};
+        if (::fstat(fd, &st) != 0) {
+            ::close(fd);
+            throw std::runtime_error("cannot stat " + path);
+        }
+        size_ = static_cast<size_t>(st.st_size);
+        if (size_ > 0) {
+            data_ = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data_ == MAP_FAILED) {
+                ::close(fd);
+                throw std::runtime_error("cannot map " + path + ": " + std::strerror(errno));
+            }
+            ::madvise(data_, size_, MADV_SEQUENTIAL);
+        }
+        ::close(fd);
+    }
+    ~MappedFile() {
+        if (data_ && data_ != MAP_FAILED) ::munmap(data_, size_);
+    }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    std::span<const uint8_t> data() const { return {static_cast<const uint8_t*>(data_), size_}; }
+
+private:
+    void* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+// Chunk boundaries sit just after an END byte, roughly chunk_size apart.
+std::vector<std::span<const uint8_t>> split_chunks(std::span<const uint8_t> data, size_t chunk_size) {
+    std::vector<std::span<const uint8_t>> chunks;
+    size_t begin = 0;
+    while (begin < data.size()) {
+        size_t end = data.size();
+        if (data.size() - begin > chunk_size) {
+            const void* found = std::memchr(data.data() + begin + chunk_size, slip::END, data.size() - begin - chunk_size);
+            if (found) end = static_cast<size_t>(static_cast<const uint8_t*>(found) - data.data()) + 1;
+        }
+        chunks.push_back(data.subspan(begin, end - begin));
+        begin = end;
+    }
+    return chunks;
+}
+
+struct ChunkResult {
+    std::string jsonl;
+    std::vector<PacketProcessor::MqttMessage> messages;
+    uint64_t frames = 0;
+    uint64_t failed = 0;
+    uint64_t invalid = 0;
+    bool done = false;
+};
+
+void append_jsonl(std::string& out, const PacketProcessor::MqttMessage& message) {
+    auto quoted = [](const std::string& s) {
+        return nlohmann::json(s).dump(-1, ' ', false, nlohmann::json::error_handler_t::replace);
+    };
+    out += "{\"topic\":";
+    out += quoted(message.topic);
+    if (message.format == PayloadFormat::Cbor || message.format == PayloadFormat::MsgPack) {
+        static constexpr char HEX[] = "0123456789abcdef";
+        out += ",\"payload_hex\":\"";
+        for (unsigned char c : message.payload) {
+            out += HEX[c >> 4];
+            out += HEX[c & 0x0F];
+        }
+        out += '"';
+    } else {
+        out += ",\"payload\":";
+        out += quoted(message.payload);
+    }
+    out += "}\n";
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    namespace po = boost::program_options;
+
+    po::options_description desc("bridge_convert options");
+    desc.add_options()
+        ("help,h", "Show this help message")
+        ("config,c", po::value<std::string>()->default_value("config.yaml"), "Bridge configuration (packet_defs, mqtt)")
+        ("input,i", po::value<std::string>(), "SLIP-framed input file")
+        ("output,o", po::value<std::string>()->default_value("-"), "JSON Lines output file, - for stdout")
+        ("threads,j", po::value<unsigned>()->default_value(std::max(1u, std::thread::hardware_concurrency())), "Worker threads")
+        ("chunk-mb", po::value<size_t>()->default_value(8), "Approximate chunk size in MiB")
+        ("publish", "Publish to the configured MQTT broker instead of writing JSON Lines")
+        ("rate", po::value<double>()->default_value(1000), "Publish rate cap in messages/s (0 = unlimited)")
+        ("log-level,l", po::value<std::string>()->default_value("critical"), "Log level; per-frame failures are counted, not logged");
+    po::positional_options_description positional;
+    positional.add("input", 1);
+
+    po::variables_map vm;
+    try {
+        po::store(po::command_line_parser(argc, argv).options(desc).positional(positional).run(), vm);
+        po::notify(vm);
+    } catch (const po::error& e) {
+        std::cerr << e.what() << "\n" << desc;
+        return 1;
+    }
+    if (vm.count("help") || !vm.count("input")) {
+        std::cout << "Usage: bridge_convert [options] <input>\n" << desc;
+        return vm.count("help") ? 0 : 1;
+    }
+    spdlog::set_level(Configuration::parseLogLevel(vm["log-level"].as<std::string>()));
+
+    const bool publish = vm.count("publish") > 0;
+    const unsigned threads = std::max(1u, vm["threads"].as<unsigned>());
+    const size_t chunk_size = std::max<size_t>(1, vm["chunk-mb"].as<size_t>()) << 20;
+
+    try {
+        auto config = Configuration::fromYaml(vm["config"].as<std::string>());
+        PacketDbStore packet_db(std::make_shared<const PacketDbSnapshot>(load_packet_db(config.packet_defs)));
+        MappedFile input(vm["input"].as<std::string>());
+        auto chunks = split_chunks(input.data(), chunk_size);
+
+        std::FILE* out = nullptr;
+        if (!publish) {
+            const auto& path = vm["output"].as<std::string>();
+            out = path == "-" ? stdout : std::fopen(path.c_str(), "wb");
+            if (!out) throw std::runtime_error("cannot open output " + path);
+        }
+
+        boost::asio::io_context ioc;
+        std::unique_ptr<MqttClient> mqtt;
+        if (publish) {
+            mqtt = std::make_unique<MqttClient>(ioc, config.mqtt);
+            mqtt->connect();
+        }
+
+        // Workers may run at most `window` chunks ahead of the writer, which
+        // bounds memory when the output side is slower than decoding.
+        const size_t window = threads * 4;
+        std::vector<ChunkResult> results(chunks.size());
+        std::mutex mutex;
+        std::condition_variable cv;
+        size_t written = 0;
+        std::atomic<size_t> next{0};
+
+        auto start = std::chrono::steady_clock::now();
+        auto worker = [&] {
+            PacketProcessor processor(packet_db);
+            for (size_t i = next++; i < chunks.size(); i = next++) {
+                {
+                    std::unique_lock lock(mutex);
+                    cv.wait(lock, [&] { return i < written + window; });
+                }
+                ChunkResult result;
+                result.invalid = slip::decode_all(chunks[i], [&](std::span<const uint8_t> frame) {
+                    ++result.frames;
+                    auto messages = processor.processFrame(frame);
+                    if (!messages) {
+                        ++result.failed;
+                    } else if (publish) {
+                        std::move(messages->begin(), messages->end(), std::back_inserter(result.messages));
+                    } else {
+                        for (const auto& message : *messages) append_jsonl(result.jsonl, message);
+                    }
+                });
+                result.done = true;
+                {
+                    std::lock_guard lock(mutex);
+                    results[i] = std::move(result);
+                }
+                cv.notify_all();
+            }
+        };
+
+        uint64_t frames = 0, failed = 0, invalid = 0, messages = 0, publish_errors = 0;
+        size_t outstanding = 0;
+        TokenBucket rate(vm["rate"].as<double>(), std::max(1.0, vm["rate"].as<double>() / 10));
+        {
+            std::vector<std::jthread> pool;
+            for (unsigned t = 0; t < threads; ++t) pool.emplace_back(worker);
+
+            for (size_t i = 0; i < chunks.size(); ++i) {
+                ChunkResult result;
+                {
+                    std::unique_lock lock(mutex);
+                    cv.wait(lock, [&] { return results[i].done; });
+                    result = std::move(results[i]);
+                    results[i] = ChunkResult{};
+                }
+                frames += result.frames;
+                failed += result.failed;
+                invalid += result.invalid;
+                if (publish) {
+                    for (const auto& message : result.messages) {
+                        for (auto wait = rate.waitFor(1, std::chrono::steady_clock::now()); wait.count() > 0;
+                             wait = rate.waitFor(1, std::chrono::steady_clock::now())) {
+                            std::this_thread::sleep_for(wait);
+                            ioc.poll();
+                        }
+                        rate.consume(1);
+                        while (outstanding >= 1024) ioc.run_one();
+                        ++outstanding;
+                        mqtt->publish(message.topic, message.payload, [&](boost::system::error_code ec) {
+                            --outstanding;
+                            if (ec) ++publish_errors;
+                        }, message.qos, message.retain, content_type(message.format), message.priority);
+                        ioc.poll();
+                    }
+                    messages += result.messages.size();
+                } else {
+                    messages += static_cast<uint64_t>(std::count(result.jsonl.begin(), result.jsonl.end(), '\n'));
+                    std::fwrite(result.jsonl.data(), 1, result.jsonl.size(), out);
+                }
+                {
+                    std::lock_guard lock(mutex);
+                    written = i + 1;
+                }
+                cv.notify_all();
+            }
+        }
+        if (publish) {
+            while (outstanding > 0) ioc.run_one();
+            mqtt->stop();
+            ioc.run_for(std::chrono::seconds(1));
+        } else if (out != stdout) {
+            std::fclose(out);
+        } else {
+            std::fflush(out);
+        }
+
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        const double bytes = static_cast<double>(input.data().size());
+        std::cerr << "input bytes:     " << input.data().size() << " in " << chunks.size() << " chunks\n"
+                  << "frames:          " << frames << "\n"
+                  << "messages:        " << messages << "\n"
+                  << "failed frames:   " << failed << "\n"
+                  << "invalid frames:  " << invalid << "\n";
+        if (publish) std::cerr << "publish errors:  " << publish_errors << "\n";
+        std::cerr << "threads:         " << threads << "\n"
+                  << "elapsed:         " << elapsed << " s\n"
+                  << "throughput:      " << (elapsed > 0 ? bytes / elapsed / 1e9 : 0) << " GB/s\n";
+    } catch (const std::exception& e) {
+        spdlog::critical("Conversion failed: {}", e.what());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,492 @@
+// Minimal MQTT 5 broker stand-in for benchmarking the bridge offline.
+//
+// It accepts connections, answers CONNECT, SUBSCRIBE and PINGREQ, and
+// acknowledges publishes (PUBACK for QoS 1, PUBREC/PUBCOMP for QoS 2) after
+// --delay-ms plus up to --jitter-ms, without reordering acknowledgements on a
+// connection. Messages are counted, not stored or forwarded. Disconnects can
+// be injected per connection (--disconnect-every N publishes) or as outages
+// that drop every connection and refuse new ones for a while:
+//
+//   ./mock_broker --port 1883 --delay-ms 5 --jitter-ms 20
+//   ./mock_broker --port 1883 --outage-every 30 --outage-length 5
+//
+// --receive-maximum caps the publishes a client may have unacknowledged,
+// which together with --delay-ms exercises the bridge's backpressure.
+
+#include <boost/asio.hpp>
+#include <boost/program_options.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <random>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace asio = boost::asio;
+using tcp = asio::ip::tcp;
+using clock_type = std::chrono::steady_clock;
+
+namespace {
+
+// Control packet types (upper nibble of the first byte).
+constexpr uint8_t CONNECT = 1;
+constexpr uint8_t CONNACK = 2;
+constexpr uint8_t PUBLISH = 3;
+constexpr uint8_t PUBACK = 4;
+constexpr uint8_t PUBREC = 5;
+constexpr uint8_t PUBREL = 6;
+constexpr uint8_t PUBCOMP = 7;
+constexpr uint8_t SUBSCRIBE = 8;
+constexpr uint8_t SUBACK = 9;
+constexpr uint8_t UNSUBSCRIBE = 10;
+constexpr uint8_t UNSUBACK = 11;
+constexpr uint8_t PINGREQ = 12;
+constexpr uint8_t PINGRESP = 13;
+constexpr uint8_t DISCONNECT = 14;
+
+constexpr uint8_t PROP_RECEIVE_MAXIMUM = 0x21;
+constexpr uint8_t REASON_UNSUPPORTED_PROTOCOL = 0x84;
+constexpr size_t MAX_PACKET = 16 * 1024 * 1024;
+
+struct Options {
+    std::chrono::microseconds delay;
+    std::chrono::microseconds jitter;
+    uint16_t receive_maximum;       // 0 = not sent, clients assume 65535
+    uint64_t disconnect_every;      // publishes per connection, 0 = never
+};
+
+struct Stats {
+    uint64_t connections = 0;
+    uint64_t publishes[3] = {0, 0, 0};
+    uint64_t payload_bytes = 0;
+    uint64_t acks = 0;
+    uint64_t subscribes = 0;
+    uint64_t injected_disconnects = 0;
+    uint64_t refused = 0;
+
+    uint64_t total_publishes() const { return publishes[0] + publishes[1] + publishes[2]; }
+};
+
+void put_varint(std::vector<uint8_t>& out, size_t value) {
+    do {
+        uint8_t byte = value & 0x7F;
+        value >>= 7;
+        out.push_back(value ? byte | 0x80 : byte);
+    } while (value);
+}
+
+// Decodes a variable byte integer; nullopt when more bytes are needed.
+std::optional<size_t> get_varint(std::span<const uint8_t> in, size_t& pos) {
+    size_t value = 0;
+    for (int shift = 0; shift < 28; shift += 7) {
+        if (pos >= in.size()) return std::nullopt;
+        uint8_t byte = in[pos++];
+        value |= size_t(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return value;
+    }
+    throw std::runtime_error("malformed variable byte integer");
+}
+
+uint16_t get_u16(std::span<const uint8_t> in, size_t pos) {
+    if (pos + 2 > in.size()) throw std::runtime_error("truncated packet");
+    return static_cast<uint16_t>(in[pos] << 8 | in[pos + 1]);
+}
+
+void put_ack(std::vector<uint8_t>& out, uint8_t type, uint8_t flags, uint16_t packet_id) {
+    // Remaining length 2: packet id only, reason code Success implied.
+    out.insert(out.end(), {uint8_t(type << 4 | flags), 2, uint8_t(packet_id >> 8), uint8_t(packet_id)});
+}
+
+class Session : public std::enable_shared_from_this<Session> {
+public:
+    Session(tcp::socket socket, const Options& options, Stats& stats, std::mt19937& rng)
+        : socket_(std::move(socket)), timer_(socket_.get_executor()), options_(options), stats_(stats), rng_(rng)
+    {
+        in_.resize(64 * 1024);
+    }
+
+    void start() {
+        socket_.set_option(tcp::no_delay(true));
+        read();
+    }
+
+    void close() {
+        boost::system::error_code ec;
+        socket_.close(ec);
+        timer_.cancel();
+    }
+
+    bool open() const { return socket_.is_open(); }
+
+private:
+    void read() {
+        if (used_ == in_.size()) in_.resize(in_.size() * 2);
+        socket_.async_read_some(asio::buffer(in_.data() + used_, in_.size() - used_),
+            [self = shared_from_this()](boost::system::error_code ec, size_t n) {
+                if (ec) {
+                    self->close();
+                    return;
+                }
+                self->used_ += n;
+                try {
+                    self->parse();
+                } catch (const std::exception& e) {
+                    std::cerr << "closing connection: " << e.what() << "\n";
+                    self->close();
+                    return;
+                }
+                self->flush();
+                if (self->open() && !self->closing_) self->read();
+            });
+    }
+
+    // Handles every complete packet in the buffer and keeps the remainder.
+    void parse() {
+        std::span<const uint8_t> in(in_.data(), used_);
+        size_t pos = 0;
+        while (pos < in.size() && open() && !closing_) {
+            size_t cursor = pos + 1;
+            auto length = get_varint(in, cursor);
+            if (!length) break;
+            if (*length > MAX_PACKET) throw std::runtime_error("packet too large");
+            if (cursor + *length > in.size()) break;
+            handle(in[pos] >> 4, in[pos] & 0x0F, in.subspan(cursor, *length));
+            pos = cursor + *length;
+        }
+        std::copy(in_.begin() + static_cast<std::ptrdiff_t>(pos), in_.begin() + static_cast<std::ptrdiff_t>(used_), in_.begin());
+        used_ -= pos;
+    }
+
+    void handle(uint8_t type, uint8_t flags, std::span<const uint8_t> body) {
+        switch (type) {
+        case CONNECT: {
+            // Protocol name (length-prefixed "MQTT") followed by the level.
+            size_t level_pos = 2 + get_u16(body, 0);
+            bool v5 = level_pos < body.size() && body[level_pos] == 5;
+            std::vector<uint8_t> properties;
+            if (v5 && options_.receive_maximum > 0) {
+                properties = {PROP_RECEIVE_MAXIMUM, uint8_t(options_.receive_maximum >> 8), uint8_t(options_.receive_maximum)};
+            }
+            std::vector<uint8_t> connack{uint8_t(CONNACK << 4)};
+            std::vector<uint8_t> variable{0, v5 ? uint8_t(0) : REASON_UNSUPPORTED_PROTOCOL};
+            put_varint(variable, properties.size());
+            variable.insert(variable.end(), properties.begin(), properties.end());
+            put_varint(connack, variable.size());
+            connack.insert(connack.end(), variable.begin(), variable.end());
+            out_.insert(out_.end(), connack.begin(), connack.end());
+            if (!v5) {
+                flush();
+                closing_ = true;
+            }
+            break;
+        }
+        case PUBLISH: {
+            uint8_t qos = (flags >> 1) & 3;
+            if (qos > 2) throw std::runtime_error("invalid QoS");
+            size_t pos = 2 + get_u16(body, 0);
+            uint16_t packet_id = 0;
+            if (qos > 0) {
+                packet_id = get_u16(body, pos);
+                pos += 2;
+            }
+            auto properties = get_varint(body, pos);
+            if (!properties || pos + *properties > body.size()) throw std::runtime_error("truncated PUBLISH");
+            pos += *properties;
+            ++stats_.publishes[qos];
+            stats_.payload_bytes += body.size() - pos;
+            if (qos == 1) acknowledge(PUBACK, 0, packet_id);
+            if (qos == 2) acknowledge(PUBREC, 0, packet_id);
+            if (options_.disconnect_every > 0 && ++publishes_ % options_.disconnect_every == 0) {
+                // Acknowledgements already due go out first; delayed ones are lost.
+                ++stats_.injected_disconnects;
+                closing_ = true;
+            }
+            break;
+        }
+        case PUBREL:
+            // The QoS 2 handshake completes without further delay.
+            put_ack(out_, PUBCOMP, 0, get_u16(body, 0));
+            break;
+        case SUBSCRIBE:
+        case UNSUBSCRIBE: {
+            uint16_t packet_id = get_u16(body, 0);
+            size_t pos = 2;
+            auto properties = get_varint(body, pos);
+            if (!properties) throw std::runtime_error("truncated SUBSCRIBE");
+            pos += *properties;
+            // One reason code per topic filter: the granted QoS, or Success.
+            std::vector<uint8_t> variable{uint8_t(packet_id >> 8), uint8_t(packet_id), 0};
+            while (pos < body.size()) {
+                pos += 2 + get_u16(body, pos);
+                if (type == SUBSCRIBE) {
+                    if (pos >= body.size()) throw std::runtime_error("truncated SUBSCRIBE");
+                    variable.push_back(body[pos++] & 3);
+                    ++stats_.subscribes;
+                } else {
+                    variable.push_back(0);
+                }
+            }
+            out_.push_back(uint8_t((type == SUBSCRIBE ? SUBACK : UNSUBACK) << 4));
+            put_varint(out_, variable.size());
+            out_.insert(out_.end(), variable.begin(), variable.end());
+            break;
+        }
+        case PINGREQ:
+            out_.insert(out_.end(), {uint8_t(PINGRESP << 4), 0});
+            break;
+        case DISCONNECT:
+            close();
+            break;
+        default:
+            break;
+        }
+    }
+
+    // Queues an acknowledgement, delayed when configured. A later publish is
+    // never acknowledged before an earlier one, as MQTT requires.
+    void acknowledge(uint8_t type, uint8_t flags, uint16_t packet_id) {
+        if (options_.delay.count() == 0 && options_.jitter.count() == 0) {
+            ++stats_.acks;
+            put_ack(out_, type, flags, packet_id);
+            return;
+        }
+        auto due = clock_type::now() + options_.delay;
+        if (options_.jitter.count() > 0) {
+            due += std::chrono::microseconds(std::uniform_int_distribution<int64_t>(0, options_.jitter.count())(rng_));
+        }
+        due = std::max(due, last_due_);
+        last_due_ = due;
+        delayed_.push_back(Delayed{due, type, flags, packet_id});
+        if (delayed_.size() == 1) armTimer();
+    }
+
+    void armTimer() {
+        timer_.expires_at(delayed_.front().due);
+        timer_.async_wait([self = shared_from_this()](boost::system::error_code ec) {
+            if (ec || !self->open() || self->closing_) return;
+            auto now = clock_type::now();
+            while (!self->delayed_.empty() && self->delayed_.front().due <= now) {
+                const auto& ack = self->delayed_.front();
+                ++self->stats_.acks;
+                put_ack(self->out_, ack.type, ack.flags, ack.packet_id);
+                self->delayed_.pop_front();
+            }
+            self->flush();
+            if (!self->delayed_.empty()) self->armTimer();
+        });
+    }
+
+    // Writes everything queued since the last write in one go.
+    void flush() {
+        if (writing_ || out_.empty() || !open()) {
+            if (closing_ && !writing_ && out_.empty()) close();
+            return;
+        }
+        writing_ = true;
+        sending_.swap(out_);
+        asio::async_write(socket_, asio::buffer(sending_),
+            [self = shared_from_this()](boost::system::error_code ec, size_t) {
+                self->writing_ = false;
+                self->sending_.clear();
+                if (ec) {
+                    self->close();
+                    return;
+                }
+                self->flush();
+            });
+    }
+
+    struct Delayed {
+        clock_type::time_point due;
+        uint8_t type;
+        uint8_t flags;
+        uint16_t packet_id;
+    };
+
+    tcp::socket socket_;
+    asio::steady_timer timer_;
+    const Options& options_;
+    Stats& stats_;
+    std::mt19937& rng_;
+    std::vector<uint8_t> in_;
+    size_t used_ = 0;
+    std::vector<uint8_t> out_;
+    std::vector<uint8_t> sending_;
+    bool writing_ = false;
+    bool closing_ = false;
+    std::deque<Delayed> delayed_;
+    clock_type::time_point last_due_{};
+    uint64_t publishes_ = 0;
+};
+
+class Broker {
+public:
+    Broker(asio::io_context& ioc, const tcp::endpoint& endpoint, const Options& options)
+        : acceptor_(ioc, endpoint), outage_timer_(ioc), options_(options), rng_(std::random_device{}())
+    {
+        accept();
+    }
+
+    // Every `every`, drops all connections and refuses new ones for `length`.
+    void scheduleOutages(std::chrono::seconds every, std::chrono::seconds length) {
+        outage_timer_.expires_after(every);
+        outage_timer_.async_wait([this, every, length](boost::system::error_code ec) {
+            if (ec) return;
+            std::cout << "outage: dropping " << prune() << " connections for " << length.count() << " s" << std::endl;
+            for (auto& weak : sessions_) {
+                if (auto session = weak.lock()) session->close();
+            }
+            stats_.injected_disconnects += sessions_.size();
+            sessions_.clear();
+            refusing_ = true;
+            outage_timer_.expires_after(length);
+            outage_timer_.async_wait([this, every, length](boost::system::error_code ec) {
+                if (ec) return;
+                refusing_ = false;
+                std::cout << "outage over" << std::endl;
+                scheduleOutages(every, length);
+            });
+        });
+    }
+
+    void stop() {
+        boost::system::error_code ec;
+        acceptor_.close(ec);
+        outage_timer_.cancel();
+        for (auto& weak : sessions_) {
+            if (auto session = weak.lock()) session->close();
+        }
+    }
+
+    const Stats& stats() const { return stats_; }
+    size_t connected() { return prune(); }
+
+private:
+    void accept() {
+        acceptor_.async_accept([this](boost::system::error_code ec, tcp::socket socket) {
+            if (ec == asio::error::operation_aborted) return;
+            if (!ec) {
+                if (refusing_) {
+                    ++stats_.refused;
+                    socket.close(ec);
+                } else {
+                    ++stats_.connections;
+                    auto session = std::make_shared<Session>(std::move(socket), options_, stats_, rng_);
+                    session->start();
+                    sessions_.push_back(session);
+                }
+            }
+            accept();
+        });
+    }
+
+    size_t prune() {
+        std::erase_if(sessions_, [](const std::weak_ptr<Session>& weak) {
+            auto session = weak.lock();
+            return !session || !session->open();
+        });
+        return sessions_.size();
+    }
+
+    tcp::acceptor acceptor_;
+    asio::steady_timer outage_timer_;
+    const Options& options_;
+    Stats stats_;
+    std::mt19937 rng_;
+    std::vector<std::weak_ptr<Session>> sessions_;
+    bool refusing_ = false;
+};
+
+void print_summary(const Stats& stats, double elapsed) {
+    std::cout << "connections " << stats.connections << "  publishes " << stats.total_publishes()
+              << " (qos0 " << stats.publishes[0] << ", qos1 " << stats.publishes[1] << ", qos2 " << stats.publishes[2] << ")"
+              << "  acks " << stats.acks << "  payload MB " << double(stats.payload_bytes) / 1e6
+              << "  avg msg/s " << uint64_t(double(stats.total_publishes()) / elapsed)
+              << "  subscribes " << stats.subscribes
+              << "  injected disconnects " << stats.injected_disconnects << "  refused " << stats.refused << "\n";
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    namespace po = boost::program_options;
+    po::options_description desc("Mock MQTT 5 broker");
+    desc.add_options()
+        ("help,h", "Show this help message")
+        ("bind,b", po::value<std::string>()->default_value("127.0.0.1"), "Listen address")
+        ("port,p", po::value<unsigned short>()->default_value(1883), "Listen port")
+        ("delay-ms", po::value<double>()->default_value(0), "Delay before acknowledging a publish")
+        ("jitter-ms", po::value<double>()->default_value(0), "Extra random delay, up to this much")
+        ("receive-maximum", po::value<uint16_t>()->default_value(0), "Unacknowledged publishes allowed per client (0 = unlimited)")
+        ("disconnect-every", po::value<uint64_t>()->default_value(0), "Drop a connection after every N publishes on it")
+        ("outage-every", po::value<unsigned>()->default_value(0), "Drop all connections every N seconds")
+        ("outage-length", po::value<unsigned>()->default_value(5), "Refuse connections for this many seconds after an outage")
+        ("seconds,s", po::value<unsigned>()->default_value(0), "Run time (0 = until interrupted)");
+
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+    if (vm.count("help")) {
+        desc.print(std::cout);
+        return 0;
+    }
+
+    auto micros = [](double ms) { return std::chrono::microseconds(static_cast<int64_t>(ms * 1000.0)); };
+    Options options{
+        micros(vm["delay-ms"].as<double>()),
+        micros(vm["jitter-ms"].as<double>()),
+        vm["receive-maximum"].as<uint16_t>(),
+        vm["disconnect-every"].as<uint64_t>(),
+    };
+
+    asio::io_context ioc;
+    tcp::endpoint endpoint(asio::ip::make_address(vm["bind"].as<std::string>()), vm["port"].as<unsigned short>());
+    Broker broker(ioc, endpoint, options);
+    if (auto every = vm["outage-every"].as<unsigned>(); every > 0) {
+        broker.scheduleOutages(std::chrono::seconds(every), std::chrono::seconds(vm["outage-length"].as<unsigned>()));
+    }
+    std::cout << "mock broker listening on " << endpoint << std::endl;
+
+    auto start = clock_type::now();
+    auto seconds = vm["seconds"].as<unsigned>();
+    uint64_t last_publishes = 0;
+    unsigned elapsed_s = 0;
+    asio::steady_timer report(ioc);
+    asio::signal_set signals(ioc, SIGINT, SIGTERM);
+    auto shutdown = [&] {
+        broker.stop();
+        report.cancel();
+        signals.cancel();
+    };
+    std::function<void()> tick = [&] {
+        report.expires_after(std::chrono::seconds(1));
+        report.async_wait([&](boost::system::error_code ec) {
+            if (ec) return;
+            uint64_t publishes = broker.stats().total_publishes();
+            std::cout << "msg/s " << publishes - last_publishes << "  connected " << broker.connected() << std::endl;
+            last_publishes = publishes;
+            if (seconds > 0 && ++elapsed_s >= seconds) {
+                shutdown();
+                return;
+            }
+            tick();
+        });
+    };
+    tick();
+
+    signals.async_wait([&](boost::system::error_code ec, int) {
+        if (!ec) shutdown();
+    });
+
+    ioc.run();
+    print_summary(broker.stats(), std::chrono::duration<double>(clock_type::now() - start).count());
+    return 0;
+}
@@ -0,0 +1,314 @@
+// TCP load generator for the bridge's SLIP listener, plaintext or TLS.
+//
+// Each thread opens a connection, keeps up to --window sensor_data frames
+// unacknowledged and counts the ACK/NAK frames that come back. With --pid it
+// also reads the bridge's CPU time from /proc, so running it once against a
+// plaintext listener and once against a TLS listener gives the per-frame and
+// per-byte cost of encryption on the bridge side:
+//
+//   ./tcp_loadgen --port 12345 --pid $(pidof tcp_mqtt_bridge)
+//   ./tcp_loadgen --port 12443 --tls --pid $(pidof tcp_mqtt_bridge)
+//
+// --reconnect N closes the connection every N frames to measure handshake
+// cost; sessions are resumed unless --no-resume is given.
+
+#include <boost/program_options.hpp>
+
+#include <netdb.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+constexpr uint8_t END = 0xC0;
+constexpr uint8_t ESC = 0xDB;
+constexpr uint8_t ESC_END = 0xDC;
+constexpr uint8_t ESC_ESC = 0xDD;
+constexpr uint8_t ACK = 0x06;
+constexpr uint8_t NAK = 0x15;
+
+std::atomic<uint64_t> sent{0};
+std::atomic<uint64_t> sent_bytes{0};
+std::atomic<uint64_t> acked{0};
+std::atomic<uint64_t> naked{0};
+std::atomic<uint64_t> handshakes{0};
+std::atomic<uint64_t> resumed{0};
+std::atomic<bool> running{true};
+
+struct Options {
+    std::string host;
+    std::string port;
+    size_t window;
+    size_t payload;
+    uint64_t reconnect;
+    bool tls;
+    bool resume;
+};
+
+void slip_append(std::vector<uint8_t>& out, const std::vector<uint8_t>& packet) {
+    out.push_back(END);
+    for (uint8_t b : packet) {
+        if (b == END) { out.push_back(ESC); out.push_back(ESC_END); }
+        else if (b == ESC) { out.push_back(ESC); out.push_back(ESC_ESC); }
+        else out.push_back(b);
+    }
+    out.push_back(END);
+}
+
+// sensor_data (15 bytes), optionally padded with trailing bytes the bridge
+// ignores, to see how the cost scales with frame size.
+std::vector<uint8_t> sensor_packet(uint16_t sensor_id, uint32_t seq, size_t payload) {
+    std::vector<uint8_t> p(std::max<size_t>(15, payload), 0x55);
+    p[0] = 0x10;
+    p[1] = static_cast<uint8_t>(sensor_id);
+    p[2] = static_cast<uint8_t>(sensor_id >> 8);
+    float values[3] = {20.0f + float(seq % 10), 50.0f, 1013.25f};
+    std::memcpy(p.data() + 3, values, sizeof(values));
+    return p;
+}
+
+int open_socket(const std::string& host, const std::string& port) {
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* res = nullptr;
+    if (::getaddrinfo(host.c_str(), port.c_str(), &hints, &res) != 0 || !res) return -1;
+    int fd = ::socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (fd >= 0 && ::connect(fd, res->ai_addr, res->ai_addrlen) != 0) {
+        ::close(fd);
+        fd = -1;
+    }
+    ::freeaddrinfo(res);
+    if (fd >= 0) {
+        int one = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    return fd;
+}
+
+// A blocking connection; TLS when ctx is set.
+class Connection {
+public:
+    Connection(const Options& options, SSL_CTX* ctx, SSL_SESSION*& session) {
+        fd_ = open_socket(options.host, options.port);
+        if (fd_ < 0 || !ctx) return;
+        ssl_ = SSL_new(ctx);
+        SSL_set_fd(ssl_, fd_);
+        if (session && options.resume) SSL_set_session(ssl_, session);
+        if (SSL_connect(ssl_) != 1) {
+            ERR_print_errors_fp(stderr);
+            SSL_free(ssl_);
+            ssl_ = nullptr;
+            ::close(fd_);
+            fd_ = -1;
+            return;
+        }
+        handshakes++;
+        if (SSL_session_reused(ssl_)) resumed++;
+    }
+
+    ~Connection() {
+        if (ssl_) {
+            SSL_shutdown(ssl_);
+            SSL_free(ssl_);
+        }
+        if (fd_ >= 0) ::close(fd_);
+    }
+
+    bool ok() const { return fd_ >= 0; }
+
+    // The newest session; TLS 1.3 tickets only arrive with the first reads.
+    void saveSession(SSL_SESSION*& session) {
+        if (!ssl_) return;
+        if (SSL_SESSION* current = SSL_get1_session(ssl_)) {
+            if (session) SSL_SESSION_free(session);
+            session = current;
+        }
+    }
+
+    bool writeAll(const uint8_t* data, size_t size) {
+        while (size > 0) {
+            ssize_t n = ssl_ ? SSL_write(ssl_, data, static_cast<int>(size)) : ::send(fd_, data, size, MSG_NOSIGNAL);
+            if (n <= 0) return false;
+            data += n;
+            size -= static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    ssize_t read(uint8_t* data, size_t size) {
+        return ssl_ ? SSL_read(ssl_, data, static_cast<int>(size)) : ::recv(fd_, data, size, 0);
+    }
+
+private:
+    int fd_ = -1;
+    SSL* ssl_ = nullptr;
+};
+
+void sender(const Options& options, SSL_CTX* ctx, uint16_t sensor_id) {
+    SSL_SESSION* session = nullptr;
+    uint32_t seq = 0;
+    std::vector<uint8_t> batch;
+    uint8_t replies[4096];
+
+    while (running) {
+        Connection conn(options, ctx, session);
+        if (!conn.ok()) {
+            std::cerr << "cannot connect to " << options.host << ":" << options.port << "\n";
+            running = false;
+            break;
+        }
+        uint64_t outstanding = 0;
+        uint64_t on_connection = 0;
+        while (running && (options.reconnect == 0 || on_connection < options.reconnect)) {
+            // Fill the window, then wait for at least one reply.
+            batch.clear();
+            size_t frames = 0;
+            while (outstanding + frames < options.window &&
+                   (options.reconnect == 0 || on_connection + frames < options.reconnect)) {
+                slip_append(batch, sensor_packet(sensor_id, seq++, options.payload));
+                ++frames;
+            }
+            if (frames > 0) {
+                if (!conn.writeAll(batch.data(), batch.size())) {
+                    running = false;
+                    break;
+                }
+                outstanding += frames;
+                on_connection += frames;
+                sent += frames;
+                sent_bytes += batch.size();
+            }
+            ssize_t n = conn.read(replies, sizeof(replies));
+            if (n <= 0) {
+                running = false;
+                break;
+            }
+            for (ssize_t i = 0; i < n; ++i) {
+                if (replies[i] == ACK) { acked++; --outstanding; }
+                else if (replies[i] == NAK) { naked++; --outstanding; }
+            }
+        }
+        // Collect the replies still owed before closing or stopping.
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(500);
+        while (outstanding > 0 && std::chrono::steady_clock::now() < deadline) {
+            ssize_t n = conn.read(replies, sizeof(replies));
+            if (n <= 0) break;
+            for (ssize_t i = 0; i < n; ++i) {
+                if (replies[i] == ACK) { acked++; --outstanding; }
+                else if (replies[i] == NAK) { naked++; --outstanding; }
+            }
+        }
+        conn.saveSession(session);
+    }
+    if (session) SSL_SESSION_free(session);
+}
+
+// utime + stime of a process, in seconds; negative if unavailable.
+double process_cpu_seconds(int pid) {
+    std::ifstream stat("/proc/" + std::to_string(pid) + "/stat");
+    std::string line;
+    if (pid <= 0 || !std::getline(stat, line)) return -1;
+    // Fields after the parenthesised command name; utime and stime are 14 and 15.
+    std::istringstream fields(line.substr(line.rfind(')') + 2));
+    std::string field;
+    unsigned long utime = 0, stime = 0;
+    for (int i = 3; fields >> field; ++i) {
+        if (i == 14) utime = std::stoul(field);
+        if (i == 15) { stime = std::stoul(field); break; }
+    }
+    return double(utime + stime) / double(::sysconf(_SC_CLK_TCK));
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    namespace po = boost::program_options;
+    po::options_description desc("TCP load generator");
+    desc.add_options()
+        ("help,h", "Show this help message")
+        ("host,H", po::value<std::string>()->default_value("127.0.0.1"), "Bridge host")
+        ("port,p", po::value<std::string>()->default_value("12345"), "Bridge TCP port")
+        ("threads,t", po::value<unsigned>()->default_value(1), "Connections, one thread each")
+        ("window,w", po::value<size_t>()->default_value(32), "Unacknowledged frames per connection")
+        ("payload", po::value<size_t>()->default_value(15), "Packet size in bytes (at least 15)")
+        ("reconnect", po::value<uint64_t>()->default_value(0), "Reconnect every N frames (0 = never)")
+        ("tls", "Connect with TLS (certificates are not verified)")
+        ("no-resume", "Do a full handshake on every reconnect")
+        ("pid", po::value<int>()->default_value(0), "Bridge process id, to report its CPU time")
+        ("seconds,s", po::value<unsigned>()->default_value(10), "Test duration");
+
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+    if (vm.count("help")) {
+        desc.print(std::cout);
+        return 0;
+    }
+
+    Options options{
+        vm["host"].as<std::string>(),
+        vm["port"].as<std::string>(),
+        std::max<size_t>(1, vm["window"].as<size_t>()),
+        vm["payload"].as<size_t>(),
+        vm["reconnect"].as<uint64_t>(),
+        vm.count("tls") > 0,
+        vm.count("no-resume") == 0,
+    };
+    SSL_CTX* ctx = nullptr;
+    if (options.tls) {
+        ctx = SSL_CTX_new(TLS_client_method());
+        SSL_CTX_set_verify(ctx, SSL_VERIFY_NONE, nullptr);
+    }
+
+    auto threads = std::max(1u, vm["threads"].as<unsigned>());
+    auto seconds = vm["seconds"].as<unsigned>();
+    int pid = vm["pid"].as<int>();
+    double cpu_start = process_cpu_seconds(pid);
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; ++t) {
+        workers.emplace_back(sender, std::cref(options), ctx, static_cast<uint16_t>(t + 1));
+    }
+
+    uint64_t last_acked = 0;
+    for (unsigned s = 0; s < seconds && running; ++s) {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        uint64_t now_acked = acked;
+        std::cout << "acked/s " << now_acked - last_acked << "  nak total " << naked << "\n";
+        last_acked = now_acked;
+    }
+    running = false;
+    for (auto& w : workers) w.join();
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double cpu = process_cpu_seconds(pid) - cpu_start;
+
+    std::cout << "total sent " << sent << "  acked " << acked << "  nak " << naked
+              << "  avg acked/s " << uint64_t(double(acked) / elapsed)
+              << "  MB/s " << double(sent_bytes) / elapsed / 1e6 << "\n";
+    if (options.tls) {
+        std::cout << "handshakes " << handshakes << "  resumed " << resumed << "\n";
+    }
+    if (pid > 0 && cpu_start >= 0 && acked > 0) {
+        std::cout << "bridge cpu " << cpu << " s  (" << cpu * 1e6 / double(acked) << " us/frame, "
+                  << cpu / (double(sent_bytes) / 1e9) << " s/GB)\n";
+    }
+    if (ctx) SSL_CTX_free(ctx);
+    return 0;
+}
@@ -0,0 +1,169 @@
+// UDP load generator for the bridge's datagram listener.
+//
+// Each thread owns a connected UDP socket, sends sensor_data packets in
+// sendmmsg batches and drains ACK/NAK replies with recvmmsg. The reply rate is
+// the bridge's end-to-end datagram throughput; run the bridge pinned to one
+// core (taskset -c 0) to read it as datagrams per second per core.
+
+#include <boost/program_options.hpp>
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+constexpr uint8_t ACK = 0x06;
+constexpr uint8_t NAK = 0x15;
+constexpr size_t BATCH = 64;
+
+std::atomic<uint64_t> sent{0};
+std::atomic<uint64_t> acked{0};
+std::atomic<uint64_t> naked{0};
+std::atomic<bool> running{true};
+
+std::vector<uint8_t> sensor_packet(uint16_t sensor_id, uint32_t seq) {
+    std::vector<uint8_t> p(15);
+    p[0] = 0x10;
+    p[1] = static_cast<uint8_t>(sensor_id);
+    p[2] = static_cast<uint8_t>(sensor_id >> 8);
+    float values[3] = {20.0f + float(seq % 10), 50.0f, 1013.25f};
+    std::memcpy(p.data() + 3, values, sizeof(values));
+    return p;
+}
+
+int open_socket(const std::string& host, const std::string& port) {
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    addrinfo* res = nullptr;
+    if (::getaddrinfo(host.c_str(), port.c_str(), &hints, &res) != 0 || !res) return -1;
+    int fd = ::socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (fd >= 0 && ::connect(fd, res->ai_addr, res->ai_addrlen) != 0) {
+        ::close(fd);
+        fd = -1;
+    }
+    ::freeaddrinfo(res);
+    return fd;
+}
+
+void drain_replies(int fd) {
+    uint8_t buffers[BATCH][16];
+    iovec iovecs[BATCH];
+    mmsghdr msgs[BATCH];
+    for (size_t i = 0; i < BATCH; ++i) {
+        iovecs[i] = {buffers[i], sizeof(buffers[i])};
+        std::memset(&msgs[i], 0, sizeof(msgs[i]));
+        msgs[i].msg_hdr.msg_iov = &iovecs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    int n;
+    while ((n = ::recvmmsg(fd, msgs, BATCH, MSG_DONTWAIT, nullptr)) > 0) {
+        for (int i = 0; i < n; ++i) {
+            if (msgs[i].msg_len == 1 && buffers[i][0] == ACK) acked++;
+            else if (msgs[i].msg_len == 1 && buffers[i][0] == NAK) naked++;
+        }
+    }
+}
+
+void sender(const std::string& host, const std::string& port, uint16_t sensor_id, double rate_per_thread) {
+    int fd = open_socket(host, port);
+    if (fd < 0) {
+        std::cerr << "cannot open socket to " << host << ":" << port << "\n";
+        running = false;
+        return;
+    }
+
+    std::vector<std::vector<uint8_t>> packets(BATCH);
+    iovec iovecs[BATCH];
+    mmsghdr msgs[BATCH];
+    uint32_t seq = 0;
+    auto start = std::chrono::steady_clock::now();
+    uint64_t local_sent = 0;
+
+    while (running) {
+        if (rate_per_thread > 0) {
+            auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            if (double(local_sent) > elapsed * rate_per_thread) {
+                drain_replies(fd);
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+                continue;
+            }
+        }
+        for (size_t i = 0; i < BATCH; ++i) {
+            packets[i] = sensor_packet(sensor_id, seq++);
+            iovecs[i] = {packets[i].data(), packets[i].size()};
+            std::memset(&msgs[i], 0, sizeof(msgs[i]));
+            msgs[i].msg_hdr.msg_iov = &iovecs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        int n = ::sendmmsg(fd, msgs, BATCH, 0);
+        if (n > 0) {
+            local_sent += static_cast<uint64_t>(n);
+            sent += static_cast<uint64_t>(n);
+        }
+        drain_replies(fd);
+    }
+    // Give in-flight replies a moment to arrive.
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    drain_replies(fd);
+    ::close(fd);
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    namespace po = boost::program_options;
+    po::options_description desc("UDP load generator");
+    desc.add_options()
+        ("help,h", "Show this help message")
+        ("host,H", po::value<std::string>()->default_value("127.0.0.1"), "Bridge host")
+        ("port,p", po::value<std::string>()->default_value("12346"), "Bridge UDP port")
+        ("threads,t", po::value<unsigned>()->default_value(1), "Sender threads")
+        ("rate,r", po::value<double>()->default_value(0), "Total datagrams per second (0 = as fast as possible)")
+        ("seconds,s", po::value<unsigned>()->default_value(10), "Test duration");
+
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+    if (vm.count("help")) {
+        desc.print(std::cout);
+        return 0;
+    }
+
+    auto threads = std::max(1u, vm["threads"].as<unsigned>());
+    auto seconds = vm["seconds"].as<unsigned>();
+    double rate_per_thread = vm["rate"].as<double>() / threads;
+
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; ++t) {
+        workers.emplace_back(sender, vm["host"].as<std::string>(), vm["port"].as<std::string>(),
+                             static_cast<uint16_t>(t + 1), rate_per_thread);
+    }
+
+    uint64_t last_sent = 0, last_acked = 0;
+    for (unsigned s = 0; s < seconds && running; ++s) {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        uint64_t now_sent = sent, now_acked = acked;
+        std::cout << "sent/s " << now_sent - last_sent << "  acked/s " << now_acked - last_acked
+                  << "  nak total " << naked << "\n";
+        last_sent = now_sent;
+        last_acked = now_acked;
+    }
+    running = false;
+    for (auto& w : workers) w.join();
+
+    std::cout << "total sent " << sent << "  acked " << acked << "  nak " << naked
+              << "  avg acked/s " << (seconds ? acked / seconds : 0) << "\n";
+    return 0;
+}